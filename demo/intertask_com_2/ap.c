@@ -26,19 +26,18 @@ void task_1(void *p)
 {
   struct vc_buf * buf;
   unsigned int  * data;
+  unsigned int    i = 0;
   
   xtask_create_mailbox(TASK1_MAILBOX, INBOX_SIZE, OUTBOX_SIZE);
   
   buf = xtask_get_outbox(TASK1_MAILBOX);
   buf->data_size = OUTBOX_SIZE;
-  data = (unsigned int *) buf->data;
-  
-  *data = 0;
 
   while(1) {
     xtask_delay_ticks(200);
+    data = (unsigned int *) buf->data; // buffer changes after each send
+    *data = i++;
     xtask_send_outbox(TASK1_MAILBOX, TASK2_MAILBOX);
-    (*data)++;
   }
 }
 
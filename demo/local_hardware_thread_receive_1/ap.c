@@ -29,7 +29,7 @@ void task_1(void *p)
   unsigned int *data;
   struct vc_buf *buf;
   
-  handle = xtask_create_thread(hardware_thread, 128, (void *)0, 4, 4, 4);
+  handle = xtask_create_thread(hardware_thread, 128, (void *)0, 4, 4, 4, 2);
   
   while (1) {
     buf = xtask_vc_receive(handle, 0);
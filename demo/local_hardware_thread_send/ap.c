@@ -30,7 +30,7 @@ void task_1(void *p)
   struct vc_buf *buf;
   unsigned int i = 0;
   
-  handle = xtask_create_thread(hardware_thread, 128, (void *)0, 4, 4, 4);
+  handle = xtask_create_thread(hardware_thread, 128, (void *)0, 4, 4, 4, 2);
   
   buf = xtask_vc_get_write_buf(handle);
   
@@ -40,7 +40,7 @@ void task_1(void *p)
     buf->data_size = 4;
     data = (unsigned int *) buf->data;
     *data = i;
-    buf = xtask_vc_send(buf);
+    buf = xtask_vc_send(handle, buf);
     i++;
   }
 }
@@ -0,0 +1,99 @@
+/******************************************************************************
+ *                                                                            *
+ * File:   ap.c                                                               *
+ * Author: Bianco Zandbergen <bianco [AT] zandbergen.name>                    *
+ *                                                                            *
+ * Comparing the throughput of a virtual channel in per object mode with a    *
+ * virtual channel in streaming mode. A dedicated hardware thread sends data  *
+ * to the task in each mode and the task measures the time it takes to        *
+ * receive the same amount of data. Run in the simulator with make runsim.    *
+ *                                                                            *
+ ******************************************************************************/
+#include <stdio.h>
+#include <xccompat.h>
+#include "../../xtask/include/xtask.h"
+
+// words per buffer and number of buffers to receive in each mode
+#define BUF_WORDS 64
+#define NR_BUFS   64
+
+unsigned int ref_time(void);
+void infinite_send(chanend c);
+
+void idle_task(void *p)
+{
+  while(1);
+}
+
+void object_thread(void *p, chanend c)
+{  
+  infinite_send(c);  
+}
+
+void stream_thread(void *p, chanend c)
+{
+  unsigned int data[BUF_WORDS];
+  unsigned int i = 0;
+  int j;
+  
+  while (1) {
+    for (j = 0; j < BUF_WORDS; j++) {
+      data[j] = i++;
+    }
+    
+    xtask_hwt_stream_send(c, data, BUF_WORDS);
+  }
+}
+
+unsigned int measure(unsigned int handle)
+{
+  unsigned int start;
+  int i;
+  
+  xtask_vc_receive(handle, 0); // wait until the hardware thread runs
+  start = ref_time();
+  
+  for (i = 0; i < NR_BUFS; i++) {
+    xtask_vc_receive(handle, 0);
+  }
+  
+  return ref_time() - start;
+}
+
+void task_1(void *p)
+{
+  unsigned int handle;
+  unsigned int ticks;
+  
+  handle = xtask_create_thread(object_thread, 128, (void *)0, 4, 
+                               BUF_WORDS * 4, 4, 2);
+  ticks = measure(handle);
+  printf("per object: %u words in %u ticks\n", BUF_WORDS * NR_BUFS, ticks);
+  
+  handle = xtask_create_thread(stream_thread, 128 + BUF_WORDS, (void *)0, 4, 
+                               BUF_WORDS * 4, 4, 2 | VC_STREAM);
+  ticks = measure(handle);
+  printf("streaming:  %u words in %u ticks\n", BUF_WORDS * NR_BUFS, ticks);
+  
+  while (1);
+}
+
+void init_tasks_1()
+{
+  xtask_create_init_task(task_1, 512, 1, 1, (void *)0);  
+}
+
+void init_tasks_2()
+{
+  
+}
+
+void start_kernel_0(chanend r, chanend w)
+{
+  xtask_kernel(init_tasks_1, idle_task, 100000, r, w);
+}
+
+void start_kernel_1(chanend r, chanend w)
+{
+  xtask_kernel(init_tasks_2, idle_task, 100000, r, w);
+}
@@ -14,42 +14,95 @@
 // inbox state flags
 #define INBOX_TASK_WAITING 0x01
 #define INBOX_SENDER_PEND  0x02
+#define INBOX_RECEIVING    0x04
 
 // pending kernel reply state flags
 #define KR_FREE 0x00
 #define KR_USED 0x01
 
+// number of pending kernel replies added to the pool at once
+#define KR_POOL_SIZE 8
+
 // look for pending senders on local CS or all CS
 #define LOCAL_TILE 1
 #define ALL_TILES  2
 
+// mailbox registration (cmd 5) operations
+#define MB_CREATE 0
+#define MB_DELETE 1
+
+// topic subscription (cmd 17) operations
+#define SUB_ADD    0
+#define SUB_REMOVE 1
+
+// mailbox index: log2 of initial number of slots and removed slot marker
+#define MB_INDEX_BITS 4
+#define MB_TOMBSTONE  ((struct mailbox *) 1)
+
+// number of hardware locks on a tile
+#define NR_HW_LOCKS 4
+
+// number of management request commands
+#define NR_MAN_CMDS 22
+
+// hardware threads and chanends of a tile
+#define NR_HW_THREADS 8
+#define NR_CHANENDS   32
+
+// remote hardware thread (cmd 6): target CS id in upper half of code,
+// tx buffer size in upper half of rx buffer size
+#define ANY_TILE          0
+#define LEAST_LOADED_TILE 0xFFFF
+#define HWT_CS_SHIFT      16
+#define HWT_CODE_MASK     0x0000FFFF
+#define VC_SIZE_SHIFT     16
+#define VC_SIZE_MASK      0x0000FFFF
+
+// ring bus payload buffer size in bytes
+#define RING_PAYLOAD_SIZE 512
+
+// number of ring bus buffers allocated at start, more are added when needed
+#define RING_NR_BUFS 4
+
+// words of ring bus message header: cs_id, msg_type, status, req_id, dest, payload_size
+#define RING_HDR_WORDS 6
+
+// words of routed message header on a link: cs_id, dest, msg_type, status, payload_size
+#define LINK_HDR_WORDS 5
+
+// mailbox directory: number of hash buckets of cached mailbox locations
+#define MB_LOC_BUCKETS 32
+
+// number of fragments of a large message on the ring bus at once
+#define RING_FRAG_WINDOW 2
+
+// CS id flag: run the ring bus on a hardware thread of its own
+#define CS_RING_THREAD 0x8000
+
+// stack size in words of the ring thread
+#define RING_THREAD_STACK 256
+
+// routing table entry of a CS that can not be reached through a link
+#define NO_ROUTE 0xFFFFFFFF
+
 // send reply back to kernel or not
 #define REPLY    1
 #define NO_REPLY 0
 
-// virtual channel read buffers flags
-#define CS_RD_BUF0      0x0000000001
-#define CS_RD_BUF1      0x0000000002
-#define TASK_RD_BUF0    0x0000000004
-#define TASK_RD_BUF1    0x0000000008
-#define TASK_RD_BUFS    0x000000000C
-#define RD_BUF0_FIRST   0x0000000010
-#define RD_BUF1_FIRST   0x0000000020
-#define RD_BUF0_FILLED  0x0000000040
-#define RD_BUF1_FILLED  0x0000000080
-#define RD_BUFS_FILLED  0x00000000C0
-
-// virtual channel write buffers flags
-#define CS_WR_BUF0      0x0000000100
-#define CS_WR_BUF1      0x0000000200
-#define TASK_WR_BUF0    0x0000000400
-#define TASK_WR_BUF1    0x0000000800
-#define TASK_WR_BUFS    0x0000000C00
-#define WR_BUF0_FIRST   0x0000001000
-#define WR_BUF1_FIRST   0x0000002000
-#define WR_BUF0_FILLED  0x0000004000
-#define WR_BUF1_FILLED  0x0000008000
-#define WR_BUFS_FILLED  0x000000C000
+// virtual channel buffer rings: number of buffers per direction,
+// the number is passed to CS in the upper half of the object size
+// together with the VC_STREAM and VC_SHM mode flags
+#define VC_DEFAULT_BUFS 2
+#define VC_MIN_BUFS     2
+#define VC_MAX_BUFS     64
+#define VC_BUFS_SHIFT   16
+#define VC_OBJ_MASK     0x0000FFFF
+#define VC_STREAM       0x8000
+#define VC_SHM          0x4000
+#define VC_MODE_MASK    (VC_STREAM | VC_SHM)
+
+// no buffer index
+#define VC_NO_BUF       0xFFFFFFFF
 
 // virtual channel receive disabled flag
 #define CS_RD_BLOCK     0x0000010000
@@ -57,7 +110,25 @@
 // task blocked on virtual channel read flag
 #define TASK_RD_BLOCK   0x0000020000
 
-// management message
+// task blocked on virtual channel write buffer flag
+#define TASK_WR_BLOCK   0x0000040000
+
+// stream frame accepted but not yet received, waiting for a read buffer
+#define VC_RX_PENDING   0x0000080000
+
+// hardware thread has exited
+#define VC_EXITED       0x0000100000
+
+// task waits until hardware thread exits
+#define VC_JOIN_WAIT    0x0000200000
+
+// virtual channel transfer states (vchan->tx_state)
+#define VC_TX_IDLE      0  // no transfer in progress
+#define VC_TX_START     1  // waiting for hardware thread to accept object
+#define VC_TX_END       2  // waiting for hardware thread to finish object
+
+// management message, sent as a header word (cmd | number of parameters << 24)
+// followed by the parameters up to the last one that is not 0
 struct man_msg {
   unsigned int cmd;
   unsigned int p0;
@@ -72,6 +143,8 @@ struct man_msg {
 #include <xccompat.h>
 #include "../include/kernel.h"
 
+struct chan_event;
+
 /* pending kernel reply */
 struct p_kreply {
   unsigned char state;         /* in use or not */
@@ -87,13 +160,57 @@ struct cs_data {
   struct vchan  * vchans;      /* list of virtual channels (to hardware threads) */
   chanend ring_in;             /* ring bus input chanend */
   chanend ring_out;            /* ring bus output chanend */
-  struct ring_buf *rbuf;       /* ring bus buffer */
+  struct ring_buf *rbuf;       /* routed message buffer */
   unsigned int id;             /* Communication Server id, must be unique */
   struct mailbox *mailboxes;   /* list of all registered mailboxes */
   struct mailbox *p_outbox;    /* list of mailboxes with pending sends (recipient not ready) */
   struct p_request *p_reqs;    /* pending ring bus replies */
-  struct p_kreply k_replies[8]; /* pending kernel replies */
+  struct p_kreply *kr_pool;    /* free pending kernel replies */
+  unsigned int kr_pool_size;   /* number of allocated pending kernel replies */
+  unsigned int nr_kr;          /* number of pending kernel replies of all kernels */
+  unsigned int max_kr;         /* high-water mark of nr_kr */
   int ring;                    /* has ring bus? */
+  struct ring_buf *rb_free;    /* free ring bus buffers */
+  struct ring_buf *tx_head;    /* ring bus messages waiting to be sent, oldest first */
+  struct ring_buf *tx_tail;    /* last ring bus message waiting to be sent */
+  unsigned int tx_word;        /* next word of tx_head to send */
+  struct ring_buf *rx_buf;     /* ring bus message being received */
+  unsigned int rx_word;        /* number of words of rx_buf received */
+  unsigned int next_req_id;    /* id of last ring bus request */
+  struct mb_location *mb_locs[MB_LOC_BUCKETS]; /* cached CS id of mailboxes on other tiles */
+  struct ev_group *ev_groups;  /* list of registered event flag groups */
+  struct subscription *subs;   /* topic subscriptions of mailboxes on this tile */
+  struct hwt_entry *hwt_codes; /* registered hardware thread entry points */
+  struct vchan *hwt_pool;      /* parked hardware threads with their channel and stack */
+  unsigned int nr_threads;     /* hardware threads started by this CS */
+  struct hwt_stack *hwt_stacks; /* stacks of threads started by code on this tile */
+  struct cs_link *links;       /* point-to-point links to neighbour CS */
+  unsigned int nr_links;       /* number of links */
+  unsigned int *route;         /* link index to use for each CS id, or NO_ROUTE */
+  unsigned int nr_routes;      /* number of entries in route */
+  struct p_remote *p_remote;   /* senders on other tiles waiting for a local mailbox */
+  unsigned int locks[NR_HW_LOCKS]; /* hardware locks for shared objects */
+  unsigned int nr_locks;       /* number of allocated hardware locks */
+  unsigned int next_lock;      /* next lock to share when all are allocated */
+  struct mailbox **mb_slots;   /* open addressing hash index of mailboxes by id */
+  unsigned int mb_size;        /* number of slots, power of two */
+  unsigned int mb_bits;        /* log2 of mb_size */
+  unsigned int mb_used;        /* number of mailboxes in index */
+  unsigned int mb_filled;      /* number of used slots including tombstones */
+  struct vchan **vc_table;     /* virtual channels indexed by handle */
+  unsigned int vc_table_size;  /* number of entries in vc_table */
+  unsigned int nr_vchans;      /* number of handles in use, handle 0 is invalid */
+  unsigned int rt_lock;        /* lock of rb_free and hand-off lists, 0 without ring thread */
+  chanend rt_c;                /* doorbell chanend of server thread, 0 without ring thread */
+  chanend rt_hwt_c;            /* doorbell chanend of ring thread */
+  struct ring_buf *rt_rx_head; /* received messages for the server thread, oldest first */
+  struct ring_buf *rt_rx_tail; /* last received message for the server thread */
+  struct ring_buf *rt_tx_head; /* messages for the ring thread to send, oldest first */
+  struct ring_buf *rt_tx_tail; /* last message for the ring thread to send */
+  volatile unsigned int rt_starved; /* ring thread waits for free ring bus buffers */
+  unsigned int (*man_table[NR_MAN_CMDS])(struct cs_data *    csdata, /* management request table */
+                                         struct cs_kernel *  k,
+                                         struct chan_event * evt);
 };
 
 /* kernel communication information */
@@ -102,7 +219,11 @@ struct cs_kernel {
   chanend c_async;             /* asynchronous channel (notification) */
   struct chan_event *event;    /* chanend event settings */
   struct cs_kernel *next;      /* list pointer */
-  
+  struct p_kreply *kr_head;    /* queue of pending replies, oldest first */
+  struct p_kreply *kr_tail;    /* last pending reply */
+  unsigned int nr_kr;          /* number of pending replies */
+  unsigned int max_kr;         /* high-water mark of nr_kr */
+  unsigned int kr_notified;    /* notification sent, queue not drained yet */
 };
 
 /* chanend event settings */
@@ -116,11 +237,14 @@ struct chan_event {
   struct chan_event * next;    /* list pointer */
 };
 
-/* buffer for virtual channels and mailboxes */
+/* buffer for virtual channels and mailboxes,
+   tasks only see the first three fields (see xtask.h) */
 struct vc_buf {
   void *data;                  /* pointer to data buffer */
   unsigned int buf_size;       /* buffer size (bytes) */
   unsigned int data_size;      /* amount of data (bytes) in buffer */
+  struct vchan *vc;            /* virtual channel of buffer, NULL for mailboxes */
+  unsigned int nr;             /* buffer number within the virtual channel */
 };
 
 /* virtual channel information */
@@ -128,15 +252,52 @@ struct vchan {
   struct chan_event *event;    /* pointer to chanend event settings */
   unsigned int obj_size;       /* channel transfer object size */
   struct cs_data *csdata;      
-  struct vc_buf read_bufs[2];  /* two read buffers */
-  struct vc_buf write_bufs[2]; /* two write buffers */
-  unsigned int state;          /* state flags, mainly buffer states */
+  unsigned int tx_state;       /* transfer state, checked first by _xtask_vc_vect */
+  unsigned int stream;         /* VC_STREAM: framed bursts, VC_SHM: shared rings */
+  unsigned int tx_offset;      /* offset of object in write buffer being transferred */
+  unsigned int rx_len;         /* length in words of pending stream frame */
+  struct vc_buf *read_bufs;    /* ring of nr_bufs read buffers */
+  struct vc_buf *write_bufs;   /* ring of nr_bufs write buffers */
+  unsigned int nr_bufs;        /* number of buffers in each ring */
+  unsigned int rd_head;        /* oldest filled read buffer */
+  unsigned int rd_fill;        /* read buffer that CS is filling */
+  unsigned int rd_filled;      /* number of completely filled read buffers */
+  unsigned int rd_task;        /* read buffer held by task or VC_NO_BUF */
+  unsigned int wr_head;        /* oldest write buffer queued for transfer */
+  unsigned int wr_queued;      /* number of write buffers queued for transfer */
+  unsigned int wr_task;        /* write buffer held by task or VC_NO_BUF */
+  unsigned int state;          /* state flags */
   unsigned int handle;         /* virtual channel handle used by task */
   unsigned int min_read_size;  /* minimum amount of data to read for task */
   unsigned int thread_chanend; /* CS chanend of channel */
   unsigned int own_chanend;    /* hardware thread chanend of channel */
   struct cs_kernel *kernel;    /* kernel of task that owns this virtual channel */
-  struct vchan *next;          /* list pointer */
+  struct vc_shm *shm;          /* rings shared with hardware thread, NULL if not VC_SHM */
+  unsigned int *stack;         /* stack of hardware thread on this tile, NULL if remote */
+  unsigned int host_cs;        /* CS id that started the thread by code */
+  unsigned int stack_words;    /* stack size in words */
+  unsigned int exit_status;    /* exit status of hardware thread */
+  unsigned int join_tid;       /* task id of task waiting for exit */
+  struct cs_kernel *join_kernel; /* kernel of task waiting for exit */
+  struct vchan *next;          /* list pointer, also for pool of parked threads */
+};
+
+/* buffer rings of a virtual channel in VC_SHM mode, shared with a hardware
+   thread on this tile. Counters run modulo 2 * nr_bufs, each counter has 
+   one writer, so no lock is needed */
+struct vc_shm {
+  struct vc_buf *read_bufs;       /* ring filled by the hardware thread */
+  struct vc_buf *write_bufs;      /* ring filled by the task */
+  unsigned int nr_bufs;           /* number of buffers in each ring */
+  chanend c;                      /* chanend of hardware thread, for doorbells */
+  volatile unsigned int rd_put;   /* read buffers filled, written by thread */
+  volatile unsigned int rd_get;   /* read buffers returned by task, written by CS */
+  volatile unsigned int wr_put;   /* write buffers sent by task, written by CS */
+  volatile unsigned int wr_get;   /* write buffers taken by thread, written by thread */
+  volatile unsigned int rd_wait;  /* thread waits for a free read buffer */
+  volatile unsigned int wr_wait;  /* thread waits for a write buffer */
+  unsigned int rd_seen;           /* rd_put handled by CS */
+  unsigned int wr_done;           /* wr_get handled by CS */
 };
 
 /* intertask communication mailbox */
@@ -148,15 +309,85 @@ struct mailbox {
   struct vc_buf outbox;        /* mailbox outbox */
   unsigned int inbox_state;    /* state flags */
   unsigned int outbox_dest;    /* recipient mailbox id */
+  unsigned int outbox_cs;      /* CS id of recipient for a routed send, 0 if none */
+  unsigned int rx_cs;          /* CS id of sender of large message being received */
+  unsigned int rx_req;         /* request id of large message being received */
+  unsigned int rx_size;        /* size of large message being received */
+  struct vc_buf *queue;        /* ring of queued messages, NULL when not queued */
+  unsigned int q_depth;        /* number of messages the queue can hold */
+  unsigned int q_head;         /* index of oldest queued message */
+  unsigned int q_count;        /* number of queued messages */
   struct mailbox *p_next;      /* list pointer for pending mailboxes list */
   struct mailbox *next;        /* list pointer for all mailboxes list */
 };
 
+/* event flag group registered by a kernel on this tile */
+struct ev_group {
+  unsigned int id;             /* event flag group id, must be unique */
+  struct cs_kernel *kernel;    /* kernel that owns the group */
+  unsigned int handle;         /* group handle at that kernel */
+  struct ev_group *next;       /* list pointer */
+};
+
+/* point-to-point link to a neighbour CS */
+struct cs_link {
+  chanend c_in;                /* chanend for incoming routed messages */
+  chanend c_out;               /* chanend for outgoing routed messages */
+  struct cs_data *csdata;      /* CS that owns the link */
+  struct chan_event *event;    /* event settings of c_in */
+  struct chan_event *tx_event; /* event settings of c_out */
+  struct ring_buf *tx_head;    /* routed messages waiting to be sent, oldest first */
+  struct ring_buf *tx_tail;    /* last routed message waiting to be sent */
+  unsigned int tx_word;        /* next word of tx_head to send */
+  struct ring_buf *rx_buf;     /* routed message being received */
+  unsigned int rx_word;        /* number of words of rx_buf received */
+};
+
+/* sender on another tile waiting until a local mailbox is ready */
+struct p_remote {
+  unsigned int cs_id;          /* CS of the sender */
+  unsigned int mb_id;          /* local recipient mailbox id */
+  struct p_remote *next;       /* list pointer */
+};
+
+/* topic subscription of a mailbox on this tile */
+struct subscription {
+  unsigned int topic;          /* topic id */
+  struct mailbox *mb;          /* subscribed mailbox */
+  struct subscription *next;   /* list pointer */
+};
+
+/* hardware thread entry point that can be started by code from another tile */
+struct hwt_entry {
+  unsigned int code;           /* function number, unique on the tile */
+  void *pc;                    /* entry point of hardware thread */
+  struct hwt_entry *next;      /* list pointer */
+};
+
+/* stack of a hardware thread started by code on this tile */
+struct hwt_stack {
+  chanend c;                   /* chanend of the hardware thread */
+  unsigned int *stack;         /* stack, freed when the thread ends */
+  struct hwt_stack *next;      /* list pointer */
+};
+
+/* location of a mailbox on another tile */
+struct mb_location {
+  unsigned int id;             /* mailbox id */
+  unsigned int cs_id;          /* CS id of the tile of the mailbox */
+  struct mb_location *next;    /* list pointer for hash bucket */
+};
+
 /* pending ring bus reply */
 struct p_request {
   struct cs_kernel *kernel;    /* kernel of task that did request */
   unsigned int tid;            /* task id */
   unsigned int msg_type;       /* ring bus message type */
+  unsigned int req_id;         /* request id, returned in the reply */
+  unsigned int offset;         /* bytes of large message sent */
+  unsigned int nr_frags;       /* fragments of large message on the ring bus */
+  unsigned int failed;         /* a fragment of large message was not delivered */
+  unsigned int dest;           /* CS id of recipient of large message */
   void *data;                  /* pointer to saved state */
   struct p_request *next;      /* list pointer */
 };
@@ -168,32 +399,147 @@ struct ring_buf {
   unsigned int status;         /* message status */
   unsigned int payload_size;   /* payload size in bytes */
   void * payload;              /* pointer to buffer */
+  unsigned int dest;           /* destination CS id, 0 = all CS on the ring bus */
+  unsigned int req_id;         /* request id of ring bus message, 0 = none */
+  struct ring_buf *next;       /* list pointer */
 };
 
 // function prototypes
-void test_hardware_thread(void *args, chanend c);
+void xtask_comserver_mesh(chanend man_sync[], chanend man_async[], unsigned int nr_man_chan, 
+                          chanend ring_in, chanend ring_out, 
+                          chanend link_in[], chanend link_out[], unsigned int nr_links,
+                          unsigned int route[], unsigned int nr_routes, unsigned int id);
 
 void         _xtask_man_sendrec(chanend c, void *msg);
 void         _xtask_man_send(chanend c, void *msg);
 void         _xtask_man_chan_vec();
+void         _xtask_link_vec();
+void         _xtask_link_tx_vec();
 void         _xtask_vc_vect();
 void         _xtask_set_chan_event(void *chan_event);
 chanend      _xtask_get_chanend();
+void         _xtask_free_chanend(chanend c);
 void         _xtask_set_chanend_dest(chanend chan, chanend dest);
 void         _xtask_set_cs_data(void *data);
 unsigned int _xtask_create_thread(void *pc, void *sp, void *args, chanend c);
 void         _xtask_send_man_msg(chanend c, void *msg);
 void         _xtask_chan_enable_events(chanend c);
-void         _xtask_ring_send(void *csdata);
 void         _xtask_notify_kernel(chanend ce);
 void         _xtask_ring_vec();
-
-void         test_hardware_thread(void *args, chanend c);
+void         _xtask_ring_tx_vec();
+void         _xtask_ring_server_vec();
+void         _xtask_ring_thread_vec();
+void         _xtask_hwt_park(chanend c);
 
 struct mailbox   * xtask_get_mailbox(struct cs_data *csdata, unsigned int id);
-struct p_kreply  * xtask_get_free_kreply(struct cs_data *csdata);
+struct vchan     * xtask_get_vchan(struct cs_data *csdata, unsigned int handle);
+void               xtask_vc_register(struct cs_data *csdata, struct vchan *vc);
+void               xtask_vc_alloc_bufs(struct vchan *vc, unsigned int obj_size,
+                                       unsigned int rx_size, unsigned int tx_size);
+void               xtask_vc_free(struct vchan *vc);
+void               xtask_vc_free_bufs(struct vchan *vc);
+void               xtask_vc_reset(struct vchan *vc);
+unsigned int       xtask_vc_nr_bufs(unsigned int obj_size);
+unsigned int       xtask_vc_bufs_fit(struct vchan *vc, unsigned int obj_size,
+                                     unsigned int rx_size, unsigned int tx_size);
+void               xtask_vc_exit(struct vchan *vc);
+void               xtask_vc_join(struct cs_data *csdata, struct vchan *vc);
+void               xtask_vc_release(struct cs_data *csdata, struct vchan *vc);
+void               xtask_hwt_restart(struct vchan *vc, void *pc, unsigned int args);
+struct vc_buf    * xtask_vc_take_rd_buf(struct vchan *vc);
+void               xtask_vc_tx_start(struct vchan *vc);
+void               xtask_vc_tx_complete(struct vchan *vc);
+void               xtask_vc_wake_reader(struct vchan *vc, struct cs_data *csdata);
+void               xtask_vc_stream_rx_frame(struct vchan *vc);
+void               xtask_vc_shm_event(struct vchan *vc);
+void               xtask_vc_shm_publish(struct vchan *vc);
+void               xtask_vc_shm_kick(struct vchan *vc, volatile unsigned int *wait);
+void               xtask_vc_shm_attach(struct vchan *vc);
+void               xtask_mb_index_resize(struct cs_data *csdata, unsigned int bits);
+void               xtask_mb_index_insert(struct cs_data *csdata, struct mailbox *mb);
+void               xtask_mb_index_remove(struct cs_data *csdata, struct mailbox *mb);
+unsigned int       xtask_mb_move(struct vc_buf *dst, struct vc_buf *src);
+unsigned int       xtask_mb_queue_put(struct mailbox *mb, struct vc_buf *msg);
+void               xtask_mb_queue_get(struct mailbox *mb);
+unsigned int       xtask_mb_offer(struct cs_data *csdata, struct mailbox *mb, 
+                                  void *data, unsigned int size);
+unsigned int       xtask_topic_deliver(struct cs_data *csdata, unsigned int topic,
+                                       void *data, unsigned int size);
+unsigned int       xtask_link_send(struct cs_data *csdata, unsigned int dest);
+void               xtask_link_queue(struct cs_link *link, struct ring_buf *rb);
+void               xtask_link_tx_word(struct cs_link *link);
+void               xtask_link_tx_event(struct cs_link *link);
+void               xtask_link_receive(struct cs_link *link);
+void               xtask_process_routed_msg(struct cs_data *csdata);
+unsigned int       xtask_mb_route_send(struct cs_data *csdata, struct mailbox *send_mb);
+struct ev_group  * xtask_get_ev_group(struct cs_data *csdata, unsigned int id);
+struct hwt_entry * xtask_get_hwt_code(struct cs_data *csdata, unsigned int code);
+void               xtask_kreply_pool_grow(struct cs_data *csdata, unsigned int n);
+struct p_kreply  * xtask_get_free_kreply(struct cs_data *csdata, struct cs_kernel *k);
 struct p_kreply  * xtask_get_kreply(struct cs_data *csdata, struct cs_kernel *k);
+void               xtask_notify_kernel(struct cs_kernel *k);
+void               xtask_free_kreply(struct cs_data *csdata, struct p_kreply *kr);
 struct p_request * xtask_get_free_p_request(struct cs_data *csdata);
+struct p_request * xtask_take_p_request(struct cs_data *csdata, unsigned int req_id);
+struct ring_buf  * xtask_ring_alloc(struct cs_data *csdata);
+void               xtask_ring_free(struct cs_data *csdata, struct ring_buf *rb);
+void               xtask_ring_pool_grow(struct cs_data *csdata, unsigned int n);
+struct ring_buf  * xtask_ring_pool_get(struct cs_data *csdata);
+void               xtask_ring_lock(struct cs_data *csdata);
+void               xtask_ring_unlock(struct cs_data *csdata);
+void               xtask_ring_send(struct cs_data *csdata, struct ring_buf *rb);
+void               xtask_ring_queue(struct cs_data *csdata, struct ring_buf *rb);
+unsigned int       xtask_ring_start_thread(struct cs_data *csdata);
+void               xtask_ring_thread(void *args, chanend c);
+void               xtask_ring_put(struct cs_data *csdata, struct ring_buf **head,
+                                  struct ring_buf **tail, struct ring_buf *rb, chanend c);
+struct ring_buf  * xtask_ring_take(struct cs_data *csdata, struct ring_buf **head,
+                                   struct ring_buf **tail);
+void               xtask_ring_server_event(struct cs_data *csdata);
+void               xtask_ring_thread_event(struct cs_data *csdata);
+void               xtask_ring_tx_word(struct cs_data *csdata);
+void               xtask_ring_tx_event(struct cs_data *csdata);
+void               xtask_ring_receive(struct cs_data *csdata);
+void               xtask_ring_send_outbox(struct cs_data *csdata, struct mailbox *send_mb);
+void               xtask_ring_send_frags(struct cs_data *csdata, struct p_request *pr);
+unsigned int       xtask_mb_loc_get(struct cs_data *csdata, unsigned int id);
+void               xtask_mb_loc_set(struct cs_data *csdata, unsigned int id, unsigned int cs_id);
+void               xtask_mb_loc_remove(struct cs_data *csdata, unsigned int id, unsigned int cs_id);
+void               xtask_mb_loc_announce(struct cs_data *csdata, unsigned int msg_type, 
+                                         unsigned int id);
+void               xtask_process_ring_msg(struct cs_data *csdata, struct ring_buf *rb);
+unsigned int       xtask_hwt_score(struct cs_data *csdata, unsigned int code);
+chanend            xtask_hwt_start(struct cs_data *csdata, unsigned int code, 
+                                   unsigned int stackwords, unsigned int args, 
+                                   unsigned int cs_c);
+void               xtask_hwt_end(struct cs_data *csdata, chanend c);
+void               xtask_hwt_connect(struct cs_data *csdata, struct vchan *vc, 
+                                     unsigned int tid, unsigned int thread_c,
+                                     unsigned int host_cs);
+void               xtask_hwt_fail(struct cs_data *csdata, struct vchan *vc, unsigned int tid);
+
+unsigned int xtask_process_man_msg(struct cs_data *csdata, struct cs_kernel *k);
+unsigned int xtask_man_create_thread(struct cs_data *csdata, struct cs_kernel *k, struct chan_event *evt);
+unsigned int xtask_man_vc_receive(struct cs_data *csdata, struct cs_kernel *k, struct chan_event *evt);
+unsigned int xtask_man_vc_get_write_buf(struct cs_data *csdata, struct cs_kernel *k, struct chan_event *evt);
+unsigned int xtask_man_vc_send(struct cs_data *csdata, struct cs_kernel *k, struct chan_event *evt);
+unsigned int xtask_man_mailbox(struct cs_data *csdata, struct cs_kernel *k, struct chan_event *evt);
+unsigned int xtask_man_create_remote_thread(struct cs_data *csdata, struct cs_kernel *k, struct chan_event *evt);
+unsigned int xtask_man_get_outbox(struct cs_data *csdata, struct cs_kernel *k, struct chan_event *evt);
+unsigned int xtask_man_send_outbox(struct cs_data *csdata, struct cs_kernel *k, struct chan_event *evt);
+unsigned int xtask_man_get_inbox(struct cs_data *csdata, struct cs_kernel *k, struct chan_event *evt);
+unsigned int xtask_man_get_kreply(struct cs_data *csdata, struct cs_kernel *k, struct chan_event *evt);
+unsigned int xtask_man_register_ev_group(struct cs_data *csdata, struct cs_kernel *k, struct chan_event *evt);
+unsigned int xtask_man_set_ev_flags(struct cs_data *csdata, struct cs_kernel *k, struct chan_event *evt);
+unsigned int xtask_man_unregister_ev_group(struct cs_data *csdata, struct cs_kernel *k, struct chan_event *evt);
+unsigned int xtask_man_get_lock(struct cs_data *csdata, struct cs_kernel *k, struct chan_event *evt);
+unsigned int xtask_man_identify(struct cs_data *csdata, struct cs_kernel *k, struct chan_event *evt);
+unsigned int xtask_man_wake_kernel(struct cs_data *csdata, struct cs_kernel *k, struct chan_event *evt);
+unsigned int xtask_man_send_outbox_multi(struct cs_data *csdata, struct cs_kernel *k, struct chan_event *evt);
+unsigned int xtask_man_subscribe(struct cs_data *csdata, struct cs_kernel *k, struct chan_event *evt);
+unsigned int xtask_man_publish(struct cs_data *csdata, struct cs_kernel *k, struct chan_event *evt);
+unsigned int xtask_man_register_thread_code(struct cs_data *csdata, struct cs_kernel *k, struct chan_event *evt);
+unsigned int xtask_man_join_thread(struct cs_data *csdata, struct cs_kernel *k, struct chan_event *evt);
 
 #endif /* ndef __XC__ */
 
@@ -18,11 +18,37 @@
 #define WORD_SIZE   4
 #define KSTACK_SIZE 256
 
-#define NR_KCALLS   12
+#define NR_KCALLS   34
+
+/* number of scheduling queues: task priorities 0-6, background and idle */
+#define NR_PRIORITIES 9
+
+/* priority of the idle task */
+#define IDLE_PRIORITY 8
+
+/* priority of tasks that have used up the budget of their reservation,
+   below all task priorities so the budget is only used from idle time */
+#define RESV_BG_PRIORITY 7
+
+/* kernel scheduling modes */
+#define SCHED_PREEMPTIVE  0
+#define SCHED_COOPERATIVE 1
+
+/* number of slots in the software timer wheel, must be a power of two */
+#define TIMER_WHEEL_SIZE 16
+
+/* software timer state flags */
+#define TIMER_ACTIVE 0x01
+
+/* event flag wait options */
+#define EF_WAIT_ANY 0x00
+#define EF_WAIT_ALL 0x01
+#define EF_CLEAR    0x02
 
 typedef void (*task_code)(void *);
 typedef void (*init_code)(void);
 typedef void (*hwt_code)(void *, chanend);
+typedef void (*timer_code)(void *);
 
 /* kernel call parameters */
 struct kcall_data {
@@ -38,17 +64,49 @@ struct task_entry {
   unsigned long *sp;                  /* task stack pointer */
   unsigned long *bottom_stack;        /* stack top */
   unsigned int stack_size;            /* size of stack */
-  unsigned int priority;              /* priority of task: 0-7 */
+  unsigned int priority;              /* priority of task: 0-8 */
+  unsigned int threshold;             /* only tasks with priority < threshold may preempt this task */
   unsigned int tid;                   /* task id */
   unsigned int delay;                 /* when delayed the delay tick value is stored here */
   struct kcall_data *kcall_params;    /* when blocked, the pointer to the kcall params is stored */
   unsigned int kcall_nr;              /* and also the kernel call number is stored */
+  struct reservation *resv;           /* CPU budget reservation, NULL if none */
   struct task_entry *next;            /* pointer to next process for queues */
 };
 
+/* CPU budget reservation of a task (deferrable server) */
+struct reservation {
+  struct task_entry *task;            /* task that owns the reservation */
+  unsigned int budget;                /* timer cycles of CPU time per period */
+  unsigned int remaining;             /* timer cycles left in the current period */
+  unsigned int period;                /* replenishment period in ticks */
+  unsigned int replenish;             /* tick value of the next replenishment */
+  unsigned int priority;              /* priority of the task while budget is left */
+  unsigned int threshold;             /* preemption threshold of the task while budget is left */
+  struct reservation *next;           /* list pointer for kdata->resv_head */
+};
+
+/* software timer, kept in the timer wheel slot (expiry % TIMER_WHEEL_SIZE) */
+struct timer_entry {
+  timer_code code;                    /* callback, executed by the kernel on expiry */
+  void *args;                         /* argument passed to the callback */
+  unsigned int expiry;                /* tick value at which the timer expires */
+  unsigned int period;                /* reload value in ticks, 0 for a one-shot timer */
+  unsigned int state;                 /* state flags */
+  struct timer_entry *next;           /* list pointer for timer wheel slot */
+};
+
+/* event flag group, blocked tasks wait in the group's own wait queue */
+struct event_group {
+  unsigned int id;                    /* id registered at CS, 0 for a local group */
+  unsigned int flags;                 /* current flag values */
+  struct task_entry *wait_head;       /* tasks waiting for flags, FIFO */
+};
+
 struct k_data {
   struct task_entry * current_task;   /* current running task */
-  struct task_entry * sched_head[8];  /* heads of the ready queues */
+  struct task_entry * sched_head[NR_PRIORITIES]; /* heads of the ready queues, the fields
+                                                    after it are accessed in kernel_asm.S */
   unsigned int timer_res;             /* timer resource handle */
   unsigned int timer_cycles;          /* number of timer cycles per tick */
   unsigned int timer_int;             /* timer value of next interrupt */
@@ -60,6 +118,14 @@ struct k_data {
   void (*kcall_table[NR_KCALLS])(unsigned int        callnr, /* kernel call table */
                                  struct k_data     * kdata, 
                                  struct kcall_data * kcall);
+  struct timer_entry *timer_wheel[TIMER_WHEEL_SIZE]; /* software timers, hashed by expiry tick */
+  unsigned int sched_mode;            /* SCHED_PREEMPTIVE or SCHED_COOPERATIVE */
+  struct reservation *resv_head;      /* head of list of CPU budget reservations */
+  unsigned int acct_timer;            /* free running timer for budget accounting, 0 if unused */
+  unsigned int acct_stamp;            /* acct_timer value of the last accounting */
+  unsigned int cs_handle;             /* handle of this kernel at the CS, 0 if not known yet */
+  struct shobj_waiter *shobj_waiters; /* tasks blocked on shared objects */
+  struct task_entry *idle_task;       /* the idle task, can always be preempted */
 };
 
 /* function prototypes */
@@ -69,10 +135,21 @@ void   _xtask_init_system();
 void * _xtask_get_kdata();
 void   xtask_enqueue(struct k_data *kdata, struct task_entry *proc);
 void   xtask_pick_task(struct k_data* kdata);
+void   xtask_preempt(struct k_data *kdata);
+int    xtask_dequeue(struct k_data *kdata, struct task_entry *proc);
+void   xtask_account(struct k_data *kdata);
+void   xtask_check_reservations(struct k_data *kdata);
+void   xtask_resv_release(struct k_data *kdata, struct task_entry *proc);
+void   xtask_set_sched_mode(unsigned int mode);
 void   _xtask_man_chan_setup_int(chanend c, void *env);
 void   _xtask_init_kdata(void * kstack_bottom, unsigned int stack_offset, void *kdata);
 int    xtask_create_init_task(task_code code, unsigned int stack_size, 
          unsigned int priority, unsigned int tid, void *args);
+void   xtask_check_timers(struct k_data *kdata);
+void   xtask_timer_arm(struct k_data *kdata, struct timer_entry *te, unsigned int ticks);
+void   xtask_timer_disarm(struct k_data *kdata, struct timer_entry *te);
+int    xtask_event_flags_set(struct k_data *kdata, struct event_group *eg, unsigned int flags);
+int    xtask_check_shobj_waiters(struct k_data *kdata);
          
 void xtask_kcall_delay_ticks          (unsigned int callnr, struct k_data * kdata, struct kcall_data * kcall);
 void xtask_kcall_create_thread        (unsigned int callnr, struct k_data * kdata, struct kcall_data * kcall);
@@ -86,6 +163,28 @@ void xtask_kcall_send_outbox          (unsigned int callnr, struct k_data * kdat
 void xtask_kcall_get_inbox            (unsigned int callnr, struct k_data * kdata, struct kcall_data * kcall);
 void xtask_kcall_create_task          (unsigned int callnr, struct k_data * kdata, struct kcall_data * kcall);
 void xtask_kcall_exit                 (unsigned int callnr, struct k_data * kdata, struct kcall_data * kcall);
+void xtask_kcall_create_timer         (unsigned int callnr, struct k_data * kdata, struct kcall_data * kcall);
+void xtask_kcall_start_timer          (unsigned int callnr, struct k_data * kdata, struct kcall_data * kcall);
+void xtask_kcall_stop_timer           (unsigned int callnr, struct k_data * kdata, struct kcall_data * kcall);
+void xtask_kcall_delete_timer         (unsigned int callnr, struct k_data * kdata, struct kcall_data * kcall);
+void xtask_kcall_set_threshold        (unsigned int callnr, struct k_data * kdata, struct kcall_data * kcall);
+void xtask_kcall_yield                (unsigned int callnr, struct k_data * kdata, struct kcall_data * kcall);
+void xtask_kcall_set_reservation      (unsigned int callnr, struct k_data * kdata, struct kcall_data * kcall);
+void xtask_kcall_create_event_group   (unsigned int callnr, struct k_data * kdata, struct kcall_data * kcall);
+void xtask_kcall_set_event_flags      (unsigned int callnr, struct k_data * kdata, struct kcall_data * kcall);
+void xtask_kcall_clear_event_flags    (unsigned int callnr, struct k_data * kdata, struct kcall_data * kcall);
+void xtask_kcall_wait_event_flags     (unsigned int callnr, struct k_data * kdata, struct kcall_data * kcall);
+void xtask_kcall_set_event_flags_id   (unsigned int callnr, struct k_data * kdata, struct kcall_data * kcall);
+void xtask_kcall_delete_event_group   (unsigned int callnr, struct k_data * kdata, struct kcall_data * kcall);
+void xtask_kcall_shobj_alloc          (unsigned int callnr, struct k_data * kdata, struct kcall_data * kcall);
+void xtask_kcall_shobj_block          (unsigned int callnr, struct k_data * kdata, struct kcall_data * kcall);
+void xtask_kcall_shobj_kick           (unsigned int callnr, struct k_data * kdata, struct kcall_data * kcall);
+void xtask_kcall_delete_mailbox       (unsigned int callnr, struct k_data * kdata, struct kcall_data * kcall);
+void xtask_kcall_send_outbox_multi    (unsigned int callnr, struct k_data * kdata, struct kcall_data * kcall);
+void xtask_kcall_subscribe            (unsigned int callnr, struct k_data * kdata, struct kcall_data * kcall);
+void xtask_kcall_publish              (unsigned int callnr, struct k_data * kdata, struct kcall_data * kcall);
+void xtask_kcall_register_thread_code(unsigned int callnr, struct k_data * kdata, struct kcall_data * kcall);
+void xtask_kcall_join_thread          (unsigned int callnr, struct k_data * kdata, struct kcall_data * kcall);
 
 #define ENTER_CRITICAL() __asm__ volatile("clrsr 0x02")
 #define EXIT_CRITICAL()  __asm__ volatile("setsr 0x02")
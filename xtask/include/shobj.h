@@ -0,0 +1,58 @@
+/******************************************************************************
+ *                                                                            *
+ * File:   shobj.h                                                            *
+ * Author: Bianco Zandbergen <bianco [AT] zandbergen.name>                    *
+ *                                                                            *
+ * This file is part of the xTask Distributed Operating System for            *
+ * the XMOS XS1 microprocessor architecture (www.xtask.org).                  *
+ *                                                                            *
+ * Shared objects header file.                                                *
+ ******************************************************************************/
+#ifndef SHOBJ_H
+#define SHOBJ_H
+
+#include "../include/kernel.h"
+
+// number of tries before a task blocks on a shared object
+#define SHOBJ_SPIN 64
+
+// shared object types
+#define SHOBJ_MUTEX 1
+#define SHOBJ_QUEUE 2
+
+// queue flags
+#define SHOBJ_SPSC  0x00
+#define SHOBJ_MPSC  0x01
+
+/* task waiting on a shared object, lives on the stack of the blocked task */
+struct shobj_waiter {
+  struct task_entry *task;            /* blocked task */
+  unsigned int kernel;                /* CS handle of the kernel of the task */
+  volatile unsigned int granted;      /* set by the task or thread that wakes the waiter */
+  struct shobj_waiter *next;          /* list pointer for wait queue of object */
+  struct shobj_waiter *k_next;        /* list pointer for kdata->shobj_waiters */
+};
+
+/* mutex, ownership is handed over directly to the first waiter */
+struct shobj_mutex {
+  unsigned int lock;                  /* hardware lock resource */
+  volatile unsigned int locked;       /* mutex is owned */
+  struct shobj_waiter *wait_head;     /* tasks waiting for the mutex, FIFO */
+};
+
+/* queue of words with a single consumer */
+struct shobj_queue {
+  unsigned int lock;                  /* hardware lock resource */
+  unsigned int flags;                 /* SHOBJ_SPSC or SHOBJ_MPSC */
+  unsigned int size;                  /* capacity in words */
+  volatile unsigned int head;         /* read counter, only written by the consumer */
+  volatile unsigned int tail;         /* write counter, only written by producers */
+  struct shobj_waiter * volatile waiter; /* blocked consumer task */
+  unsigned int *items;                /* ring buffer */
+};
+
+// function prototypes
+unsigned int xtask_shobj_prepare_wait(void *obj, unsigned int type,
+               struct shobj_waiter *w);
+
+#endif /* SHOBJ_H */
@@ -19,9 +19,34 @@
 #define LOCAL_TILE 1
 #define ALL_TILES  2
 
+/* event flag wait options */
+#define EF_WAIT_ANY 0x00
+#define EF_WAIT_ALL 0x01
+#define EF_CLEAR    0x02
+
+/* shared queue producers */
+#define SHOBJ_SPSC  0x00
+#define SHOBJ_MPSC  0x01
+
+/* CS id flag, serve the ring bus on a hardware thread of its own */
+#define CS_RING_THREAD 0x8000
+
+/* tile of remote hardware thread */
+#define ANY_TILE          0
+#define LEAST_LOADED_TILE 0xFFFF
+
+/* virtual channel modes, or'ed into the number of buffers */
+#define VC_STREAM 0x8000
+#define VC_SHM    0x4000
+
+/* kernel scheduling modes */
+#define SCHED_PREEMPTIVE  0
+#define SCHED_COOPERATIVE 1
+
 typedef void (*task_code)(void *);
 typedef void (*init_code)(void);
 typedef void (*hwt_code)(void *, chanend);
+typedef void (*timer_code)(void *);
 
 /* virtual channel and mailbox buffer */
 struct vc_buf {
@@ -30,6 +55,9 @@ struct vc_buf {
   unsigned int data_size;
 };
 
+/* buffer rings of a virtual channel in VC_SHM mode */
+struct vc_shm;
+
 /* function prototypes */
 void            xtask_kernel(init_code init_threads, task_code idle_task, 
                   unsigned int timer_cycles, chanend cs_async, chanend cs_sync);
@@ -41,20 +69,47 @@ int             xtask_create_task(task_code code, unsigned int stack_size,
                   unsigned int priority, unsigned int tid, void *args);
 
 unsigned int    xtask_create_thread(hwt_code pc, unsigned int stackwords, void *args, 
-                  unsigned int obj_size, unsigned int rx_buf_size, unsigned int tx_buf_size);
+                  unsigned int obj_size, unsigned int rx_buf_size, unsigned int tx_buf_size,
+                  unsigned int nr_bufs);
                   
 unsigned int    xtask_create_remote_thread(unsigned int code, unsigned int stackwords, 
-                  unsigned int obj_size, unsigned int rx_buf_size, unsigned int tx_buf_size);
+                  unsigned int obj_size, unsigned int rx_buf_size, unsigned int tx_buf_size,
+                  unsigned int nr_bufs);
+
+unsigned int    xtask_create_remote_thread_on(unsigned int cs_id, unsigned int code, 
+                  unsigned int stackwords, unsigned int args, unsigned int obj_size, 
+                  unsigned int rx_buf_size, unsigned int tx_buf_size, unsigned int nr_bufs);
+
+unsigned int    xtask_register_thread_code(unsigned int code, hwt_code pc);
+
+unsigned int    xtask_join_thread(unsigned int handle, unsigned int *status);
                   
 struct vc_buf * xtask_vc_get_write_buf(unsigned int handle);
 
-struct vc_buf * xtask_vc_send(struct vc_buf *buf);
+struct vc_buf * xtask_vc_send(unsigned int handle, struct vc_buf *buf);
 
 struct vc_buf * xtask_vc_receive(unsigned int handle, unsigned int min_size);
 
 unsigned int    xtask_create_mailbox(unsigned int id, 
                   unsigned int inbox_size, unsigned int outbox_size);
                   
+unsigned int    xtask_create_queued_mailbox(unsigned int id, unsigned int inbox_size,
+                  unsigned int outbox_size, unsigned int depth);
+
+unsigned int    xtask_delete_mailbox(unsigned int id);
+
+unsigned int    xtask_send_outbox_to(unsigned int sender, unsigned int receiver,
+                  unsigned int cs_id);
+
+unsigned int    xtask_send_outbox_multi(unsigned int sender, unsigned int *recipients,
+                  unsigned int nr_recipients);
+
+unsigned int    xtask_subscribe(unsigned int topic, unsigned int id);
+
+unsigned int    xtask_unsubscribe(unsigned int topic, unsigned int id);
+
+unsigned int    xtask_publish(unsigned int topic, unsigned int sender);
+
 struct vc_buf * xtask_get_outbox(unsigned int id);
 
 unsigned int    xtask_send_outbox(unsigned int sender, unsigned int receiver);
@@ -65,12 +120,87 @@ void            xtask_delay_ticks(unsigned int ticks);
 
 void            xtask_exit(unsigned int status);
 
+unsigned int    xtask_create_timer(timer_code code, void *args);
+
+void            xtask_start_timer(unsigned int timer, unsigned int ticks, 
+                  unsigned int period);
+
+void            xtask_stop_timer(unsigned int timer);
+
+void            xtask_delete_timer(unsigned int timer);
+
+void            xtask_set_sched_mode(unsigned int mode);
+
+unsigned int    xtask_set_preempt_threshold(unsigned int threshold);
+
+void            xtask_yield(void);
+
+unsigned int    xtask_set_reservation(unsigned int budget, unsigned int period);
+
+unsigned int    xtask_create_event_group(unsigned int id);
+
+unsigned int    xtask_set_event_flags(unsigned int group, unsigned int flags);
+
+unsigned int    xtask_clear_event_flags(unsigned int group, unsigned int flags);
+
+unsigned int    xtask_wait_event_flags(unsigned int group, unsigned int flags, 
+                  unsigned int options);
+
+unsigned int    xtask_set_event_flags_id(unsigned int id, unsigned int flags);
+
+unsigned int    xtask_delete_event_group(unsigned int group);
+
+unsigned int    xtask_mutex_create(void);
+
+unsigned int    xtask_mutex_trylock(unsigned int mutex);
+
+void            xtask_mutex_lock(unsigned int mutex);
+
+void            xtask_mutex_unlock(unsigned int mutex);
+
+void            xtask_hwt_mutex_lock(unsigned int mutex);
+
+void            xtask_hwt_mutex_unlock(unsigned int mutex);
+
+unsigned int    xtask_queue_create(unsigned int size, unsigned int flags);
+
+unsigned int    xtask_queue_send(unsigned int queue, unsigned int item);
+
+unsigned int    xtask_queue_receive(unsigned int queue);
+
+unsigned int    xtask_hwt_queue_send(unsigned int queue, unsigned int item);
+
+unsigned int    xtask_hwt_queue_receive(unsigned int queue);
+
+void            xtask_hwt_stream_send(chanend c, unsigned int *data, 
+                  unsigned int nr_words);
+
+unsigned int    xtask_hwt_stream_receive(chanend c, unsigned int *data, 
+                  unsigned int max_words);
+
+struct vc_shm * xtask_hwt_shm_attach(chanend c);
+
+struct vc_buf * xtask_hwt_shm_get_buf(struct vc_shm *shm);
+
+void            xtask_hwt_shm_put_buf(struct vc_shm *shm);
+
+struct vc_buf * xtask_hwt_shm_receive(struct vc_shm *shm);
+
+void            xtask_hwt_shm_release(struct vc_shm *shm);
+
+void            xtask_hwt_exit(chanend c, unsigned int status);
+
 #endif /* ndef __XC__ */
 
 #ifdef __XC__
 
 void xtask_comserver(chanend man_sync[], chanend man_async[], unsigned int nr_man_chan, 
                      chanend ?ring_in, chanend ?ring_out, unsigned int id);
+
+void xtask_comserver_mesh(chanend man_sync[], chanend man_async[], unsigned int nr_man_chan, 
+                          chanend ?ring_in, chanend ?ring_out, 
+                          chanend link_in[], chanend link_out[], unsigned int nr_links,
+                          unsigned int route[], unsigned int nr_routes, unsigned int id);
                   
 #endif /* def __XC__ */
 
@@ -10,18 +10,119 @@
  * Communication Server. More specific it contains the following functions:   *
  *                                                                            *
  * xtask_comserver                 - initialise and start CS                  *
- * xtask_vc_send_buf               - send a buffer to hardware thread         *
- * xtask_process_man_msg           - process received management message      *
+ * xtask_comserver_mesh            - start CS with links to other CS          *
+ * xtask_vc_tx_start               - start sending buffer to hardware thread  *
+ * xtask_vc_tx_event               - continue sending buffer to hw thread     *
+ * xtask_vc_tx_complete            - return sent buffer to write ring         *
+ * xtask_process_man_msg           - dispatch received management message     *
+ * xtask_man_create_thread         - create hardware thread with channel      *
+ * xtask_man_vc_receive            - get read buffer of virtual channel       *
+ * xtask_man_vc_get_write_buf      - get write buffer of virtual channel      *
+ * xtask_man_vc_send               - send write buffer to hardware thread     *
+ * xtask_man_mailbox               - register or remove mailbox               *
+ * xtask_man_create_remote_thread  - create hardware thread on other tile     *
+ * xtask_man_get_outbox            - get outbox of mailbox                    *
+ * xtask_man_send_outbox           - send outbox to recipient                 *
+ * xtask_man_get_inbox             - read inbox of mailbox                    *
+ * xtask_man_get_kreply            - get pending kernel reply                 *
+ * xtask_man_register_ev_group     - register event flag group                *
+ * xtask_man_set_ev_flags          - set flags of event flag group by id      *
+ * xtask_man_unregister_ev_group   - remove event flag group                  *
+ * xtask_man_get_lock              - get hardware lock for shared object      *
+ * xtask_man_identify              - get handle of requesting kernel          *
+ * xtask_man_wake_kernel           - wake kernel for shared object waiter     *
+ * xtask_man_send_outbox_multi     - send outbox to set of recipients         *
+ * xtask_man_subscribe             - add or remove topic subscription         *
+ * xtask_man_publish               - send outbox to subscribers of topic      *
+ * xtask_man_register_thread_code  - register hardware thread entry point     *
+ * xtask_man_join_thread           - wait until hardware thread exits         *
  * xtask_cs_get_rd_ptr             - get new read pointer to store next       *
  *                                   object received from hardware thread     *
  * xtask_cs_check_rd_blocked_tasks - unblock tasks that were blocked on a     *
  *                                   read on virtual channel (from hardware   *
  *                                   thread)                                  *
+ * xtask_vc_wake_reader            - unblock task blocked on read             *
+ * xtask_vc_stream_rx              - start receiving stream frame             *
+ * xtask_vc_stream_rx_frame        - receive stream frame into read buffer    *
+ * xtask_hwt_stream_send           - send stream frame from hardware thread   *
+ * xtask_hwt_stream_receive        - receive stream frame in hardware thread  *
+ * xtask_vc_shm_event              - doorbell of shared-memory channel        *
+ * xtask_vc_shm_publish            - offer queued write buffers to thread     *
+ * xtask_vc_shm_kick               - wake hardware thread waiting on a ring   *
+ * xtask_vc_shm_attach             - send shared rings to hardware thread     *
+ * xtask_hwt_shm_attach            - get shared rings in hardware thread      *
+ * xtask_hwt_shm_get_buf           - get free read buffer in hardware thread  *
+ * xtask_hwt_shm_put_buf           - hand filled read buffer to task          *
+ * xtask_hwt_shm_receive           - get write buffer sent by task            *
+ * xtask_hwt_shm_release           - return write buffer to task              *
+ * xtask_hwt_exit                  - exit hardware thread and park it         *
+ * xtask_hwt_restart               - start parked hardware thread again       *
+ * xtask_vc_exit                   - hardware thread of channel has exited    *
+ * xtask_vc_join                   - return exit status to joining task       *
+ * xtask_vc_release                - remove channel, park or end its thread   *
+ * xtask_ring_alloc                - get ring bus buffer from pool            *
+ * xtask_ring_free                 - return ring bus buffer to pool           *
+ * xtask_ring_pool_grow            - add ring bus buffers to pool             *
+ * xtask_ring_pool_get             - take ring bus buffer from pool if any    *
+ * xtask_ring_lock                 - acquire lock shared with ring thread     *
+ * xtask_ring_unlock               - release lock shared with ring thread     *
+ * xtask_ring_send                 - queue message for ring bus               *
+ * xtask_ring_queue                - queue message on ring bus chanend        *
+ * xtask_ring_start_thread         - start ring thread of CS                  *
+ * xtask_ring_thread               - ring thread, serves the ring bus         *
+ * xtask_ring_put                  - hand message to other thread of CS       *
+ * xtask_ring_take                 - take messages from other thread of CS    *
+ * xtask_ring_server_event         - process messages from ring thread        *
+ * xtask_ring_thread_event         - queue messages from server thread        *
+ * xtask_ring_tx_word              - send next word of ring bus message       *
+ * xtask_ring_tx_event             - continue sending ring bus message        *
+ * xtask_ring_receive              - receive word of ring bus message         *
+ * xtask_ring_send_outbox          - send outbox to other tile over ring bus  *
+ * xtask_ring_send_frags           - send fragments of large message          *
  * xtask_process_ring_msg          - process received ring message            *
+ * xtask_hwt_score                 - free threads and chanends for new thread *
+ * xtask_hwt_start                 - start registered hardware thread by code *
+ * xtask_hwt_end                   - free stack of thread started by code     *
+ * xtask_hwt_connect               - complete virtual channel of new thread   *
+ * xtask_hwt_fail                  - report failed remote thread creation     *
+ * xtask_link_send                 - send routed message to neighbour CS      *
+ * xtask_link_queue                - queue routed message on a link           *
+ * xtask_link_tx_word              - send next word of routed message         *
+ * xtask_link_tx_event             - neighbour CS has received a word         *
+ * xtask_link_receive              - receive and forward routed message       *
+ * xtask_mb_route_send             - route outbox to CS of recipient          *
+ * xtask_process_routed_msg        - process routed message for this CS       *
+ * xtask_get_vchan                 - get virtual channel by handle            *
+ * xtask_vc_register               - assign handle to new virtual channel     *
+ * xtask_vc_nr_bufs                - number of buffers in each buffer ring    *
+ * xtask_vc_alloc_bufs             - allocate buffer rings of virtual channel *
+ * xtask_vc_reset                  - empty buffer rings of virtual channel    *
+ * xtask_vc_bufs_fit               - buffer rings can be used for new thread  *
+ * xtask_vc_free_bufs              - free buffer rings of virtual channel     *
+ * xtask_vc_free                   - release virtual channel never registered *
+ * xtask_vc_take_rd_buf            - hand read buffer to task                 *
  * xtask_get_mailbox               - get mailbox by id                        *
- * xtask_get_free_kreply           - get free pending kernel reply            *                                
- * xtask_get_kreply                - get pending kernel reply for given kernel*                                           
+ * xtask_mb_index_resize           - rebuild mailbox index with new size      *
+ * xtask_mb_index_insert           - add mailbox to mailbox index             *
+ * xtask_mb_index_remove           - remove mailbox from mailbox index        *
+ * xtask_mb_loc_get                - get CS of mailbox from directory         *
+ * xtask_mb_loc_set                - add mailbox location to directory        *
+ * xtask_mb_loc_remove             - remove mailbox location from directory   *
+ * xtask_mb_loc_announce           - announce created or deleted mailbox      *
+ * xtask_mb_move                   - move message between mailbox buffers     *
+ * xtask_mb_queue_put              - add message to mailbox queue             *
+ * xtask_mb_queue_get              - move queued message to inbox             *
+ * xtask_mb_offer                  - deliver message if recipient can take it *
+ * xtask_topic_deliver             - offer message to local topic subscribers *
+ * xtask_get_ev_group              - get event flag group by id               *
+ * xtask_get_hwt_code              - get registered hardware thread by code   *
+ * xtask_kreply_pool_grow          - add pending kernel replies to pool       *
+ * xtask_get_free_kreply           - queue new pending kernel reply           *
+ * xtask_get_kreply                - dequeue pending kernel reply of kernel   *
+ * xtask_notify_kernel             - notify kernel of pending replies once    *
+ * xtask_free_kreply               - return pending kernel reply to pool      *
  * xtask_get_free_p_request        - get free pending ring bus reply          *                                          
+ * xtask_take_p_request            - remove pending ring bus reply by id      *
  *                                                                            *
  ******************************************************************************/  
 
@@ -41,10 +142,8 @@
  *               ring_out      - chanend for outgoing ring bus messages.      *
  * Return:       does not return, waits for event                             *
  *                                                                            *
- *               Initialises and starts the Communication Server.             *
- *               Allocates and initialises data structures.                   *
- *               Initialises management and ring buffer channels.             *
- *               Starts server by waiting for an event on chanends.           *
+ *               Initialises and starts the Communication Server connected    *
+ *               to the other CS by a ring bus only.                          *
  *               This function is part of the API.                            * 
  ******************************************************************************/
 #pragma stackfunction 128
@@ -54,6 +153,46 @@ void xtask_comserver(chanend      man_sync[],
                      chanend      ring_in, 
                      chanend      ring_out, 
                      unsigned int id)
+{
+  xtask_comserver_mesh(man_sync, man_async, nr_man_chan, ring_in, ring_out,
+                       NULL, NULL, 0, NULL, 0, id);
+}
+
+/******************************************************************************
+ * Function:     xtask_comserver_mesh                                         *
+ * Parameters:   man_sync[]    - Array of sync management channel chanends.   *
+ *               man_async[]   - Array of async management channel chanends.  *
+ *               nr_man_chan   - Number of management channels (pairs).       *
+ *                               Equals the number of kernels connected.      *
+ *               ring_in       - chanend for ingoing ring bus messages.       *
+ *               ring_out      - chanend for outgoing ring bus messages.      *
+ *               link_in[]     - chanends for incoming routed messages.       *
+ *               link_out[]    - chanends for outgoing routed messages.       *
+ *               nr_links      - Number of links to neighbour CS.             *
+ *               route[]       - Link to use for each CS id, or NO_ROUTE.     *
+ *               nr_routes     - Number of entries in route.                  *
+ *               id            - CS id, or'ed with CS_RING_THREAD to serve    *
+ *                               the ring bus on a thread of its own.         *
+ * Return:       does not return, waits for event                             *
+ *                                                                            *
+ *               Initialises and starts the Communication Server.             *
+ *               Allocates and initialises data structures.                   *
+ *               Initialises management, ring buffer and link channels.       *
+ *               Starts server by waiting for an event on chanends.           *
+ *               This function is part of the API.                            * 
+ ******************************************************************************/
+#pragma stackfunction 128
+void xtask_comserver_mesh(chanend      man_sync[], 
+                          chanend      man_async[], 
+                          unsigned int nr_man_chan, 
+                          chanend      ring_in, 
+                          chanend      ring_out, 
+                          chanend      link_in[],
+                          chanend      link_out[],
+                          unsigned int nr_links,
+                          unsigned int route[],
+                          unsigned int nr_routes,
+                          unsigned int id)
 {
   int i;
   
@@ -62,21 +201,96 @@ void xtask_comserver(chanend      man_sync[],
 
   csdata->kernels   = NULL;
   csdata->vchans    = NULL;
+  csdata->vc_table  = NULL;
+  csdata->vc_table_size = 0;
+  csdata->nr_vchans = 0;
   csdata->mailboxes = NULL;
+  csdata->mb_slots  = NULL;
   csdata->p_reqs    = NULL;
   csdata->p_outbox  = NULL;
-  csdata->id        = id;
+  csdata->ev_groups = NULL;
+  csdata->subs      = NULL;
+  csdata->p_remote  = NULL;
+  csdata->hwt_codes = NULL;
+  csdata->hwt_pool  = NULL;
+  csdata->nr_threads = 0;
+  csdata->hwt_stacks = NULL;
+  csdata->nr_locks  = 0;
+  csdata->next_lock = 0;
+
+  // index of mailboxes by id
+  xtask_mb_index_resize(csdata, MB_INDEX_BITS);
+
+  // management request table, indexed by command
+  for (i = 0; i < NR_MAN_CMDS; i++) {
+    csdata->man_table[i] = NULL;
+  }
+
+  csdata->man_table[1]  = xtask_man_create_thread;
+  csdata->man_table[2]  = xtask_man_vc_receive;
+  csdata->man_table[3]  = xtask_man_vc_get_write_buf;
+  csdata->man_table[4]  = xtask_man_vc_send;
+  csdata->man_table[5]  = xtask_man_mailbox;
+  csdata->man_table[6]  = xtask_man_create_remote_thread;
+  csdata->man_table[7]  = xtask_man_get_outbox;
+  csdata->man_table[8]  = xtask_man_send_outbox;
+  csdata->man_table[9]  = xtask_man_get_inbox;
+  csdata->man_table[10] = xtask_man_get_kreply;
+  csdata->man_table[11] = xtask_man_register_ev_group;
+  csdata->man_table[12] = xtask_man_set_ev_flags;
+  csdata->man_table[13] = xtask_man_get_lock;
+  csdata->man_table[14] = xtask_man_identify;
+  csdata->man_table[15] = xtask_man_wake_kernel;
+  csdata->man_table[16] = xtask_man_send_outbox_multi;
+  csdata->man_table[17] = xtask_man_subscribe;
+  csdata->man_table[18] = xtask_man_publish;
+  csdata->man_table[19] = xtask_man_register_thread_code;
+  csdata->man_table[20] = xtask_man_join_thread;
+  csdata->man_table[21] = xtask_man_unregister_ev_group;
+  csdata->id        = id & ~CS_RING_THREAD;
   
   csdata->ring = (!ring_in || !ring_out) ? 0 : 1; // has ring bus?
 
-  if (csdata->ring) {
-    // ring_buf contains the buffer information for ring bus messages  
+  if (nr_links > 0) {
+    // ring_buf contains the buffer information for routed messages  
     csdata->rbuf          = malloc(sizeof(struct ring_buf));
-    csdata->rbuf->payload = malloc(512);
-    
+    csdata->rbuf->payload = malloc(RING_PAYLOAD_SIZE);
+  }
+
+  // pool of ring bus buffers, several messages can be in flight at once
+  csdata->rb_free     = NULL;
+  csdata->tx_head     = NULL;
+  csdata->tx_tail     = NULL;
+  csdata->tx_word     = 0;
+  csdata->rx_buf      = NULL;
+  csdata->rx_word     = 0;
+  csdata->next_req_id = 0;
+
+  // no ring thread unless started below
+  csdata->rt_lock     = 0;
+  csdata->rt_c        = 0;
+  csdata->rt_hwt_c    = 0;
+  csdata->rt_rx_head  = NULL;
+  csdata->rt_rx_tail  = NULL;
+  csdata->rt_tx_head  = NULL;
+  csdata->rt_tx_tail  = NULL;
+  csdata->rt_starved  = 0;
+
+  // mailbox directory, filled by announcements and replies from other CS
+  for (i = 0; i < MB_LOC_BUCKETS; i++) {
+    csdata->mb_locs[i] = NULL;
+  }
+
+  if (csdata->ring) {
     csdata->ring_in       = ring_in;
     csdata->ring_out      = ring_out;
-  
+
+    xtask_ring_pool_grow(csdata, RING_NR_BUFS);
+  }
+
+  // the ring bus gets a hardware thread of its own when asked for, CS 
+  // serves it itself when there is no free lock or chanend for it
+  if (csdata->ring && !((id & CS_RING_THREAD) && xtask_ring_start_thread(csdata))) {
     // chan_event contains the information needed by event vectors that execute upon receiving data
     // this chan_event is for receiving messages from the ring bus
     struct chan_event *ev = malloc(sizeof(struct chan_event));
@@ -84,6 +298,48 @@ void xtask_comserver(chanend      man_sync[],
     ev->vector = (void *)  _xtask_ring_vec;   // vector that is executed when data is available
     ev->env    = (void *) csdata;             // address of csdata as environment vector
     _xtask_set_chan_event((void *)ev);        // configure chanend and enable events on chanend
+
+    // the next CS acknowledges each received word on ring_out
+    ev = malloc(sizeof(struct chan_event));
+    ev->res    = ring_out;
+    ev->vector = (void *)  _xtask_ring_tx_vec;
+    ev->env    = (void *) csdata;
+    _xtask_set_chan_event((void *)ev);
+  }
+
+  // point-to-point links to neighbour CS and the routing table
+  csdata->nr_links  = nr_links;
+  csdata->nr_routes = nr_routes;
+  csdata->links     = malloc(nr_links * sizeof(struct cs_link));
+  csdata->route     = malloc(nr_routes * sizeof(unsigned int));
+
+  for (i = 0; i < nr_routes; i++) {
+    csdata->route[i] = route[i];
+  }
+
+  for (i = 0; i < nr_links; i++) {
+    struct cs_link *link = &csdata->links[i];
+
+    link->c_in           = link_in[i];
+    link->c_out          = link_out[i];
+    link->csdata         = csdata;
+    link->event          = malloc(sizeof(struct chan_event));
+    link->event->res     = link->c_in;
+    link->event->vector  = (void *) _xtask_link_vec;
+    link->event->env     = (void *) link;   // link as environment vector
+    _xtask_set_chan_event((void *)link->event);
+
+    // the neighbour CS acknowledges each received word on c_out
+    link->tx_head          = NULL;
+    link->tx_tail          = NULL;
+    link->tx_word          = 0;
+    link->rx_buf           = NULL;
+    link->rx_word          = 0;
+    link->tx_event         = malloc(sizeof(struct chan_event));
+    link->tx_event->res    = link->c_out;
+    link->tx_event->vector = (void *) _xtask_link_tx_vec;
+    link->tx_event->env    = (void *) link;
+    _xtask_set_chan_event((void *)link->tx_event);
   }
 
   // initialize all management channels
@@ -99,7 +355,12 @@ void xtask_comserver(chanend      man_sync[],
     temp->event->data        = (struct man_msg *) (malloc(sizeof(struct man_msg)));
     temp->event->object_size = sizeof(struct man_msg);
     temp->event->vector      = (void *)_xtask_man_chan_vec;
-    temp->event->env         = (void *)temp->event;
+    temp->event->env         = (void *)temp; // kernel structure as environment vector
+    temp->kr_head            = NULL;           // no pending kernel replies
+    temp->kr_tail            = NULL;
+    temp->nr_kr              = 0;
+    temp->max_kr             = 0;
+    temp->kr_notified        = 0;
     
     _xtask_set_chan_event((void *)temp->event); // configure chanend and enable events on chanend
 
@@ -107,1362 +368,4824 @@ void xtask_comserver(chanend      man_sync[],
     csdata->kernels = temp;
   }
   
-  // free all pending kernel replies 
-  for (i=0; i<8; i++) {
-    //csdata->k_replies[i].state &= ~(KR_USED);
-    csdata->k_replies[i].state = 0;
-    csdata->k_replies[i].k     = 0;
-  }
+  // pool of pending kernel replies, grows when exhausted
+  csdata->kr_pool      = NULL;
+  csdata->kr_pool_size = 0;
+  csdata->nr_kr        = 0;
+  csdata->max_kr       = 0;
+  xtask_kreply_pool_grow(csdata, KR_POOL_SIZE);
 
   _xtask_set_cs_data((void *)csdata); // push csdata address on stack
   __asm__ volatile ("waiteu");        // start server by waiting for requests from kernels
 }
 
 /******************************************************************************
- * Function:     xtask_vc_send_buf                                            *
+ * Function:     xtask_vc_tx_start                                            *
  * Parameters:   vc      - Pointer to vchan structure                         *
- *               bufnr   - buffer number (0 or 1)                             *
- * Return:       does not return, waits for event                             *
+ * Return:       void                                                         *
  *                                                                            *
- *               Send a buffer with objects to a dedicated hardware thread    *
- *               through a channel. The object size must be a multiple of     *
- *               4 bytes.                                                     *
+ *               Start the transfer of the oldest queued write buffer to the  *
+ *               dedicated hardware thread, unless a transfer is already in   *
+ *               progress. Only the first control token is sent here, the     *
+ *               objects are sent one at a time by xtask_vc_tx_event each     *
+ *               time the hardware thread answers. CS therefore never waits   *
+ *               for a slow hardware thread and keeps serving other requests. *
  ******************************************************************************/
-void xtask_vc_send_buf(struct vchan * vc, 
-                       unsigned int   bufnr)
+void xtask_vc_tx_start(struct vchan *vc)
 {
-  unsigned int  obj_size  = vc->obj_size;
-  struct vc_buf *vcbuf    = &vc->write_bufs[bufnr];
-  unsigned int  data_size = vcbuf->data_size;
-  unsigned int  chan_end  = vc->own_chanend;
-  unsigned int  nr_words;
-  
-  void *current_obj;
-  void *temp_obj;
-  int i, j;
+  unsigned int chan_end = vc->own_chanend;
 
-  current_obj = vcbuf->data;
+  if (vc->tx_state != VC_TX_IDLE) {
+    return; // buffer will be started when the current one completes
+  }
 
-  nr_words = obj_size / 4; // number of words per object
+  if (vc->shm != NULL && !(vc->state & VC_EXITED)) {
+    // the hardware thread takes the buffers from shared memory
+    xtask_vc_shm_publish(vc);
+    return;
+  }
 
-  for (i=0; i<data_size; i+=obj_size) { // for each object
-   
-    // send object synchronised to hardware thread
-    __asm__ volatile ("outct res[%0], 0x01"::"r"(chan_end));
-    __asm__ volatile ("chkct res[%0], 0x01"::"r"(chan_end));
-    
-    current_obj += obj_size;
-    temp_obj = current_obj;
-    
-    for (j=0; j<nr_words; j++) {
-      temp_obj -= 4; // send highest word in memory of object first
-      __asm__ volatile ("out res[%0], %1"::"r"(chan_end),"r"(*((unsigned int*)temp_obj)));
-    }   
+  // empty buffers are completed at once, all buffers
+  // when the hardware thread has exited
+  while (vc->wr_queued > 0 && 
+         ((vc->state & VC_EXITED) || vc->write_bufs[vc->wr_head].data_size == 0)) {
+    xtask_vc_tx_complete(vc);
+  }
 
-    __asm__ volatile ("outct res[%0], 0x01"::"r"(chan_end));
-    __asm__ volatile ("chkct res[%0], 0x01"::"r"(chan_end));
+  if (vc->wr_queued == 0) {
+    return; // nothing to send
   }
+
+  vc->tx_offset = 0;
+  vc->tx_state  = VC_TX_START;
+
+  // the answer of the hardware thread arrives as an event on the chanend,
+  // which may have been disabled when no read buffer was available
+  _xtask_chan_enable_events(chan_end);
+
+  // ask the hardware thread to accept the first object
+  __asm__ volatile ("outct res[%0], 0x01"::"r"(chan_end));
 }
 
 /******************************************************************************
- * Function:     xtask_process_man_msg                                        *
- * Parameters:   csdata  - Pointer to cs_data structure.                      *
- *               evt     - Pointer to chan_event structure.                   *
- * Return:       whether CS should send a reply back to the kernel            *
+ * Function:     xtask_vc_tx_event                                            *
+ * Parameters:   vc      - Pointer to vchan structure                         *
+ * Return:       void                                                         *
  *                                                                            *
- *               Process a request received throught a management channel     *
- *               from a kernel.                                               *
- *                                                                            * 
- *               This function should be divided in subfunctions to           *
- *               increase readability.                                        *
- ******************************************************************************/ 
-unsigned int xtask_process_man_msg(struct cs_data *    csdata,
-                                   struct chan_event * evt)
+ *               Called by the event vector of the virtual channel when a     *
+ *               transfer is in progress and the hardware thread answered.    *
+ *               Sends the next object, highest word in memory first, or      *
+ *               in streaming mode the whole buffer as one frame, or          *
+ *               completes the buffer. A completed buffer goes back to the    *
+ *               ring and unblocks a task waiting for a write buffer. The     *
+ *               object size must be a multiple of 4 bytes.                   *
+ ******************************************************************************/
+void xtask_vc_tx_event(struct vchan *vc)
 {
-  if (((struct man_msg*)evt->data)->cmd == 1) {
-    /* 
-       create new hardware thread with channel
-       p0 = pc
-       p1 = stackwords
-       p2 = args
-       p3 = object size
-       p4 = rx buf size
-       p5 = tx buf size 
-    */
-  
-    chanend a = _xtask_get_chanend();
-    chanend b = _xtask_get_chanend();
-    _xtask_set_chanend_dest(a,b);
-    _xtask_set_chanend_dest(b,a);
-    
-    // create new hardware thread
-    unsigned int * new_stack = (unsigned int *)malloc(((struct man_msg*)evt->data)->p1 * WORD_SIZE);
-    void *         new_sp    = (void*) (new_stack + (((struct man_msg*)evt->data)->p1 - 1));
-    unsigned int   handler   = _xtask_create_thread((void*)((struct man_msg*)evt->data)->p0, 
-                                                          (void*)new_sp, 
-                                                          (void*)((struct man_msg*)evt->data)->p2, 
-                                                           b);
-                                                           
-    // allocate and initialise new chan_event structure for hardware thread
-    struct chan_event *new_ce = (struct chan_event*) malloc(sizeof(struct chan_event));
-    new_ce->res = a;
-    new_ce->vector = (void *) _xtask_vc_vect;
-    
-    ((struct man_msg*)evt->data)->p0 = handler; // return handle to kernel
-    ((struct man_msg*)evt->data)->p1 = a;       // return CS chanend to hardware thread, seems to be not used by kernel
-
-    // allocate and initialise new vchan structure for hardware thread
-    struct vchan *new_vchan   = malloc(sizeof(struct vchan));
-    new_vchan->own_chanend    = a;
-    new_vchan->thread_chanend = b;
-    new_vchan->handle         = handler;
-    new_vchan->event          = new_ce;
-    new_vchan->state          = 0;
-    new_vchan->read_bufs[0].data       =  malloc(((struct man_msg*)evt->data)->p4);
-    new_vchan->read_bufs[0].buf_size   =  ((struct man_msg*)evt->data)->p4;
-    new_vchan->read_bufs[0].data_size  =  0;
-    new_vchan->read_bufs[1].data       =  malloc(((struct man_msg*)evt->data)->p4);
-    new_vchan->read_bufs[1].buf_size   =  ((struct man_msg*)evt->data)->p4;
-    new_vchan->read_bufs[1].data_size  =  0;
-    new_vchan->write_bufs[0].data      =  malloc(((struct man_msg*)evt->data)->p5);
-    new_vchan->write_bufs[0].buf_size  =  ((struct man_msg*)evt->data)->p5;
-    new_vchan->write_bufs[0].data_size =  0;
-    new_vchan->write_bufs[1].data      =  malloc(((struct man_msg*)evt->data)->p5);
-    new_vchan->write_bufs[1].buf_size  =  ((struct man_msg*)evt->data)->p5;
-    new_vchan->write_bufs[1].data_size =  0;
-    new_vchan->obj_size                =  ((struct man_msg*)evt->data)->p3;
-    new_vchan->csdata                  =  csdata;
-
-    struct cs_kernel *temp_k = csdata->kernels;
-    
-    // find kernel that made the request (and has the task that made the request)
-    while (temp_k != NULL) {
-      if (temp_k->c_sync == evt->res) {
-        break;
-      }
-
-      temp_k = temp_k->next;
-    }
+  unsigned int  chan_end = vc->own_chanend;
+  struct vc_buf *vcbuf   = &vc->write_bufs[vc->wr_head];
+  unsigned int  *word;
+  int j;
 
-    new_vchan->kernel = temp_k; // save a pointer to that kernel
+  __asm__ volatile ("chkct res[%0], 0x01"::"r"(chan_end));
 
-    // add vchan to list of virtual channels
-    new_vchan->next = csdata->vchans;
-    csdata->vchans = new_vchan;
+  if (vc->tx_state == VC_TX_START && vc->stream) {
+    // hardware thread accepted the frame, send the length and
+    // the whole buffer in one burst, lowest word in memory first
+    unsigned int nr_words = vcbuf->data_size / 4;
 
-    new_ce->env = new_vchan; // address of vchan structure, environment vector for hardware thread receive vector
-    _xtask_set_chan_event((void*)new_ce); // start receive data from hardware thread
-    return REPLY; // send a reply back to kernel
-    
-  } else if (((struct man_msg*)evt->data)->cmd == 2) {
-    /*
-       Task requests a (optionally partially) filled read buffer
-       from virtual channel to hardware thread.
-       p0 = handle
-       p1 = min read size
-    */
-    
-    // find the right virtual channel in the list by the given handle
-    struct vchan *temp_vchan = csdata->vchans;
-    while (temp_vchan != NULL) {
-      if (temp_vchan->handle == ((struct man_msg*)evt->data)->p0) {
-        break;
-      }
+    word = (unsigned int *)vcbuf->data;
+    __asm__ volatile ("out res[%0], %1"::"r"(chan_end),"r"(nr_words));
 
-      temp_vchan = temp_vchan->next;
+    for (j = 0; j < nr_words; j++) {
+      __asm__ volatile ("out res[%0], %1"::"r"(chan_end),"r"(word[j]));
     }
 
-    if (temp_vchan != NULL) {
-
-      temp_vchan->min_read_size = ((struct man_msg*)evt->data)->p1; 
-  
-      // task made a new read request, so set the data size of the
-      // previously held buffer to zero.
-      if (temp_vchan->state & TASK_RD_BUF0) {
-        temp_vchan->read_bufs[0].data_size = 0;
-      } else if (temp_vchan->state & TASK_RD_BUF1) {
-        temp_vchan->read_bufs[1].data_size = 0;
-      }
-      
-      // new read request, clear flags that indicate that the task is
-      // using the read buffers.
-      temp_vchan->state &= ~(TASK_RD_BUFS);
-      
-      // find a buffer to return, if there is any of course
-      if (temp_vchan->state & RD_BUFS_FILLED) {
-        // at least one of both buffers are completely filled
-        
-        if ( (temp_vchan->state & RD_BUFS_FILLED) == RD_BUFS_FILLED) {
-          // both buffers are completely filled, which one to pick?
-          if (temp_vchan->state & RD_BUF0_FIRST) {  // return buf 0, it was filled first
-            temp_vchan->state &= ~(RD_BUF0_FIRST);  // clear buffer fill order flag
-            temp_vchan->state |= TASK_RD_BUF0;      // task uses buf now
-            temp_vchan->state &= ~(RD_BUF0_FILLED); // clear buffer filled flag
-            ((struct man_msg*)evt->data)->p0 = (unsigned int)&temp_vchan->read_bufs[0];
-            
-          } else if (temp_vchan->state & RD_BUF1_FIRST) { // return buf 1, it was filled first
-            temp_vchan->state &= ~(RD_BUF1_FIRST);
-            temp_vchan->state |= TASK_RD_BUF1;
-            temp_vchan->state &= ~(RD_BUF1_FILLED);
-            ((struct man_msg*)evt->data)->p0 = (unsigned int)&temp_vchan->read_bufs[1];
-          }
-        } else if (temp_vchan->state & RD_BUF0_FILLED) {
-          // only buf 0 is filled, return this one
-          temp_vchan->state |= TASK_RD_BUF0;
-          temp_vchan->state &= ~(RD_BUF0_FILLED);
-          ((struct man_msg*)evt->data)->p0 = (unsigned int)&temp_vchan->read_bufs[0];
-          
-        } else if (temp_vchan->state & RD_BUF1_FILLED) {
-          // only buf 1 is filled, return this one
-          temp_vchan->state |= TASK_RD_BUF1;
-          temp_vchan->state &= ~(RD_BUF1_FILLED);
-          ((struct man_msg*)evt->data)->p0 = (unsigned int)&temp_vchan->read_bufs[1]; 
-        }
+    __asm__ volatile ("outct res[%0], 0x01"::"r"(chan_end));
+    vc->tx_offset = vcbuf->data_size; // the frame is the whole buffer
+    vc->tx_state = VC_TX_END;
+    return;
+  } else if (vc->tx_state == VC_TX_START) {
+    // hardware thread accepted the object, send it word by word
+    word = (unsigned int *)((unsigned int)vcbuf->data + vc->tx_offset + vc->obj_size);
+
+    for (j = 0; j < vc->obj_size / 4; j++) {
+      word--; // send highest word in memory of object first
+      __asm__ volatile ("out res[%0], %1"::"r"(chan_end),"r"(*word));
+    }
 
-      } else {
-        // no completely filled buffer was available but maybe we can find
-        // a partly filled buffer that meets the tasks requirement
-        // for the minimal amount of data. If minimal amount is 0, we only
-        // want completely filled buffers
-        
-        if (temp_vchan->state & CS_RD_BUF0 &&
-          temp_vchan->min_read_size > 0 &&
-          temp_vchan->read_bufs[0].data_size >= temp_vchan->min_read_size) {
-          // CS has partially filled buf 0 and it meets the amount requirement, return this buffer
-          temp_vchan->state &= ~(CS_RD_BUF0);
-          temp_vchan->state |= TASK_RD_BUF0;
-          ((struct man_msg*)evt->data)->p0 = (unsigned int)&temp_vchan->read_bufs[0];
-
-        } else if (temp_vchan->state & CS_RD_BUF0 &&
-          temp_vchan->min_read_size > 0 &&
-          temp_vchan->read_bufs[0].data_size >= temp_vchan->min_read_size) {
-          // CS has partially filled buf 0 and it meets the amount requirement, return this buffer
-          temp_vchan->state &= ~(CS_RD_BUF1);
-          temp_vchan->state |= TASK_RD_BUF1;
-          ((struct man_msg*)evt->data)->p0 = (unsigned int)&temp_vchan->read_bufs[1];
+    __asm__ volatile ("outct res[%0], 0x01"::"r"(chan_end));
+    vc->tx_state = VC_TX_END;
+    return;
+  }
 
-        } else {
-          ((struct man_msg*)evt->data)->p0 = 0; // send null pointer to kernel as buffer pointer
-          temp_vchan->state |= TASK_RD_BLOCK;   // indicate that the task will be blocked by the kernel
-        }
-      }
+  // hardware thread received the object
+  if (!vc->stream) {
+    vc->tx_offset += vc->obj_size;
+  }
 
-      // check if channel events needs to be reenabled
-      // channel events are disabled when there is no
-      // buffer available because the task is using them
-      // or has not yet read them.
-      if (temp_vchan->state & CS_RD_BLOCK) {
-        if (( !(temp_vchan->state & TASK_RD_BUF0) && !(temp_vchan->state & RD_BUF0_FILLED)) ||
-            ( !(temp_vchan->state & TASK_RD_BUF1) && !(temp_vchan->state & RD_BUF1_FILLED))) {
-          _xtask_chan_enable_events(temp_vchan->event->res);
-        }
-      }
-    } else {
-      // virtual channel not found, should not get here
-    }
-    
-    return REPLY; // return buffer to read or null pointer to kernel
-    
-  } else if (((struct man_msg*)evt->data)->cmd == 3) {
-    /*
-       Task requests a buffer to fill and
-       send to hardware thread.
-       p0 = handle
-    */
-    
-    struct vchan *vc = csdata->vchans;
-    
-    // find the virtual channel in the list by the given handle
-    while (vc != NULL) {
-      if (vc->handle == ((struct man_msg*)evt->data)->p0) {
-        break;
-      }
+  if (vc->tx_offset < vcbuf->data_size) {
+    // ask the hardware thread to accept the next object
+    __asm__ volatile ("outct res[%0], 0x01"::"r"(chan_end));
+    vc->tx_state = VC_TX_START;
+    return;
+  }
 
-      vc = vc->next;
-    }
-    
-    // return one of the available buffers
-    // we actually assume that both buffers are free and thus also
-    // not in use by CS to transfer to a hardware thread
-    // this because this request should be made before the first transfer
-    // and should only be made once because requesting a transfer
-    // will return a new buffer
-    // we still check the flags just to be sure
-    if (! (vc->state & TASK_WR_BUF0)) {
-      vc->state |= TASK_WR_BUF0;
-      vc->write_bufs[0].data_size = 0;
-      ((struct man_msg*)evt->data)->p0 = (unsigned int)&vc->write_bufs[0];
-    } else if (! (vc->state & TASK_WR_BUF1)) {
-      vc->state |= TASK_WR_BUF1;
-      vc->write_bufs[1].data_size = 0;
-      ((struct man_msg*)evt->data)->p0 = (unsigned int)&vc->write_bufs[1];
-    } else {
-      ((struct man_msg*)evt->data)->p0 = 0;
-      // both not available, should not get here
-    }
-    
-    return REPLY; // return the buffer pointer to the kernel
-
-  } else if (((struct man_msg*)evt->data)->cmd == 4) {
-    /* 
-       Task requests to transfer a buffer to a hardware thread
-       p0 = pointer to vc_buf structure 
-    */
-    unsigned int bufnr;
-    struct vchan *vc = csdata->vchans;
-    
-    // find the virtual channel by the given vc_buf structure
-    while (vc != NULL) {
-      if (&vc->write_bufs[0] == (struct vc_buf *)((struct man_msg*)evt->data)->p0) {
-        bufnr = 0;
-        break;
-      } else if (&vc->write_bufs[1] == (struct vc_buf *)((struct man_msg*)evt->data)->p0) {
-        bufnr = 1;
-        break;
-      }
-      vc = vc->next;
-    }
+  // buffer completed, continue with the next queued buffer
+  xtask_vc_tx_complete(vc);
+  vc->tx_state = VC_TX_IDLE;
+  xtask_vc_tx_start(vc);
+}
 
-    // return new buffer before start transmission to hardware task
-    if (bufnr == 0) {
-      
-      vc->state &= ~(TASK_WR_BUF0); // clear buffer 0 in use by task
+/******************************************************************************
+ * Function:     xtask_vc_tx_complete                                         *
+ * Parameters:   vc      - Pointer to vchan structure                         *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Give the oldest queued write buffer back to the ring after   *
+ *               its transfer. A task that blocked because all write buffers  *
+ *               were queued gets this buffer.                                *
+ ******************************************************************************/
+void xtask_vc_tx_complete(struct vchan *vc)
+{
+  vc->write_bufs[vc->wr_head].data_size = 0;
+  vc->wr_head = (vc->wr_head + 1) % vc->nr_bufs;
+  vc->wr_queued--;
 
-      // return new buffer or return null pointer if there is no free buffer
-      if (! (vc->state & TASK_WR_BUF1)) {
-        ((struct man_msg*)evt->data)->p0 = (unsigned int)&vc->write_bufs[1];
-      } else {
-        ((struct man_msg*)evt->data)->p0 = 0;
-      }
-    } else if (bufnr == 1) {
-      
-      vc->state &= ~(TASK_WR_BUF1); // clear buffer 1 in use by task
+  if (vc->state & TASK_WR_BLOCK) {
+    struct p_kreply *kr;
 
-      // return new buffer or return null pointer if there is no free buffer
-      if (! (vc->state & TASK_WR_BUF0)) {
-        ((struct man_msg*)evt->data)->p0 = (unsigned int)&vc->write_bufs[0];
-      } else {
-        ((struct man_msg*)evt->data)->p0 = 0;
-      }
-    }
-    
-    _xtask_man_send(evt->res, evt->data); // send reply to kernel
-                                          // with new buffer
+    vc->state &= ~(TASK_WR_BLOCK);
+    vc->wr_task = (vc->wr_head + vc->wr_queued) % vc->nr_bufs;
 
-    xtask_vc_send_buf(vc, bufnr); // send the buffer to the hardware thread
-    return NO_REPLY; // already have sent the reply
-    
-  } else if (((struct man_msg*)evt->data)->cmd == 5) {
-    /*
-       Task requests to register a new mailbox.
-       p0 = mailbox id
-       p1 = task id
-       p2 = inbox size
-       p3 = outbox size
-    */
-    // allocate a new mailbox structure
-    struct mailbox *reg = malloc(sizeof(struct mailbox));
-    reg->id  = ((struct man_msg*)evt->data)->p0;
-    reg->tid = ((struct man_msg*)evt->data)->p1;
-
-    // find the kernel from which the request originates
-    struct cs_kernel *temp_k = csdata->kernels;
-    
-    while (temp_k != NULL) {
-      if (temp_k->c_sync == evt->res) {
-        break;
-      }
+    kr = xtask_get_free_kreply(vc->csdata, vc->kernel);
 
-      temp_k = temp_k->next;
-    }
+    if (kr != NULL) {
+      // add pending kernel reply and notify kernel
+      kr->reply.cmd = 0x07;
+      kr->reply.p0  = vc->handle;
+      kr->reply.p1  = (unsigned int)&vc->write_bufs[vc->wr_task];
 
-    if (temp_k == NULL) {
-      // should not get here
-    } else {
-      reg->kernel = temp_k;
+      xtask_notify_kernel(vc->kernel);
     }
+  }
+}
 
-    // create inbox
-    reg->inbox.buf_size  = ((struct man_msg*)evt->data)->p2;
-    reg->inbox.data_size = 0;
-    reg->inbox.data      = malloc(reg->inbox.buf_size);
-    reg->inbox_state     = 0; 
-    
-    // create outbox
-    reg->outbox.buf_size  = ((struct man_msg*)evt->data)->p3;
-    reg->outbox.data_size = 0;
-    reg->outbox.data      = malloc(reg->outbox.buf_size); 
+/******************************************************************************
+ * Function:     xtask_process_man_msg                                        *
+ * Parameters:   csdata  - Pointer to cs_data structure.                      *
+ *               k       - Kernel from which the request originates,          *
+ *                         the environment of its chanend event.              *
+ * Return:       whether CS should send a reply back to the kernel            *
+ *                                                                            *
+ *               Process a request received throught a management channel     *
+ *               from a kernel. The request is handled by the function in     *
+ *               the management request table indexed by the command.         *
+ ******************************************************************************/ 
+unsigned int xtask_process_man_msg(struct cs_data *   csdata,
+                                   struct cs_kernel * k)
+{
+  unsigned int cmd = ((struct man_msg*)k->event->data)->cmd;
 
-    // add to the front of list with mailboxes
-    reg->next = csdata->mailboxes;
-    csdata->mailboxes = reg;
+  if (cmd >= NR_MAN_CMDS || csdata->man_table[cmd] == NULL) {
+    return NO_REPLY; // unknown request
+  }
 
-    ((struct man_msg*)evt->data)->p0 = 0; // returns 0 for now
-  
-    return REPLY;
-  
-  } else if (((struct man_msg*)evt->data)->cmd == 6) {
-    /*
-       Task requests to create a new remote hardware thread
-       p0 = code (task number!, not a pointer to a function)
-       p1 = stackwords
-       p2 = args
-       p3 = object size
-       p4 = rx buf size
-       p5 = tx buf size
-    */
-    struct p_request **prp;
-    
-    if (!csdata->ring) {
-      struct p_kreply *kr;
-      
-      // we don't have a ring bus, cannot create remote dedicated hardware thread
-      // add kernel reply to queue and notify kernel
-      kr = xtask_get_free_kreply(csdata);
+  return csdata->man_table[cmd](csdata, k, k->event);
+}
 
-      if (kr != NULL) {
-        
-        struct cs_kernel *temp_k = csdata->kernels;
-    
-        // find the kernel that has the pending reply
-        while (temp_k != NULL) {
-          if (temp_k->c_sync == evt->res) {
-            break;
-          }
-    
-          temp_k = temp_k->next;
-        }
-        
-        kr->state    |= KR_USED;
-        kr->k         = temp_k;
-        kr->reply.cmd = 2;
-        kr->reply.p1  = ((struct man_msg*)evt->data)->p0;
-        kr->reply.p2 = 1; // return value, failure
-          
-        _xtask_notify_kernel(temp_k->c_async);
-      }
-      
-      return NO_REPLY;
+/******************************************************************************
+ * Function:     xtask_man_create_thread                                      *
+ * Parameters:   csdata  - Pointer to cs_data structure.                      *
+ *               k       - Kernel from which the request originates.          *
+ *               evt     - Pointer to chan_event structure.                   *
+ * Return:       whether CS should send a reply back to the kernel            *
+ *                                                                            *
+ *               Management request 1, create hardware thread with channel.   *
+ ******************************************************************************/
+unsigned int xtask_man_create_thread(struct cs_data *    csdata,
+                                     struct cs_kernel *  k,
+                                     struct chan_event * evt)
+{
+  /* 
+     create new hardware thread with channel
+     p0 = pc
+     p1 = stackwords
+     p2 = args
+     p3 = object size, number of buffers in upper half
+     p4 = rx buf size
+     p5 = tx buf size 
+  */
+  struct vchan **vpp;
+  struct vchan *vc;
+
+  // a parked hardware thread with a large enough stack is started again,
+  // its chanends, stack and chan_event are reused
+  for (vpp = &csdata->hwt_pool; *vpp != NULL; vpp = &(*vpp)->next) {
+    if ((*vpp)->stack_words >= ((struct man_msg*)evt->data)->p1) {
+      break;
     }
-    
-    // create a new virtual channel
-    struct vchan *new_vchan = malloc(sizeof(struct vchan));
-    new_vchan->own_chanend  = _xtask_get_chanend();
-    new_vchan->state        = 0;
-    new_vchan->read_bufs[0].data       = malloc(((struct man_msg*)evt->data)->p4);
-    new_vchan->read_bufs[0].buf_size   = ((struct man_msg*)evt->data)->p4;
-    new_vchan->read_bufs[0].data_size  = 0;
-    new_vchan->read_bufs[1].data       = malloc(((struct man_msg*)evt->data)->p4);
-    new_vchan->read_bufs[1].buf_size   = ((struct man_msg*)evt->data)->p4;
-    new_vchan->read_bufs[1].data_size  = 0;
-    new_vchan->write_bufs[0].data      = malloc(((struct man_msg*)evt->data)->p5);
-    new_vchan->write_bufs[0].buf_size  = ((struct man_msg*)evt->data)->p5;
-    new_vchan->write_bufs[0].data_size = 0;
-    new_vchan->write_bufs[1].data      = malloc(((struct man_msg*)evt->data)->p5);
-    new_vchan->write_bufs[1].buf_size  = ((struct man_msg*)evt->data)->p5;
-    new_vchan->write_bufs[1].data_size = 0;
-    new_vchan->obj_size                = ((struct man_msg*)evt->data)->p3;
-    new_vchan->min_read_size           = 0;
-    new_vchan->csdata                  = csdata;
-  
-    // prepare ring bus message
-    csdata->rbuf->cs_id    = csdata->id;
-    csdata->rbuf->msg_type = 0x02;
-    csdata->rbuf->status   = 0;
-    unsigned int *pl       = (unsigned int *)csdata->rbuf->payload;
-    csdata->rbuf->payload_size = 12;
-    
-    *pl = ((struct man_msg*)evt->data)->p1; // code
-    pl++;
-    *pl = ((struct man_msg*)evt->data)->p2; // stack size
-    pl++;
-    *pl = (unsigned int)new_vchan->own_chanend; // this CS chanend
-
-    _xtask_ring_send(csdata); // send the ring bus message
-
-    // we will have to wait for the ring bus message to get back
-    // we allocate a new pending ring bus request structure
-    // to save the state
-    struct p_request *pr = malloc(sizeof(struct p_request));
-    pr->tid = ((struct man_msg*)evt->data)->p0;
-    pr->msg_type = 0x02;
-    pr->data = (void *)new_vchan;
-    
-    struct cs_kernel *temp_k = csdata->kernels;
-    
-    // find the kernel that has the pending reply
-    while (temp_k != NULL) {
-      if (temp_k->c_sync == evt->res) {
-        break;
-      }
+  }
 
-      temp_k = temp_k->next;
+  if (*vpp != NULL) {
+    vc = *vpp;
+    *vpp = vc->next;
+
+    // keep the buffer rings if the new thread uses the same rings
+    if (xtask_vc_bufs_fit(vc, 
+                          ((struct man_msg*)evt->data)->p3,
+                          ((struct man_msg*)evt->data)->p4,
+                          ((struct man_msg*)evt->data)->p5)) {
+      xtask_vc_reset(vc);
+    } else {
+      xtask_vc_free_bufs(vc);
+      xtask_vc_alloc_bufs(vc, 
+                          ((struct man_msg*)evt->data)->p3,
+                          ((struct man_msg*)evt->data)->p4,
+                          ((struct man_msg*)evt->data)->p5);
     }
 
-    new_vchan->kernel = temp_k; // also the vchan wants to know the kernel
-    pr->kernel = temp_k;
+    vc->state         = 0;
+    vc->min_read_size = 0;
+    vc->kernel        = k;
 
-    // add pending ring bus request to end of list
-    prp = &csdata->p_reqs;
+    // the virtual channel gets its old handle back
+    csdata->vc_table[vc->handle] = vc;
+    vc->next = csdata->vchans;
+    csdata->vchans = vc;
 
-    while (*prp != NULL) {
-      prp = &(*prp)->next;
-    }
+    xtask_hwt_restart(vc, 
+                      (void*)((struct man_msg*)evt->data)->p0, 
+                      ((struct man_msg*)evt->data)->p2);
 
-    pr->next = *prp;
-    *prp = pr;
-    
-    return NO_REPLY; // the kernel does not expect a reply
-    
-  } else if (((struct man_msg*)evt->data)->cmd == 7) {
-    /* 
-       The task requests to get the outbox.
-       p0 = mailbox id
-    */
-    struct mailbox *reg;
-    reg = xtask_get_mailbox(csdata,((struct man_msg*)evt->data)->p0);
-    if (reg != NULL) {
-      ((struct man_msg*)evt->data)->p0 = (unsigned int) &reg->outbox;
-    } else {
-      ((struct man_msg*)evt->data)->p0 = 0;
+    if (vc->shm != NULL) {
+      xtask_vc_shm_attach(vc);
     }
-      
-    return REPLY;
-    
-  } else if (((struct man_msg*)evt->data)->cmd == 8) {
-    /* 
-       The task requests to send his outbox
-       to a recipient.
-       p0 = sender mailbox id
-       p1 = recipient mailbox id
-    */
-    unsigned int receiver;
-    unsigned int sender;
-    struct mailbox *recv_mb;
-    struct mailbox *send_mb;
-    receiver = ((struct man_msg*)evt->data)->p1;
-    sender = ((struct man_msg*)evt->data)->p0;
-
-    recv_mb = xtask_get_mailbox(csdata, receiver);    
-    send_mb = xtask_get_mailbox(csdata, sender);    
-
-    // check if receiver is on the same tile
-    if (recv_mb != NULL) {
-      // recipient is on the same tile, makes things easier :)
-      if (recv_mb->inbox_state & INBOX_TASK_WAITING) {
-        // recipient is blocked waiting for a message
-        
-        struct p_kreply *kr;
-        
-        // copy sender outbox to recipient inbox
-        memcpy(recv_mb->inbox.data, send_mb->outbox.data, send_mb->outbox.data_size);
-        recv_mb->inbox.data_size = send_mb->outbox.data_size;
 
-        recv_mb->inbox_state &= ~(INBOX_TASK_WAITING); // not waiting anymore soon
-                
-        kr = xtask_get_free_kreply(csdata);
+    _xtask_chan_enable_events(vc->own_chanend);
 
-        // add a new pending kernel reply for the recipient task to unblock it
-        // and notify the kernel
-        if (kr != NULL) {
-          kr->state |= KR_USED;
-          kr->k = recv_mb->kernel;
-          kr->reply.cmd = 0x03;
-          kr->reply.p0 = recv_mb->tid;
-          kr->reply.p1 = (unsigned int) &recv_mb->inbox;   
-          
-          _xtask_notify_kernel(recv_mb->kernel->c_async);
-        }
+    ((struct man_msg*)evt->data)->p0 = vc->handle;
+    ((struct man_msg*)evt->data)->p1 = vc->own_chanend;
+    return REPLY;
+  }
 
-        kr = xtask_get_free_kreply(csdata);
+  chanend a = _xtask_get_chanend();
+  chanend b = _xtask_get_chanend();
+  _xtask_set_chanend_dest(a,b);
+  _xtask_set_chanend_dest(b,a);
+  
+  // create new hardware thread
+  unsigned int * new_stack = (unsigned int *)malloc(((struct man_msg*)evt->data)->p1 * WORD_SIZE);
+  void *         new_sp    = (void*) (new_stack + (((struct man_msg*)evt->data)->p1 - 1));
+  _xtask_create_thread((void*)((struct man_msg*)evt->data)->p0, 
+                       (void*)new_sp, 
+                       (void*)((struct man_msg*)evt->data)->p2, 
+                       b);
+  csdata->nr_threads++;
+                                                         
+  // allocate and initialise new chan_event structure for hardware thread
+  struct chan_event *new_ce = (struct chan_event*) malloc(sizeof(struct chan_event));
+  new_ce->res = a;
+  new_ce->vector = (void *) _xtask_vc_vect;
+
+  // allocate and initialise new vchan structure for hardware thread
+  struct vchan *new_vchan   = malloc(sizeof(struct vchan));
+  new_vchan->own_chanend    = a;
+  new_vchan->thread_chanend = b;
+  new_vchan->event          = new_ce;
+  new_vchan->state          = 0;
+  new_vchan->min_read_size  = 0;
+  new_vchan->csdata         = csdata;
+  new_vchan->stack          = new_stack;
+  new_vchan->stack_words    = ((struct man_msg*)evt->data)->p1;
+
+  // allocate the read and write buffer rings
+  xtask_vc_alloc_bufs(new_vchan, 
+                      ((struct man_msg*)evt->data)->p3,
+                      ((struct man_msg*)evt->data)->p4,
+                      ((struct man_msg*)evt->data)->p5);
+
+  new_vchan->kernel = k; // save a pointer to the kernel that made the request
+
+  // add vchan to handle table and list of virtual channels
+  xtask_vc_register(csdata, new_vchan);
+  ((struct man_msg*)evt->data)->p0 = new_vchan->handle; // return handle to kernel
+  ((struct man_msg*)evt->data)->p1 = a;       // return CS chanend to hardware thread, seems to be not used by kernel
+
+  if (new_vchan->shm != NULL) {
+    xtask_vc_shm_attach(new_vchan); // the thread waits for the shared rings
+  }
 
-        // add a new pending kernel reply for the sending task
-        // and notify the kernel
-        if (kr != NULL) {
-          kr->state |= KR_USED;
-          kr->k = send_mb->kernel;
-          kr->reply.cmd = 0x04;
-          kr->reply.p0 = send_mb->tid;
-          kr->reply.p1 = 0; /* return value.. delivery failed or not... */
-          
-          _xtask_notify_kernel(send_mb->kernel->c_async);
-        }
-        
-          
-      } else {
-        struct mailbox **rpp;
-        // recipient task is not ready to receive
-        // add sender to pending outboxes
+  new_ce->env = new_vchan; // address of vchan structure, environment vector for hardware thread receive vector
+  _xtask_set_chan_event((void*)new_ce); // start receive data from hardware thread
+  return REPLY; // send a reply back to kernel
+}
 
-        // save recipient mailbox id
-        send_mb->outbox_dest = recv_mb->id;
+/******************************************************************************
+ * Function:     xtask_man_vc_receive                                         *
+ * Parameters:   csdata  - Pointer to cs_data structure.                      *
+ *               k       - Kernel from which the request originates.          *
+ *               evt     - Pointer to chan_event structure.                   *
+ * Return:       whether CS should send a reply back to the kernel            *
+ *                                                                            *
+ *               Management request 2, get read buffer of virtual channel.    *
+ ******************************************************************************/
+unsigned int xtask_man_vc_receive(struct cs_data *    csdata,
+                                  struct cs_kernel *  k,
+                                  struct chan_event * evt)
+{
+  /*
+     Task requests a (optionally partially) filled read buffer
+     from virtual channel to hardware thread.
+     p0 = handle
+     p1 = min read size
+  */
+  
+  // find the right virtual channel by the given handle
+  struct vchan *vc = xtask_get_vchan(csdata, ((struct man_msg*)evt->data)->p0);
+  struct vc_buf *buf;
 
-        // add sender to list of pending outboxes
-        rpp = &csdata->p_outbox;
-        
-        while (*rpp != NULL) {
-          rpp = &(*rpp)->p_next;
-        }
+  if (vc == NULL) {
+    // virtual channel not found
+    ((struct man_msg*)evt->data)->p0 = 0;
+    return REPLY;
+  }
 
-        send_mb->p_next = *rpp;
-        *rpp = send_mb;  
+  vc->min_read_size = ((struct man_msg*)evt->data)->p1; 
 
-        // indicate at the recipient inbox that a sender is pending
-        recv_mb->inbox_state |= INBOX_SENDER_PEND;
-      }
-    } else {
-      // recipient is not on this tile, maybe on another tile
-      // use the ring bus to inform other communication servers
-      // if we don't have a ring bus, add a pending kernel reply with error
-      
-      if (!csdata->ring) {
-        struct p_kreply *kr;
-        kr = xtask_get_free_kreply(csdata);
+  // task made a new read request, so the previously held
+  // buffer is empty again and goes back to the ring
+  if (vc->rd_task != VC_NO_BUF) {
+    vc->read_bufs[vc->rd_task].data_size = 0;
+    vc->rd_task = VC_NO_BUF;
 
-        // add a new pending kernel reply for the sending task
-        // and notify the kernel
-        if (kr != NULL) {
-          kr->state |= KR_USED;
-          kr->k = send_mb->kernel;
-          kr->reply.cmd = 0x04;
-          kr->reply.p0 = send_mb->tid;
-          kr->reply.p1 = 1; /* return value.. delivery failed or not... */
-          
-          _xtask_notify_kernel(send_mb->kernel->c_async);
-        }
-      } else {
-        struct p_request **prp;
-        struct p_request *pr;
-        unsigned int *pl = (unsigned int *)csdata->rbuf->payload;
-  
-        send_mb->outbox_dest = receiver;
-  
-        csdata->rbuf->cs_id = csdata->id;
-        csdata->rbuf->msg_type = 0x03;
-        csdata->rbuf->status = 0;
-        
-        // first 4 bytes = mailbox id, remaining = message
-        csdata->rbuf->payload_size = send_mb->outbox.data_size + 4;
-            
-        *pl = ((struct man_msg*)evt->data)->p1; // recipient mailbox id
-        pl++;
-  
-        // copy outbox to ring bus payload buffer
-        memcpy(pl, send_mb->outbox.data, send_mb->outbox.data_size);
-        
-        _xtask_ring_send(csdata);
-        
-        // add pending reply from ring bus to the list
-        pr           = malloc(sizeof(struct p_request));
-        pr->tid      = send_mb->tid;
-        pr->msg_type = 0x03;
-        pr->data     = (void *)send_mb;
-        pr->kernel   = send_mb->kernel;
-      
-        prp = &csdata->p_reqs;
-  
-        while (*prp != NULL) {
-          prp = &(*prp)->next;
-        }
-  
-        pr->next = *prp;
-        *prp = pr;
-      }        
+    if (vc->shm != NULL) {
+      // the hardware thread may fill the buffer again
+      vc->shm->rd_get = (vc->shm->rd_get + 1) % (2 * vc->nr_bufs);
+      xtask_vc_shm_kick(vc, &vc->shm->rd_wait);
     }
+  }
 
-    return NO_REPLY;
-  } else if (((struct man_msg*)evt->data)->cmd == 9) {
-    /*
-       Task requests to read his inbox
-       p0 = mailbox id
-       p1 = location (local tile, anywhere)
-    */
-    struct mailbox *reg;
-    struct mailbox **rpp;
-    unsigned int *pl;
+  // take the oldest filled buffer, or a partly filled buffer
+  // that meets the minimum amount of data of the task
+  buf = xtask_vc_take_rd_buf(vc);
 
-    reg = xtask_get_mailbox(csdata,((struct man_msg*)evt->data)->p0);
-    
-    if (reg != NULL) {
-      reg->inbox_state |= INBOX_TASK_WAITING;      
-    } else {
-      // mailbox not found
-    }
+  if (buf != NULL) {
+    ((struct man_msg*)evt->data)->p0 = (unsigned int)buf;
+  } else {
+    ((struct man_msg*)evt->data)->p0 = 0; // send null pointer to kernel as buffer pointer
+    vc->state |= TASK_RD_BLOCK;           // indicate that the task will be blocked by the kernel
 
-    if (reg->inbox_state & INBOX_SENDER_PEND) {
-      // someone tried to send a message but
-      // the task was not ready
-      
-      reg->inbox_state &= ~(INBOX_SENDER_PEND);
+    if (vc->state & VC_EXITED) {
+      // no more data will arrive, unblock the task with a null pointer
+      xtask_vc_wake_reader(vc, csdata);
+      return REPLY;
+    }
+  }
 
-      rpp = &csdata->p_outbox;      
+  // check if channel events needs to be reenabled
+  // channel events are disabled when there is no
+  // buffer available because the task is using them
+  // or has not yet read them.
+  if ((vc->state & CS_RD_BLOCK) && 
+      vc->rd_filled + (vc->rd_task != VC_NO_BUF) < vc->nr_bufs) {
+    vc->state &= ~(CS_RD_BLOCK);
+
+    // in streaming mode the hardware thread may wait with a frame
+    if (vc->state & VC_RX_PENDING) {
+      xtask_vc_stream_rx_frame(vc);
+    }
 
-      /* check for local pending sender(s) */
-      while (*rpp != NULL) {
-        if ((*rpp)->outbox_dest == reg->id) {
-          // found pending sender
-          if (reg->inbox_state & INBOX_TASK_WAITING) {
-            struct p_kreply *kr;    
-          
-            reg->inbox_state &= ~(INBOX_TASK_WAITING);
-            
-            // copy sender outbox to recipient inbox
-            memcpy(reg->inbox.data, (*rpp)->outbox.data, (*rpp)->outbox.data_size);
-            reg->inbox.data_size = (*rpp)->outbox.data_size;
-
-            kr = xtask_get_free_kreply(csdata);
-
-            if (kr != NULL) {
-              // add pending kernel reply to unblock recipient task
-              kr->state    |= KR_USED;
-              kr->k        = reg->kernel;
-              kr->reply.p0 = reg->tid;
-              kr->reply.p1 = (unsigned int) &reg->inbox;
-        
-              // notify kernel for the pending reply
-              _xtask_notify_kernel(reg->kernel->c_async);
-            }
-
-            kr = xtask_get_free_kreply(csdata);
-
-            if (kr != NULL) {
-              // add pending kernel reply to unblock sending task
-              kr->state |= KR_USED;
-              kr->k = (*rpp)->kernel;
-              kr->reply.p0 = (*rpp)->tid;
-              kr->reply.p1 = 1;  // return value.. delivery failed or not... 
-              
-              // notify kernel for the pending reply
-              _xtask_notify_kernel((*rpp)->kernel->c_async);
-            }
+    if (!(vc->state & CS_RD_BLOCK)) {
+      _xtask_chan_enable_events(vc->event->res);
+    }
+  }
+  
+  return REPLY; // return buffer to read or null pointer to kernel
+}
 
-            // remove mailbox from pending outboxes list
-            *rpp = (*rpp)->p_next;
-            
-            // don't set the pointer-pointer to the next element!
-        
-          } else {
-            // found more than one pending senders
-            reg->inbox_state |= INBOX_SENDER_PEND;
-            rpp = &(*rpp)->p_next;
-          }
-        } else {
-          rpp = &(*rpp)->p_next;
-        }
+/******************************************************************************
+ * Function:     xtask_man_vc_get_write_buf                                   *
+ * Parameters:   csdata  - Pointer to cs_data structure.                      *
+ *               k       - Kernel from which the request originates.          *
+ *               evt     - Pointer to chan_event structure.                   *
+ * Return:       whether CS should send a reply back to the kernel            *
+ *                                                                            *
+ *               Management request 3, get write buffer of virtual channel.   *
+ ******************************************************************************/
+unsigned int xtask_man_vc_get_write_buf(struct cs_data *    csdata,
+                                        struct cs_kernel *  k,
+                                        struct chan_event * evt)
+{
+  /*
+     Task requests a buffer to fill and
+     send to hardware thread.
+     p0 = handle
+  */
+  
+  struct vchan *vc = xtask_get_vchan(csdata, ((struct man_msg*)evt->data)->p0);
 
-      } /* end check for local pending senders */
+  if (vc == NULL) {
+    ((struct man_msg*)evt->data)->p0 = 0; // unknown handle
+    return REPLY;
+  }
+  
+  // return the buffer the task may fill, this request should be
+  // made before the first transfer and should only be made once
+  // because requesting a transfer will return a new buffer
+  if (vc->wr_task == VC_NO_BUF && vc->wr_queued < vc->nr_bufs) {
+    vc->wr_task = (vc->wr_head + vc->wr_queued) % vc->nr_bufs;
+    vc->write_bufs[vc->wr_task].data_size = 0;
+  }
 
-      if (((struct man_msg*)evt->data)->p1 == ALL_TILES && csdata->ring) {
-        /* notify CS on other tiles that this task was/is ready to receive */
-        csdata->rbuf->cs_id        = csdata->id;
-        csdata->rbuf->msg_type     = 0x04;
-        csdata->rbuf->status       = 0x00;
-        csdata->rbuf->payload_size = 0x04;
-        pl = csdata->rbuf->payload;
-        *pl = reg->id;
-    
-        _xtask_ring_send(csdata); // send ring bus message
-        // don't need to add to pending ring bus reply list
-        // because no action is taken when reply from ring bus
+  if (vc->wr_task != VC_NO_BUF) {
+    ((struct man_msg*)evt->data)->p0 = (unsigned int)&vc->write_bufs[vc->wr_task];
+  } else {
+    ((struct man_msg*)evt->data)->p0 = 0;
+    // all buffers queued for transfer, should not get here
+  }
+  
+  return REPLY; // return the buffer pointer to the kernel
+}
+
+/******************************************************************************
+ * Function:     xtask_man_vc_send                                            *
+ * Parameters:   csdata  - Pointer to cs_data structure.                      *
+ *               k       - Kernel from which the request originates.          *
+ *               evt     - Pointer to chan_event structure.                   *
+ * Return:       whether CS should send a reply back to the kernel            *
+ *                                                                            *
+ *               Management request 4, send write buffer to hardware thread.  *
+ ******************************************************************************/
+unsigned int xtask_man_vc_send(struct cs_data *    csdata,
+                               struct cs_kernel *  k,
+                               struct chan_event * evt)
+{
+  /* 
+     Task requests to transfer a buffer to a hardware thread
+     p0 = handle
+     p1 = pointer to vc_buf structure 
+  */
+  struct vchan *vc = xtask_get_vchan(csdata, ((struct man_msg*)evt->data)->p0);
+  struct vc_buf *buf = (struct vc_buf *)((struct man_msg*)evt->data)->p1;
+  unsigned int bufnr;
+  
+  // the buffer must be the write buffer held by the task, the pointer
+  // comes from the task and is only compared, never dereferenced
+  if (vc == NULL || 
+      vc->wr_task == VC_NO_BUF ||
+      buf != &vc->write_bufs[vc->wr_task]) {
+    ((struct man_msg*)evt->data)->p0 = 0;
+    ((struct man_msg*)evt->data)->p1 = 0; // do not block
+    return REPLY;
+  }
+
+  bufnr = vc->wr_task;
+
+  // queue buffer for transfer, it is always the
+  // next one in the ring after the queued buffers
+  vc->wr_queued++;
+
+  // return next buffer in the ring, or block the task
+  // until a transfer completes if all buffers are queued
+  if (vc->wr_queued < vc->nr_bufs) {
+    vc->wr_task = (bufnr + 1) % vc->nr_bufs;
+    vc->write_bufs[vc->wr_task].data_size = 0;
+    ((struct man_msg*)evt->data)->p0 = (unsigned int)&vc->write_bufs[vc->wr_task];
+  } else {
+    vc->wr_task = VC_NO_BUF;
+    vc->state |= TASK_WR_BLOCK;
+    ((struct man_msg*)evt->data)->p0 = 0;
+    ((struct man_msg*)evt->data)->p1 = vc->handle; // kernel blocks the task on this handle
+  }
+
+  // start sending to the hardware thread, the transfer
+  // continues on events and does not stall the CS
+  xtask_vc_tx_start(vc);
+
+  return REPLY; // return new buffer or null pointer to kernel
+}
+
+/******************************************************************************
+ * Function:     xtask_man_mailbox                                            *
+ * Parameters:   csdata  - Pointer to cs_data structure.                      *
+ *               k       - Kernel from which the request originates.          *
+ *               evt     - Pointer to chan_event structure.                   *
+ * Return:       whether CS should send a reply back to the kernel            *
+ *                                                                            *
+ *               Management request 5, register or remove mailbox.            *
+ ******************************************************************************/
+unsigned int xtask_man_mailbox(struct cs_data *    csdata,
+                               struct cs_kernel *  k,
+                               struct chan_event * evt)
+{
+  /*
+     Task requests to register or remove a mailbox.
+     Only the owning task may remove a mailbox.
+     p0 = mailbox id
+     p1 = task id
+     p2 = inbox size
+     p3 = outbox size
+     p4 = MB_CREATE or MB_DELETE
+     p5 = queue depth, 0 for no queue
+  */
+  struct mailbox *reg = xtask_get_mailbox(csdata, ((struct man_msg*)evt->data)->p0);
+
+  if (((struct man_msg*)evt->data)->p4 == MB_DELETE) {
+    struct mailbox **rpp;
+    struct subscription **spp;
+    struct p_request *pr;
+
+    if (reg == NULL || reg->kernel != k || reg->tid != ((struct man_msg*)evt->data)->p1 ||
+        (reg->inbox_state & (INBOX_TASK_WAITING | INBOX_RECEIVING))) {
+      ((struct man_msg*)evt->data)->p0 = 1; // unknown, not owned by caller or busy
+      return REPLY;
+    }
+
+    // the mailbox may not have a send in progress
+    for (rpp = &csdata->p_outbox; *rpp != NULL && *rpp != reg; rpp = &(*rpp)->p_next);
+    for (pr = csdata->p_reqs; pr != NULL && pr->data != (void *) reg; pr = pr->next);
+
+    if (*rpp != NULL || pr != NULL || reg->outbox_cs != 0) {
+      ((struct man_msg*)evt->data)->p0 = 1;
+      return REPLY;
+    }
+
+    // fail local senders that wait for this mailbox
+    rpp = &csdata->p_outbox;
+
+    while (*rpp != NULL) {
+      if ((*rpp)->outbox_dest == reg->id) {
+        struct p_kreply *kr = xtask_get_free_kreply(csdata, (*rpp)->kernel);
+        
+        if (kr != NULL) {
+          kr->reply.cmd = 0x04;
+          kr->reply.p0 = (*rpp)->tid;
+          kr->reply.p1 = 1; // delivery failed
+          
+          xtask_notify_kernel((*rpp)->kernel);
+        }
+        
+        *rpp = (*rpp)->p_next;
+      } else {
+        rpp = &(*rpp)->p_next;
       }
     }
 
-    return NO_REPLY;
-  
-  } else if (((struct man_msg*)evt->data)->cmd == 10) {
-    /*
-       Kernel has received a notification from CS
-       and now wants to receive the pending reply.
-    */   
-
-    struct cs_kernel *temp_k = csdata->kernels;
-    struct p_kreply *kr;    
-
-    // find out which kernel by chanend
-    while (temp_k != NULL) {
-      if (temp_k->c_sync == evt->res) {
-        break;
+    // remove the subscriptions of the mailbox
+    for (spp = &csdata->subs; *spp != NULL; ) {
+      if ((*spp)->mb == reg) {
+        struct subscription *sub = *spp;
+        *spp = sub->next;
+        free(sub);
+      } else {
+        spp = &(*spp)->next;
       }
+    }
+
+    xtask_mb_index_remove(csdata, reg);
 
-      temp_k = temp_k->next;
+    // remove from list with mailboxes
+    for (rpp = &csdata->mailboxes; *rpp != reg; rpp = &(*rpp)->next);
+    *rpp = reg->next;
+
+    for (; reg->q_depth > 0; reg->q_depth--) {
+      free(reg->queue[reg->q_depth - 1].data);
     }
 
-    if (temp_k != NULL) {
+    free(reg->queue);
+    free(reg->inbox.data);
+    free(reg->outbox.data);
+    free(reg);
 
-      kr = xtask_get_kreply(csdata, temp_k);
+    // other CS drop the mailbox from their directory
+    xtask_mb_loc_announce(csdata, 0x0B, ((struct man_msg*)evt->data)->p0);
 
-      // check if a pending kernel reply has been found 
-      if (kr != NULL) {
+    ((struct man_msg*)evt->data)->p0 = 0;
+    return REPLY;
+  }
 
-        // copy kernel reply data
-        ((struct man_msg*)evt->data)->cmd = kr->reply.cmd;
-        ((struct man_msg*)evt->data)->p0 = kr->reply.p0;
-        ((struct man_msg*)evt->data)->p1 = kr->reply.p1;
-        ((struct man_msg*)evt->data)->p2 = kr->reply.p2;
-        ((struct man_msg*)evt->data)->p3 = kr->reply.p3;
-        ((struct man_msg*)evt->data)->p4 = kr->reply.p4;
-        ((struct man_msg*)evt->data)->p5 = kr->reply.p5;
-        kr->state &= ~(KR_USED);        
-      }
-    } 
-    
+  if (reg != NULL) {
+    ((struct man_msg*)evt->data)->p0 = 1; // id already registered
     return REPLY;
   }
 
-  return NO_REPLY; /* should not reach! */  
+  // allocate a new mailbox structure
+  reg = malloc(sizeof(struct mailbox));
+  reg->id  = ((struct man_msg*)evt->data)->p0;
+  reg->tid = ((struct man_msg*)evt->data)->p1;
+
+  reg->kernel = k;
+
+  // create inbox
+  reg->inbox.buf_size  = ((struct man_msg*)evt->data)->p2;
+  reg->inbox.data_size = 0;
+  reg->inbox.data      = malloc(reg->inbox.buf_size);
+  reg->inbox.vc        = NULL;
+  reg->inbox_state     = 0; 
+  
+  // create outbox
+  reg->outbox.buf_size  = ((struct man_msg*)evt->data)->p3;
+  reg->outbox.data_size = 0;
+  reg->outbox.data      = malloc(reg->outbox.buf_size); 
+  reg->outbox.vc        = NULL;
+  reg->outbox_cs        = 0;
+
+  // create message queue, the messages have the size of the inbox
+  reg->q_depth = ((struct man_msg*)evt->data)->p5;
+  reg->q_head  = 0;
+  reg->q_count = 0;
+  reg->queue   = NULL;
+
+  if (reg->q_depth > 0) {
+    unsigned int i;
+
+    reg->queue = malloc(reg->q_depth * sizeof(struct vc_buf));
+
+    for (i = 0; i < reg->q_depth; i++) {
+      reg->queue[i].buf_size  = reg->inbox.buf_size;
+      reg->queue[i].data_size = 0;
+      reg->queue[i].data      = malloc(reg->inbox.buf_size);
+      reg->queue[i].vc        = NULL;
+    }
+  }
+
+  // add to the front of list with mailboxes
+  reg->next = csdata->mailboxes;
+  csdata->mailboxes = reg;
+
+  xtask_mb_index_insert(csdata, reg);
+
+  // other CS add the mailbox to their directory
+  xtask_mb_loc_announce(csdata, 0x0A, reg->id);
+
+  ((struct man_msg*)evt->data)->p0 = 0;
+
+  return REPLY;
 }
 
 /******************************************************************************
- * Function:     xtask_cs_get_rd_ptr                                          *
- * Parameters:   vc  -   Pointer to vchan structure.                          *
- * Return:       Pointer where CS can write next object or null pointer       *
- *               when no buffer space is available                            *
+ * Function:     xtask_man_create_remote_thread                               *
+ * Parameters:   csdata  - Pointer to cs_data structure.                      *
+ *               k       - Kernel from which the request originates.          *
+ *               evt     - Pointer to chan_event structure.                   *
+ * Return:       whether CS should send a reply back to the kernel            *
  *                                                                            *
- *               The event vector for receiving data through a channel        *
- *               from a hardware thread uses this function to get a pointer   *
- *               to write the next object. This function must be called       *
- *               prior to the reception of every object.                      *
+ *               Management request 6, create hardware thread on other tile.  *
  ******************************************************************************/
-void * xtask_cs_get_rd_ptr(struct vchan *vc)
+unsigned int xtask_man_create_remote_thread(struct cs_data *    csdata,
+                                            struct cs_kernel *  k,
+                                            struct chan_event * evt)
 {
-  unsigned int buf;
-  unsigned int rd_ptr;
-
-  // check which buffer to use
-  if (vc->state & CS_RD_BUF0) {
-    // CS has already partially filled buffer 0, continue using this one
-    buf = 0;
-  } else if (vc->state & CS_RD_BUF1) {
-    // CS has already partially filled buffer 1, continue using this one
-    buf = 1;
-  } else {
-    // CS has no read buffer assigned
-    // See if we can find one that isn't in use by a task or already filled 
-    if ( !(vc->state & TASK_RD_BUF1) && !(vc->state & RD_BUF1_FILLED)) {
-      vc->state |= CS_RD_BUF1;
-      buf = 1;
-    } else if ( !(vc->state & TASK_RD_BUF0) && !(vc->state & RD_BUF0_FILLED)) {
-      vc->state |= CS_RD_BUF0;
-      buf = 0;  
+  /*
+     Task requests to create a new remote hardware thread
+     p0 = task id
+     p1 = code (task number!, not a pointer to a function), 
+          target CS id in upper half
+     p2 = stackwords
+     p3 = object size, number of buffers in upper half
+     p4 = rx buf size, tx buf size in upper half
+     p5 = args
+  */
+  unsigned int code  = ((struct man_msg*)evt->data)->p1 & HWT_CODE_MASK;
+  unsigned int cs_id = ((struct man_msg*)evt->data)->p1 >> HWT_CS_SHIFT;
+  unsigned int tid   = ((struct man_msg*)evt->data)->p0;
+  struct p_request *pr;
+  struct ring_buf *rb;
+  unsigned int *pl;
+  chanend c;
+  
+  // create a new virtual channel
+  struct vchan *new_vchan = malloc(sizeof(struct vchan));
+  new_vchan->own_chanend  = _xtask_get_chanend();
+  new_vchan->state        = 0;
+  new_vchan->min_read_size = 0;
+  new_vchan->csdata       = csdata;
+  new_vchan->kernel       = k; // also the vchan wants to know the kernel
+  new_vchan->stack        = NULL; // thread ends itself on exit
+  new_vchan->stack_words  = 0;
+
+  // allocate the read and write buffer rings, memory
+  // is not shared with a thread on another tile
+  xtask_vc_alloc_bufs(new_vchan, 
+                      ((struct man_msg*)evt->data)->p3 & ~(VC_SHM << VC_BUFS_SHIFT),
+                      ((struct man_msg*)evt->data)->p4 & VC_SIZE_MASK,
+                      ((struct man_msg*)evt->data)->p4 >> VC_SIZE_SHIFT);
+
+  if (cs_id == csdata->id || (!csdata->ring && cs_id == LEAST_LOADED_TILE)) {
+    // thread on this tile, no need to ask other CS
+    c = xtask_hwt_start(csdata, code, 
+                        ((struct man_msg*)evt->data)->p2, 
+                        ((struct man_msg*)evt->data)->p5, 
+                        new_vchan->own_chanend);
+
+    if (c != 0) {
+      xtask_hwt_connect(csdata, new_vchan, tid, c, csdata->id);
     } else {
-      // none available, return zero
-      vc->state |= CS_RD_BLOCK;
-      return (void *)0;
-    } 
-  } 
+      xtask_hwt_fail(csdata, new_vchan, tid);
+    }
+    
+    return NO_REPLY;
+  }
+
+  if (!csdata->ring) {
+    // we don't have a ring bus, cannot create remote dedicated hardware thread
+    xtask_hwt_fail(csdata, new_vchan, tid);
+    return NO_REPLY;
+  }
   
-  // check if there is room in the buffer and calc new pointer
-  if ((vc->read_bufs[buf].buf_size - vc->read_bufs[buf].data_size) < vc->obj_size) {
-    // buffer is unexpectedly full, should not get here
+  // we will have to wait for the ring bus message to get back
+  // we allocate a new pending ring bus request structure
+  // to save the state
+  pr = xtask_get_free_p_request(csdata);
+  pr->tid = tid;
+  pr->data = (void *)new_vchan;
+  pr->kernel = k;
+
+  // prepare ring bus message
+  rb = xtask_ring_alloc(csdata);
+  rb->cs_id    = csdata->id;
+  rb->status   = 0;
+  rb->req_id   = pr->req_id; // the reply is matched with this request
+  pl = (unsigned int *)rb->payload;
+  
+  pl[0] = code;
+  pl[1] = ((struct man_msg*)evt->data)->p2; // stack size
+  pl[2] = ((struct man_msg*)evt->data)->p5; // args
+  pl[3] = (unsigned int)new_vchan->own_chanend; // this CS chanend
+
+  if (cs_id == LEAST_LOADED_TILE) {
+    // collect the load of all CS first, starting with this CS
+    rb->msg_type = 0x0C;
+    rb->payload_size = 24;
+    pl[4] = csdata->id;                    // least loaded CS so far
+    pl[5] = xtask_hwt_score(csdata, code); // and its score
   } else {
-    // new pointer is buffer pointer + current data size
-    rd_ptr = (unsigned int) vc->read_bufs[buf].data;
-    rd_ptr += vc->read_bufs[buf].data_size;
-    vc->read_bufs[buf].data_size += vc->obj_size; // the new data size after receiving one object
-
-    return (void *)rd_ptr;
+    // only the target CS, or the first CS that knows the code
+    rb->msg_type = 0x02;
+    rb->payload_size = 16;
+    rb->dest = cs_id;
   }
 
-  return (void *)0;
+  pr->msg_type = rb->msg_type;
+
+  xtask_ring_send(csdata, rb); // send the ring bus message
+  
+  return NO_REPLY; // the kernel does not expect a reply
 }
 
 /******************************************************************************
- * Function:     xtask_cs_check_rd_blocked_tasks                              *
- * Parameters:   vc      - Pointer to vchan structure.                        *
- *               csdata  - Pointer to cs_data structure                       *
- * Return:       void                                                         *
+ * Function:     xtask_man_get_outbox                                         *
+ * Parameters:   csdata  - Pointer to cs_data structure.                      *
+ *               k       - Kernel from which the request originates.          *
+ *               evt     - Pointer to chan_event structure.                   *
+ * Return:       whether CS should send a reply back to the kernel            *
  *                                                                            *
- *               The event vector for receiving data through a channel        *
- *               from a hardware thread calls this function after receiving   *
- *               an object to see if there was a task blocked on reading      *
- *               data which can now be unblocked.                             *
+ *               Management request 7, get outbox of mailbox.                 *
  ******************************************************************************/
-void xtask_cs_check_rd_blocked_tasks(struct vchan *vc, struct cs_data *csdata)
+unsigned int xtask_man_get_outbox(struct cs_data *    csdata,
+                                  struct cs_kernel *  k,
+                                  struct chan_event * evt)
 {
-  unsigned int buf;
-  
-  // check which buffer the CS has written to  
-  if (vc->state & CS_RD_BUF0) {
-    buf = 0;
-  } else if (vc->state & CS_RD_BUF1) {
-    buf = 1;
+  /* 
+     The task requests to get the outbox.
+     p0 = mailbox id
+  */
+  struct mailbox *reg;
+  reg = xtask_get_mailbox(csdata,((struct man_msg*)evt->data)->p0);
+  if (reg != NULL) {
+    ((struct man_msg*)evt->data)->p0 = (unsigned int) &reg->outbox;
+  } else {
+    ((struct man_msg*)evt->data)->p0 = 0;
   }
-
-  if ((vc->read_bufs[buf].buf_size - vc->read_bufs[buf].data_size) < vc->obj_size) {
-    // buffer is full
     
-    if (buf == 0) {
-      // indicate that buffer 0 is full and not in use by CS
-      vc->state &= ~(CS_RD_BUF0);
-      vc->state |= RD_BUF0_FILLED;
-      
-      // check if order flag has to be set
-      if (vc->state & RD_BUF1_FILLED) {
-        vc->state |= RD_BUF1_FIRST;
+  return REPLY;
+}
+
+/******************************************************************************
+ * Function:     xtask_man_send_outbox                                        *
+ * Parameters:   csdata  - Pointer to cs_data structure.                      *
+ *               k       - Kernel from which the request originates.          *
+ *               evt     - Pointer to chan_event structure.                   *
+ * Return:       whether CS should send a reply back to the kernel            *
+ *                                                                            *
+ *               Management request 8, send outbox to recipient.              *
+ ******************************************************************************/
+unsigned int xtask_man_send_outbox(struct cs_data *    csdata,
+                                   struct cs_kernel *  k,
+                                   struct chan_event * evt)
+{
+  /* 
+     The task requests to send his outbox
+     to a recipient.
+     p0 = sender mailbox id
+     p1 = recipient mailbox id
+     p2 = CS id of recipient, 0 when unknown
+  */
+  unsigned int receiver;
+  unsigned int sender;
+  unsigned int cs_id;
+  struct mailbox *recv_mb;
+  struct mailbox *send_mb;
+  receiver = ((struct man_msg*)evt->data)->p1;
+  sender = ((struct man_msg*)evt->data)->p0;
+
+  // CS of recipient, given by the task or from the mailbox directory
+  cs_id = ((struct man_msg*)evt->data)->p2;
+
+  if (cs_id == 0) {
+    cs_id = xtask_mb_loc_get(csdata, receiver);
+  }
+
+  recv_mb = xtask_get_mailbox(csdata, receiver);    
+  send_mb = xtask_get_mailbox(csdata, sender);    
+
+  // check if receiver is on the same tile
+  if (recv_mb != NULL) {
+    // recipient is on the same tile, makes things easier :)
+    if (send_mb->outbox.data_size > recv_mb->inbox.buf_size) {
+      struct p_kreply *kr;
+
+      // message does not fit in the inbox or the queue of the recipient
+      kr = xtask_get_free_kreply(csdata, send_mb->kernel);
+
+      if (kr != NULL) {
+        kr->reply.cmd = 0x04;
+        kr->reply.p0 = send_mb->tid;
+        kr->reply.p1 = 1; // delivery failed
+        
+        xtask_notify_kernel(send_mb->kernel);
       }
-    } else if (buf == 1) {
-      // indicate that buffer 1 is full and not in use by CS
-      vc->state &= ~(CS_RD_BUF1);
-      vc->state |= RD_BUF1_FILLED;
+    } else if (recv_mb->inbox_state & INBOX_TASK_WAITING) {
+      // recipient is blocked waiting for a message
+      
+      struct p_kreply *kr;
       
-      // check if order flag has to be set
-      if (vc->state & RD_BUF0_FILLED) {
-        vc->state |= RD_BUF0_FIRST;
+      // deliver sender outbox to recipient inbox
+      xtask_mb_move(&recv_mb->inbox, &send_mb->outbox);
+
+      recv_mb->inbox_state &= ~(INBOX_TASK_WAITING); // not waiting anymore soon
+              
+      kr = xtask_get_free_kreply(csdata, recv_mb->kernel);
+
+      // add a new pending kernel reply for the recipient task to unblock it
+      // and notify the kernel
+      if (kr != NULL) {
+        kr->reply.cmd = 0x03;
+        kr->reply.p0 = recv_mb->tid;
+        kr->reply.p1 = (unsigned int) &recv_mb->inbox;   
+        
+        xtask_notify_kernel(recv_mb->kernel);
       }
-    }
-  }
-    
-  if (vc->state & TASK_RD_BLOCK) {
-    // a task is blocked on a read operation
-    
-    if ((vc->min_read_size > 0 && vc->read_bufs[buf].data_size >= vc->min_read_size) || 
-         vc->read_bufs[buf].data_size == vc->read_bufs[buf].buf_size) {
-      // we can unblock the task because either the buffer is completely filled
-      // or there is enough data in the buffer to meet the minimum data amount for the read operaton
 
-      struct man_msg msg;
-      struct p_kreply *kr;
-      msg.cmd = 1;
-      msg.p0 = vc->handle; // return
+      kr = xtask_get_free_kreply(csdata, send_mb->kernel);
+
+      // add a new pending kernel reply for the sending task
+      // and notify the kernel
+      if (kr != NULL) {
+        kr->reply.cmd = 0x04;
+        kr->reply.p0 = send_mb->tid;
+        kr->reply.p1 = 0; /* return value.. delivery failed or not... */
+        
+        xtask_notify_kernel(send_mb->kernel);
+      }
       
-      if (buf == 0) {
-        vc->state &= ~(CS_RD_BUF0);     // clear flag that CS uses buffer 0
-        vc->state &= ~(RD_BUF0_FILLED); // clear flag that buf 0 is filled
-        vc->state &= ~(TASK_RD_BLOCK);  // clear flag that task is blocked on read operation
-        vc->state |= TASK_RD_BUF0;      // set flag that task has buf 0
-        msg.p1 = (unsigned int)&vc->read_bufs[0]; // return buffer 0 to kernel
-      } else if (buf == 1) {
-        vc->state &= ~(CS_RD_BUF1);     // clear flag that CS uses buffer 1
-        vc->state &= ~(RD_BUF1_FILLED); // clear flag that buf 1 is filled
-        vc->state &= ~(TASK_RD_BLOCK);  // clear flag that task is blocked on read operation
-        vc->state |= TASK_RD_BUF1;      // set flag that task has buf 1
-        msg.p1 = (unsigned int)&vc->read_bufs[1]; // return buffer 1 to kernel
+    } else if (xtask_mb_queue_put(recv_mb, &send_mb->outbox)) {
+      struct p_kreply *kr;
 
+      // recipient is busy but the message is queued,
+      // sender does not have to wait for the recipient
+      kr = xtask_get_free_kreply(csdata, send_mb->kernel);
+
+      if (kr != NULL) {
+        kr->reply.cmd = 0x04;
+        kr->reply.p0 = send_mb->tid;
+        kr->reply.p1 = 0; // delivered
+        
+        xtask_notify_kernel(send_mb->kernel);
       }
+
+    } else {
+      struct mailbox **rpp;
+      // recipient task is not ready to receive and its queue is full
+      // add sender to pending outboxes
+
+      // save recipient mailbox id
+      send_mb->outbox_dest = recv_mb->id;
+
+      // add sender to list of pending outboxes
+      rpp = &csdata->p_outbox;
       
-      kr = xtask_get_free_kreply(csdata);
-          
+      while (*rpp != NULL) {
+        rpp = &(*rpp)->p_next;
+      }
+
+      send_mb->p_next = *rpp;
+      *rpp = send_mb;  
+
+      // indicate at the recipient inbox that a sender is pending
+      recv_mb->inbox_state |= INBOX_SENDER_PEND;
+    }
+  } else if (cs_id != 0 && cs_id < csdata->nr_routes && csdata->route[cs_id] < csdata->nr_links &&
+             8 + send_mb->outbox.data_size <= RING_PAYLOAD_SIZE) {
+    // recipient is on the given or a known tile, route the message to its CS
+    send_mb->outbox_dest = receiver;
+    send_mb->outbox_cs   = cs_id;
+
+    if (!xtask_mb_route_send(csdata, send_mb)) {
+      struct p_kreply *kr;
+
+      // no route or message too large
+      send_mb->outbox_cs = 0;
+      kr = xtask_get_free_kreply(csdata, send_mb->kernel);
+
       if (kr != NULL) {
-        // add pending kernel reply and notify kernel
-        kr->state |= KR_USED;
-        kr->k = vc->kernel;
-        kr->reply.cmd = msg.cmd;
-        kr->reply.p0 = msg.p0;
-        kr->reply.p1 = msg.p1;
+        kr->reply.cmd = 0x04;
+        kr->reply.p0 = send_mb->tid;
+        kr->reply.p1 = 1; // delivery failed
         
-        _xtask_notify_kernel(vc->kernel->c_async);
+        xtask_notify_kernel(send_mb->kernel);
       }
     }
+  } else {
+    // recipient is not on this tile, maybe on another tile
+    // use the ring bus to inform other communication servers
+    // if we don't have a ring bus, add a pending kernel reply with error
+    
+    if (!csdata->ring) {
+      struct p_kreply *kr;
+      kr = xtask_get_free_kreply(csdata, send_mb->kernel);
+
+      // add a new pending kernel reply for the sending task
+      // and notify the kernel
+      if (kr != NULL) {
+        kr->reply.cmd = 0x04;
+        kr->reply.p0 = send_mb->tid;
+        kr->reply.p1 = 1; /* return value.. delivery failed or not... */
+        
+        xtask_notify_kernel(send_mb->kernel);
+      }
+    } else {
+      send_mb->outbox_dest = receiver;
+      xtask_ring_send_outbox(csdata, send_mb);
+    }        
   }
-}
 
+  return NO_REPLY;
+}
 
 /******************************************************************************
- * Function:     xtask_process_ring_msg                                       *
- * Parameters:   csdata  - Pointer to cs_data structure                       *
- * Return:       void                                                         *
+ * Function:     xtask_man_get_inbox                                          *
+ * Parameters:   csdata  - Pointer to cs_data structure.                      *
+ *               k       - Kernel from which the request originates.          *
+ *               evt     - Pointer to chan_event structure.                   *
+ * Return:       whether CS should send a reply back to the kernel            *
  *                                                                            *
- *               Process a message received from the ring bus. This can be    *
- *               a message initiated by another CS or a message initiated     *
- *               by this CS that has been passed to all CS and is now         *
- *               returning.                                                   *
- *                                                                            * 
- *               This function should be divided in subfunctions to           *
- *               increase readability.                                        * 
+ *               Management request 9, read inbox of mailbox.                 *
  ******************************************************************************/
-void xtask_process_ring_msg (struct cs_data *csdata)
+unsigned int xtask_man_get_inbox(struct cs_data *    csdata,
+                                 struct cs_kernel *  k,
+                                 struct chan_event * evt)
 {
-  unsigned int *up;
-
-  up = csdata->rbuf->payload;
-  //printf("CH[%u] ring packet: cs_id: %u msg_type: %u status: %u  payload_size: %u\n", 
-  //csdata->id, csdata->rbuf->cs_id, csdata->rbuf->msg_type, csdata->rbuf->status, csdata->rbuf->payload_size);
-  //printf("CH[%u] ring rec: %u\n", csdata->id, *up);
+  /*
+     Task requests to read his inbox
+     p0 = mailbox id
+     p1 = location (local tile, anywhere)
+  */
+  struct mailbox *reg;
+  struct mailbox **rpp;
+  unsigned int *pl;
+
+  reg = xtask_get_mailbox(csdata,((struct man_msg*)evt->data)->p0);
   
-  if (csdata->rbuf->cs_id == csdata->id) {
-    // received own initiated message
+  if (reg != NULL) {
+    reg->inbox_state |= INBOX_TASK_WAITING;      
+  } else {
+    // mailbox not found
+  }
+
+  if (reg->q_count > 0) {
+    struct p_kreply *kr;
+
+    // a message is queued, the task does not have to wait
+    reg->inbox_state &= ~(INBOX_TASK_WAITING);
+    xtask_mb_queue_get(reg);
+
+    kr = xtask_get_free_kreply(csdata, reg->kernel);
+
+    if (kr != NULL) {
+      kr->reply.cmd = 0x03;
+      kr->reply.p0 = reg->tid;
+      kr->reply.p1 = (unsigned int) &reg->inbox;
+
+      xtask_notify_kernel(reg->kernel);
+    }
+  }
+
+  if (reg->inbox_state & INBOX_SENDER_PEND) {
+    // someone tried to send a message but
+    // the task was not ready
     
-    if (csdata->rbuf->msg_type == 0x01) {
-      // used to test ring bus connectivity
-      // expects payload with the CS id's of each CS in the ring bus
-      int i;
-      unsigned int *up = csdata->rbuf->payload;
-      for (i=0; i < csdata->rbuf->payload_size; i+=4) {
-        //printf("CH[%u] Found CH: %u\n",csdata->id, *up);
-        up++;
-      }
-    } else if (csdata->rbuf->msg_type == 0x02) {
-        // Ring bus reply from creating a new hardware thread
-        struct p_request *pr;
-        struct vchan *vc;
-        unsigned int *pl = (unsigned int *)csdata->rbuf->payload;
-        struct p_kreply *kr;
+    reg->inbox_state &= ~(INBOX_SENDER_PEND);
+
+    rpp = &csdata->p_outbox;      
+
+    /* check for local pending sender(s) */
+    while (*rpp != NULL) {
+      if ((*rpp)->outbox_dest == reg->id) {
+        // found pending sender
+        if (reg->inbox_state & INBOX_TASK_WAITING) {
+          struct p_kreply *kr;    
         
-        // the pending ring bus reply is in front of the list because we always receive
-        // replies in order. We gain access again to the previously allocated virtual
-        // channel structure and complete the initialisation.
-        vc = (struct vchan *) csdata->p_reqs->data;
+          reg->inbox_state &= ~(INBOX_TASK_WAITING);
+          
+          // deliver sender outbox to recipient inbox
+          xtask_mb_move(&reg->inbox, &(*rpp)->outbox);
+
+          kr = xtask_get_free_kreply(csdata, reg->kernel);
+
+          if (kr != NULL) {
+            // add pending kernel reply to unblock recipient task
+            kr->reply.cmd = 0x03;
+            kr->reply.p0 = reg->tid;
+            kr->reply.p1 = (unsigned int) &reg->inbox;
+      
+            // notify kernel for the pending reply
+            xtask_notify_kernel(reg->kernel);
+          }
+
+          kr = xtask_get_free_kreply(csdata, (*rpp)->kernel);
+
+          if (kr != NULL) {
+            // add pending kernel reply to unblock sending task
+            kr->reply.cmd = 0x04;
+            kr->reply.p0 = (*rpp)->tid;
+            kr->reply.p1 = 1;  // return value.. delivery failed or not... 
+            
+            // notify kernel for the pending reply
+            xtask_notify_kernel((*rpp)->kernel);
+          }
+
+          // remove mailbox from pending outboxes list
+          *rpp = (*rpp)->p_next;
+          
+          // don't set the pointer-pointer to the next element!
+      
+        } else if (xtask_mb_queue_put(reg, &(*rpp)->outbox)) {
+          struct p_kreply *kr;
+
+          // the queue has room again, queue message of pending sender
+          kr = xtask_get_free_kreply(csdata, (*rpp)->kernel);
+
+          if (kr != NULL) {
+            kr->reply.cmd = 0x04;
+            kr->reply.p0 = (*rpp)->tid;
+            kr->reply.p1 = 0; // delivered
+
+            xtask_notify_kernel((*rpp)->kernel);
+          }
+
+          *rpp = (*rpp)->p_next;
+        } else {
+          // found more than one pending senders
+          reg->inbox_state |= INBOX_SENDER_PEND;
+          rpp = &(*rpp)->p_next;
+        }
+      } else {
+        rpp = &(*rpp)->p_next;
+      }
+
+    } /* end check for local pending senders */
+
+    if (((struct man_msg*)evt->data)->p1 == ALL_TILES && csdata->ring) {
+      /* notify CS on other tiles that this task was/is ready to receive */
+      struct ring_buf *rb = xtask_ring_alloc(csdata);
+
+      rb->cs_id        = csdata->id;
+      rb->msg_type     = 0x04;
+      rb->status       = 0x00;
+      rb->req_id       = 0;
+      rb->payload_size = 0x04;
+      pl = rb->payload;
+      *pl = reg->id;
+  
+      xtask_ring_send(csdata, rb); // send ring bus message
+      // don't need to add to pending ring bus reply list
+      // because no action is taken when reply from ring bus
+    }
+  }
+
+  if (reg->inbox_state & INBOX_TASK_WAITING) {
+    struct p_remote **ppr = &csdata->p_remote;
+
+    // tell CS with routed senders for this mailbox that the task is ready
+    while (*ppr != NULL) {
+      if ((*ppr)->mb_id == reg->id) {
+        struct p_remote *rs = *ppr;
+
+        csdata->rbuf->cs_id        = csdata->id;
+        csdata->rbuf->msg_type     = 0x04;
+        csdata->rbuf->status       = 0x00;
+        csdata->rbuf->payload_size = 0x04;
+        pl = csdata->rbuf->payload;
+        *pl = reg->id;
+        xtask_link_send(csdata, rs->cs_id);
+
+        *ppr = rs->next;
+        free(rs);
+      } else {
+        ppr = &(*ppr)->next;
+      }
+    }
+  }
+
+  return NO_REPLY;
+}
+
+/******************************************************************************
+ * Function:     xtask_man_get_kreply                                         *
+ * Parameters:   csdata  - Pointer to cs_data structure.                      *
+ *               k       - Kernel from which the request originates.          *
+ *               evt     - Pointer to chan_event structure.                   *
+ * Return:       whether CS should send a reply back to the kernel            *
+ *                                                                            *
+ *               Management request 10, get pending kernel reply. The kernel  *
+ *               repeats the request until the reply has cmd 0, then the      *
+ *               queue is drained and the next reply notifies the kernel.     *
+ ******************************************************************************/
+unsigned int xtask_man_get_kreply(struct cs_data *    csdata,
+                                  struct cs_kernel *  k,
+                                  struct chan_event * evt)
+{
+  /*
+     Kernel has received a notification from CS
+     and now wants to receive the pending reply.
+  */   
+
+  struct p_kreply *kr;    
+
+  kr = xtask_get_kreply(csdata, k); // oldest pending reply of this kernel
+
+  // skip replies cancelled while they were queued
+  while (kr != NULL && kr->reply.cmd == 0) {
+    xtask_free_kreply(csdata, kr);
+    kr = xtask_get_kreply(csdata, k);
+  }
+
+  // check if a pending kernel reply has been found 
+  if (kr != NULL) {
+
+    // copy kernel reply data
+    ((struct man_msg*)evt->data)->cmd = kr->reply.cmd;
+    ((struct man_msg*)evt->data)->p0 = kr->reply.p0;
+    ((struct man_msg*)evt->data)->p1 = kr->reply.p1;
+    ((struct man_msg*)evt->data)->p2 = kr->reply.p2;
+    ((struct man_msg*)evt->data)->p3 = kr->reply.p3;
+    ((struct man_msg*)evt->data)->p4 = kr->reply.p4;
+    ((struct man_msg*)evt->data)->p5 = kr->reply.p5;
+    xtask_free_kreply(csdata, kr);
+  } else {
+    // queue drained, the next reply needs a new notification
+    ((struct man_msg*)evt->data)->cmd = 0;
+    k->kr_notified = 0;
+  }
+  
+  return REPLY;
+}
+
+/******************************************************************************
+ * Function:     xtask_man_register_ev_group                                  *
+ * Parameters:   csdata  - Pointer to cs_data structure.                      *
+ *               k       - Kernel from which the request originates.          *
+ *               evt     - Pointer to chan_event structure.                   *
+ * Return:       whether CS should send a reply back to the kernel            *
+ *                                                                            *
+ *               Management request 11, register event flag group.            *
+ ******************************************************************************/
+unsigned int xtask_man_register_ev_group(struct cs_data *    csdata,
+                                         struct cs_kernel *  k,
+                                         struct chan_event * evt)
+{
+  /*
+     Kernel registers an event flag group.
+     p0 = group id
+     p1 = group handle at kernel
+  */
+  struct ev_group *eg;
+
+  if (xtask_get_ev_group(csdata, ((struct man_msg*)evt->data)->p0) != NULL) {
+    ((struct man_msg*)evt->data)->p0 = 1; // id already in use
+    return REPLY;
+  }
+
+  eg         = malloc(sizeof(struct ev_group));
+
+  if (eg == NULL) {
+    ((struct man_msg*)evt->data)->p0 = 1; // out of memory
+    return REPLY;
+  }
+
+  eg->id     = ((struct man_msg*)evt->data)->p0;
+  eg->handle = ((struct man_msg*)evt->data)->p1;
+  eg->kernel = k;
+
+  // add to the front of list with event flag groups
+  eg->next = csdata->ev_groups;
+  csdata->ev_groups = eg;
+
+  ((struct man_msg*)evt->data)->p0 = 0;
+
+  return REPLY;
+}
+
+/******************************************************************************
+ * Function:     xtask_man_set_ev_flags                                       *
+ * Parameters:   csdata  - Pointer to cs_data structure.                      *
+ *               k       - Kernel from which the request originates.          *
+ *               evt     - Pointer to chan_event structure.                   *
+ * Return:       whether CS should send a reply back to the kernel            *
+ *                                                                            *
+ *               Management request 12, set flags of event flag group by id.  *
+ ******************************************************************************/
+unsigned int xtask_man_set_ev_flags(struct cs_data *    csdata,
+                                    struct cs_kernel *  k,
+                                    struct chan_event * evt)
+{
+  /*
+     Task sets the flags of an event flag group by id.
+     The group may belong to any kernel on this tile.
+     p0 = group id
+     p1 = flags
+  */
+  struct ev_group *eg;
+  struct p_kreply *kr;
+
+  eg = xtask_get_ev_group(csdata, ((struct man_msg*)evt->data)->p0);
+  kr = (eg != NULL) ? xtask_get_free_kreply(csdata, eg->kernel) : NULL;
+
+  if (kr == NULL) {
+    ((struct man_msg*)evt->data)->p0 = 1; // unknown group or no free kernel reply
+    return REPLY;
+  }
+
+  // add a new pending kernel reply for the owning kernel
+  // and notify the kernel
+  kr->reply.cmd = 0x05;
+  kr->reply.p0 = eg->handle;
+  kr->reply.p1 = ((struct man_msg*)evt->data)->p1;
+        
+  xtask_notify_kernel(eg->kernel);
+
+  ((struct man_msg*)evt->data)->p0 = 0;
+
+  return REPLY;
+}
+
+/******************************************************************************
+ * Function:     xtask_man_unregister_ev_group                                *
+ * Parameters:   csdata  - Pointer to cs_data structure.                      *
+ *               k       - Kernel from which the request originates.          *
+ *               evt     - Pointer to chan_event structure.                   *
+ * Return:       whether CS should send a reply back to the kernel            *
+ *                                                                            *
+ *               Management request 21, remove event flag group.              *
+ ******************************************************************************/
+unsigned int xtask_man_unregister_ev_group(struct cs_data *    csdata,
+                                           struct cs_kernel *  k,
+                                           struct chan_event * evt)
+{
+  /*
+     Kernel removes one of its event flag groups.
+     Flags that were set by id but not yet delivered
+     are dropped, replies with cmd 0 are skipped.
+     p0 = group id
+  */
+  struct ev_group **egp = &csdata->ev_groups;
+  struct ev_group *eg;
+  struct p_kreply *kr;
+
+  while (*egp != NULL && (*egp)->id != ((struct man_msg*)evt->data)->p0) {
+    egp = &(*egp)->next;
+  }
+
+  if (*egp == NULL || (*egp)->kernel != k) {
+    ((struct man_msg*)evt->data)->p0 = 1; // unknown group or not owned by kernel
+    return REPLY;
+  }
+
+  eg = *egp;
+  *egp = eg->next;
+
+  for (kr = k->kr_head; kr != NULL; kr = kr->next) {
+    if (kr->reply.cmd == 0x05 && kr->reply.p0 == eg->handle) {
+      kr->reply.cmd = 0;
+    }
+  }
+
+  free(eg);
+
+  ((struct man_msg*)evt->data)->p0 = 0;
+
+  return REPLY;
+}
+
+/******************************************************************************
+ * Function:     xtask_man_get_lock                                           *
+ * Parameters:   csdata  - Pointer to cs_data structure.                      *
+ *               k       - Kernel from which the request originates.          *
+ *               evt     - Pointer to chan_event structure.                   *
+ * Return:       whether CS should send a reply back to the kernel            *
+ *                                                                            *
+ *               Management request 13, get hardware lock for shared object.  *
+ ******************************************************************************/
+unsigned int xtask_man_get_lock(struct cs_data *    csdata,
+                                struct cs_kernel *  k,
+                                struct chan_event * evt)
+{
+  /*
+     Kernel requests a hardware lock for a shared object.
+     When all locks of the tile are allocated the
+     existing locks are shared by several objects.
+  */
+  unsigned int lock = 0;
+
+  if (csdata->nr_locks < NR_HW_LOCKS) {
+    __asm__ volatile ("getr %0, 5":"=r"(lock));
+  }
+
+  if (lock != 0) {
+    csdata->locks[csdata->nr_locks++] = lock;
+  } else if (csdata->nr_locks > 0) {
+    lock = csdata->locks[csdata->next_lock++ % csdata->nr_locks];
+  }
+
+  ((struct man_msg*)evt->data)->p0 = lock; // 0 if no lock at all
+
+  return REPLY;
+}
+
+/******************************************************************************
+ * Function:     xtask_man_identify                                           *
+ * Parameters:   csdata  - Pointer to cs_data structure.                      *
+ *               k       - Kernel from which the request originates.          *
+ *               evt     - Pointer to chan_event structure.                   *
+ * Return:       whether CS should send a reply back to the kernel            *
+ *                                                                            *
+ *               Management request 14, get handle of requesting kernel.      *
+ ******************************************************************************/
+unsigned int xtask_man_identify(struct cs_data *    csdata,
+                                struct cs_kernel *  k,
+                                struct chan_event * evt)
+{
+  /*
+     Kernel requests its handle at this CS,
+     used to wake tasks blocked on shared objects.
+  */
+  ((struct man_msg*)evt->data)->p0 = (unsigned int) k; // the event environment
+
+  return REPLY;
+}
+
+/******************************************************************************
+ * Function:     xtask_man_wake_kernel                                        *
+ * Parameters:   csdata  - Pointer to cs_data structure.                      *
+ *               k       - Kernel from which the request originates.          *
+ *               evt     - Pointer to chan_event structure.                   *
+ * Return:       whether CS should send a reply back to the kernel            *
+ *                                                                            *
+ *               Management request 15, wake kernel for shared object waiter. *
+ ******************************************************************************/
+unsigned int xtask_man_wake_kernel(struct cs_data *    csdata,
+                                   struct cs_kernel *  k,
+                                   struct chan_event * evt)
+{
+  /*
+     Task released a shared object for which
+     a task on another kernel waits.
+     p0 = handle of kernel to wake
+  */
+  struct cs_kernel *dest = (struct cs_kernel *) ((struct man_msg*)evt->data)->p0;
+  struct p_kreply *kr;
+
+  kr = xtask_get_free_kreply(csdata, dest);
+
+  // add a new pending kernel reply and notify the kernel,
+  // if none is free the kernel finds the waiter on its next tick
+  if (kr != NULL) {
+    kr->reply.cmd = 0x06;
+        
+    xtask_notify_kernel(dest);
+  }
+
+  return NO_REPLY; // the kernel does not expect a reply
+}
+
+/******************************************************************************
+ * Function:     xtask_man_send_outbox_multi                                  *
+ * Parameters:   csdata  - Pointer to cs_data structure.                      *
+ *               k       - Kernel from which the request originates.          *
+ *               evt     - Pointer to chan_event structure.                   *
+ * Return:       whether CS should send a reply back to the kernel            *
+ *                                                                            *
+ *               Management request 16, send outbox to a set of recipients.   *
+ *               Local recipients get the message in this pass. The ids that  *
+ *               are not found here go around the ring bus in one message     *
+ *               (type 0x05) and each CS delivers to its own recipients.      *
+ ******************************************************************************/
+unsigned int xtask_man_send_outbox_multi(struct cs_data *    csdata,
+                                         struct cs_kernel *  k,
+                                         struct chan_event * evt)
+{
+  /* 
+     p0 = sender mailbox id
+     p1 = pointer to array with recipient mailbox ids
+     p2 = number of recipients
+     p3 = calling task id
+  */
+  unsigned int *ids = (unsigned int *)((struct man_msg*)evt->data)->p1;
+  unsigned int nr   = ((struct man_msg*)evt->data)->p2;
+  unsigned int tid  = ((struct man_msg*)evt->data)->p3;
+  unsigned int failed = 0;
+  unsigned int remote = 0;
+  unsigned int *pl = NULL;
+  struct mailbox *send_mb;
+  struct mailbox *recv_mb;
+  struct ring_buf *rb = NULL;
+  struct p_kreply *kr;
+  int i;
+
+  send_mb = xtask_get_mailbox(csdata, ((struct man_msg*)evt->data)->p0);
+
+  if (send_mb == NULL) {
+    failed = nr;
+    nr = 0;
+  }
+
+  // offer message to local recipients, collect the others for the ring bus
+  if (csdata->ring) {
+    rb = xtask_ring_alloc(csdata);
+    pl = (unsigned int *)rb->payload + 2;
+  }
+
+  for (i = 0; i < nr; i++) {
+    recv_mb = xtask_get_mailbox(csdata, ids[i]);
+
+    if (recv_mb != NULL) {
+      if (!xtask_mb_offer(csdata, recv_mb, send_mb->outbox.data, send_mb->outbox.data_size)) {
+        failed++; // recipient busy
+      }
+    } else if (rb != NULL && 8 + (remote + 1) * 4 <= RING_PAYLOAD_SIZE) {
+      pl[remote++] = ids[i];
+    } else {
+      failed++; // no ring bus or does not fit in ring bus message
+    }
+  }
+
+  if (remote > 0 && 8 + remote * 4 + send_mb->outbox.data_size <= RING_PAYLOAD_SIZE) {
+    struct p_request *pr;
+
+    // the sender is unblocked when the message returns
+    pr = xtask_get_free_p_request(csdata);
+    pr->kernel   = k;
+    pr->tid      = tid;
+    pr->msg_type = 0x05;
+    pr->data     = (void *)send_mb;
+
+    // payload: number of ids, number delivered, ids, message
+    pl = rb->payload;
+    pl[0] = remote;
+    pl[1] = 0;
+    memcpy(&pl[2 + remote], send_mb->outbox.data, send_mb->outbox.data_size);
+
+    rb->cs_id        = csdata->id;
+    rb->msg_type     = 0x05;
+    rb->status       = failed; // local failures, returned with the message
+    rb->req_id       = pr->req_id;
+    rb->payload_size = 8 + remote * 4 + send_mb->outbox.data_size;
+
+    xtask_ring_send(csdata, rb);
+
+    return NO_REPLY;
+  }
+
+  // message too large for the ring bus, remote recipients fail
+  if (rb != NULL) {
+    xtask_ring_free(csdata, rb);
+  }
+
+  failed += remote;
+
+  kr = xtask_get_free_kreply(csdata, k);
+
+  if (kr != NULL) {
+    kr->reply.cmd = 0x04;
+    kr->reply.p0 = tid;
+    kr->reply.p1 = failed;
+
+    xtask_notify_kernel(k);
+  }
+
+  return NO_REPLY;
+}
+
+/******************************************************************************
+ * Function:     xtask_man_subscribe                                          *
+ * Parameters:   csdata  - Pointer to cs_data structure.                      *
+ *               k       - Kernel from which the request originates.          *
+ *               evt     - Pointer to chan_event structure.                   *
+ * Return:       whether CS should send a reply back to the kernel            *
+ *                                                                            *
+ *               Management request 17, add or remove topic subscription.     *
+ ******************************************************************************/
+unsigned int xtask_man_subscribe(struct cs_data *    csdata,
+                                 struct cs_kernel *  k,
+                                 struct chan_event * evt)
+{
+  /*
+     p0 = topic id
+     p1 = mailbox id
+     p2 = SUB_ADD or SUB_REMOVE
+  */
+  unsigned int topic = ((struct man_msg*)evt->data)->p0;
+  struct mailbox *mb = xtask_get_mailbox(csdata, ((struct man_msg*)evt->data)->p1);
+  struct subscription **spp;
+  struct subscription *sub;
+
+  ((struct man_msg*)evt->data)->p0 = 1; // unknown mailbox or subscription
+
+  if (mb == NULL) {
+    return REPLY;
+  }
+
+  for (spp = &csdata->subs; *spp != NULL; spp = &(*spp)->next) {
+    if ((*spp)->topic == topic && (*spp)->mb == mb) {
+      break;
+    }
+  }
+
+  if (((struct man_msg*)evt->data)->p2 == SUB_REMOVE) {
+    if (*spp != NULL) {
+      sub = *spp;
+      *spp = sub->next;
+      free(sub);
+      ((struct man_msg*)evt->data)->p0 = 0;
+    }
+    return REPLY;
+  }
+
+  if (*spp == NULL) {
+    // add to the front of the list with subscriptions
+    sub = malloc(sizeof(struct subscription));
+    sub->topic = topic;
+    sub->mb    = mb;
+    sub->next  = csdata->subs;
+    csdata->subs = sub;
+  }
+
+  ((struct man_msg*)evt->data)->p0 = 0;
+  return REPLY;
+}
+
+/******************************************************************************
+ * Function:     xtask_man_publish                                            *
+ * Parameters:   csdata  - Pointer to cs_data structure.                      *
+ *               k       - Kernel from which the request originates.          *
+ *               evt     - Pointer to chan_event structure.                   *
+ * Return:       whether CS should send a reply back to the kernel            *
+ *                                                                            *
+ *               Management request 18, send outbox to subscribers of topic.  *
+ *               Local subscribers get the message in this pass, then the     *
+ *               message goes around the ring bus once (type 0x06) and each   *
+ *               CS delivers to its own subscribers.                          *
+ ******************************************************************************/
+unsigned int xtask_man_publish(struct cs_data *    csdata,
+                               struct cs_kernel *  k,
+                               struct chan_event * evt)
+{
+  /* 
+     p0 = topic id
+     p1 = sender mailbox id
+     p2 = calling task id
+  */
+  unsigned int topic = ((struct man_msg*)evt->data)->p0;
+  unsigned int tid   = ((struct man_msg*)evt->data)->p2;
+  unsigned int failed = 0;
+  unsigned int *pl;
+  struct mailbox *send_mb;
+  struct p_kreply *kr;
+
+  send_mb = xtask_get_mailbox(csdata, ((struct man_msg*)evt->data)->p1);
+
+  if (send_mb != NULL) {
+    failed = xtask_topic_deliver(csdata, topic, send_mb->outbox.data, 
+                                 send_mb->outbox.data_size);
+
+    if (csdata->ring && 8 + send_mb->outbox.data_size <= RING_PAYLOAD_SIZE) {
+      struct p_request *pr;
+      struct ring_buf *rb = xtask_ring_alloc(csdata);
+
+      // the sender is unblocked when the message returns
+      pr = xtask_get_free_p_request(csdata);
+      pr->kernel   = k;
+      pr->tid      = tid;
+      pr->msg_type = 0x06;
+      pr->data     = (void *)send_mb;
+
+      // payload: topic id, number of failed deliveries, message
+      pl = rb->payload;
+      pl[0] = topic;
+      pl[1] = failed;
+      memcpy(&pl[2], send_mb->outbox.data, send_mb->outbox.data_size);
+
+      rb->cs_id        = csdata->id;
+      rb->msg_type     = 0x06;
+      rb->status       = 0;
+      rb->req_id       = pr->req_id;
+      rb->payload_size = 8 + send_mb->outbox.data_size;
+
+      xtask_ring_send(csdata, rb);
+
+      return NO_REPLY;
+    }
+  }
+
+  // only local subscribers
+  kr = xtask_get_free_kreply(csdata, k);
+
+  if (kr != NULL) {
+    kr->reply.cmd = 0x04;
+    kr->reply.p0 = tid;
+    kr->reply.p1 = failed;
+
+    xtask_notify_kernel(k);
+  }
+
+  return NO_REPLY;
+}
+
+
+/******************************************************************************
+ * Function:     xtask_man_register_thread_code                               *
+ * Parameters:   csdata  - Pointer to cs_data structure.                      *
+ *               k       - Kernel from which the request originates.          *
+ *               evt     - Pointer to chan_event structure.                   *
+ * Return:       whether CS should send a reply back to the kernel            *
+ *                                                                            *
+ *               Management request 19, register hardware thread entry point  *
+ *               so that tasks on other tiles can start it by its code.       *
+ ******************************************************************************/
+unsigned int xtask_man_register_thread_code(struct cs_data *    csdata,
+                                            struct cs_kernel *  k,
+                                            struct chan_event * evt)
+{
+  /*
+     p0 = code
+     p1 = entry point
+  */
+  unsigned int code = ((struct man_msg*)evt->data)->p0;
+  struct hwt_entry *hc;
+
+  if (code > HWT_CODE_MASK || xtask_get_hwt_code(csdata, code) != NULL) {
+    ((struct man_msg*)evt->data)->p0 = 1; // invalid or already registered
+    return REPLY;
+  }
+
+  hc = malloc(sizeof(struct hwt_entry));
+  hc->code = code;
+  hc->pc   = (void *)((struct man_msg*)evt->data)->p1;
+  hc->next = csdata->hwt_codes;
+  csdata->hwt_codes = hc;
+
+  ((struct man_msg*)evt->data)->p0 = 0;
+  return REPLY;
+}
+
+/******************************************************************************
+ * Function:     xtask_man_join_thread                                        *
+ * Parameters:   csdata  - Pointer to cs_data structure.                      *
+ *               k       - Kernel from which the request originates.          *
+ *               evt     - Pointer to chan_event structure.                   *
+ * Return:       whether CS should send a reply back to the kernel            *
+ *                                                                            *
+ *               Management request 20, wait until hardware thread exits.     *
+ ******************************************************************************/
+unsigned int xtask_man_join_thread(struct cs_data *    csdata,
+                                   struct cs_kernel *  k,
+                                   struct chan_event * evt)
+{
+  /*
+     p0 = task id
+     p1 = handle
+  */
+  struct vchan *vc = xtask_get_vchan(csdata, ((struct man_msg*)evt->data)->p1);
+  struct p_kreply *kr;
+
+  if (vc == NULL || (vc->state & VC_JOIN_WAIT)) {
+    // unknown handle or another task waits already
+    kr = xtask_get_free_kreply(csdata, k);
+
+    if (kr != NULL) {
+      kr->reply.cmd = 0x04;
+      kr->reply.p0  = ((struct man_msg*)evt->data)->p0;
+      kr->reply.p1  = 1; // return value, failure
+      kr->reply.p2  = 0;
+        
+      xtask_notify_kernel(k);
+    }
+
+    return NO_REPLY;
+  }
+
+  vc->join_tid    = ((struct man_msg*)evt->data)->p0;
+  vc->join_kernel = k;
+  vc->state      |= VC_JOIN_WAIT;
+
+  if (vc->state & VC_EXITED) {
+    xtask_vc_join(csdata, vc);
+  }
+
+  return NO_REPLY; // the task is unblocked when the thread exits
+}
+
+/******************************************************************************
+ * Function:     xtask_cs_get_rd_ptr                                          *
+ * Parameters:   vc  -   Pointer to vchan structure.                          *
+ * Return:       Pointer where CS can write next object or null pointer       *
+ *               when no buffer space is available                            *
+ *                                                                            *
+ *               The event vector for receiving data through a channel        *
+ *               from a hardware thread uses this function to get a pointer   *
+ *               to write the next object. This function must be called       *
+ *               prior to the reception of every object.                      *
+ ******************************************************************************/
+void * xtask_cs_get_rd_ptr(struct vchan *vc)
+{
+  struct vc_buf *buf;
+  unsigned int rd_ptr;
+
+  // the buffer at rd_fill belongs to CS unless all buffers
+  // are filled or held by the task
+  if (vc->rd_filled + (vc->rd_task != VC_NO_BUF) >= vc->nr_bufs) {
+    // none available, return zero
+    vc->state |= CS_RD_BLOCK;
+    return (void *)0;
+  }
+
+  buf = &vc->read_bufs[vc->rd_fill];
+  
+  // check if there is room in the buffer and calc new pointer
+  if ((buf->buf_size - buf->data_size) < vc->obj_size) {
+    // buffer is unexpectedly full, should not get here
+  } else {
+    // new pointer is buffer pointer + current data size
+    rd_ptr = (unsigned int) buf->data;
+    rd_ptr += buf->data_size;
+    buf->data_size += vc->obj_size; // the new data size after receiving one object
+
+    return (void *)rd_ptr;
+  }
+
+  return (void *)0;
+}
+
+/******************************************************************************
+ * Function:     xtask_cs_check_rd_blocked_tasks                              *
+ * Parameters:   vc      - Pointer to vchan structure.                        *
+ *               csdata  - Pointer to cs_data structure                       *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               The event vector for receiving data through a channel        *
+ *               from a hardware thread calls this function after receiving   *
+ *               an object to see if there was a task blocked on reading      *
+ *               data which can now be unblocked.                             *
+ ******************************************************************************/
+void xtask_cs_check_rd_blocked_tasks(struct vchan *vc, struct cs_data *csdata)
+{
+  struct vc_buf *buf = &vc->read_bufs[vc->rd_fill]; // buffer the CS has written to
+
+  if ((buf->buf_size - buf->data_size) < vc->obj_size) {
+    // buffer is full, add it to the filled buffers and
+    // continue with the next buffer in the ring
+    vc->rd_filled++;
+    vc->rd_fill = (vc->rd_fill + 1) % vc->nr_bufs;
+  }
+    
+  xtask_vc_wake_reader(vc, csdata);
+}
+
+/******************************************************************************
+ * Function:     xtask_vc_wake_reader                                         *
+ * Parameters:   vc      - Pointer to vchan structure.                        *
+ *               csdata  - Pointer to cs_data structure                       *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Unblock a task that is blocked on a read operation when      *
+ *               either a buffer is completely filled or there is enough      *
+ *               data to meet the minimum amount of the read operation.       *
+ ******************************************************************************/
+void xtask_vc_wake_reader(struct vchan *vc, struct cs_data *csdata)
+{
+  struct vc_buf *buf;
+
+  if (vc->state & TASK_RD_BLOCK) {
+    // a task is blocked on a read operation
+    if (vc->state & VC_EXITED) {
+      vc->min_read_size = 1; // hand over any data that is left
+    }
+
+    buf = xtask_vc_take_rd_buf(vc);
+
+    if (buf != NULL || (vc->state & VC_EXITED)) {
+      struct p_kreply *kr;
+
+      vc->state &= ~(TASK_RD_BLOCK); // clear flag that task is blocked on read operation
+      
+      kr = xtask_get_free_kreply(csdata, vc->kernel);
+          
+      if (kr != NULL) {
+        // add pending kernel reply and notify kernel
+        kr->reply.cmd = 1;
+        kr->reply.p0 = vc->handle;
+        kr->reply.p1 = (unsigned int)buf; // return buffer to kernel, NULL when thread exited
+        
+        xtask_notify_kernel(vc->kernel);
+      }
+    }
+  }
+}
+
+/******************************************************************************
+ * Function:     xtask_vc_stream_rx                                           *
+ * Parameters:   vc      - Pointer to vchan structure.                        *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               The event vector for receiving data through a channel in     *
+ *               streaming mode calls this function when the hardware thread  *
+ *               starts a frame. The frame length is read and the frame is    *
+ *               received when a read buffer is available. In shared-memory   *
+ *               mode the control token is a doorbell instead.                *
+ ******************************************************************************/
+void xtask_vc_stream_rx(struct vchan *vc)
+{
+  unsigned int chan_end = vc->own_chanend;
+
+  if (vc->shm != NULL) {
+    xtask_vc_shm_event(vc);
+    return;
+  }
+
+  __asm__ volatile ("chkct res[%0], 0x01"::"r"(chan_end));
+  __asm__ volatile ("in %0, res[%1]":"=r"(vc->rx_len):"r"(chan_end));
+
+  vc->state |= VC_RX_PENDING;
+  xtask_vc_stream_rx_frame(vc);
+}
+
+/******************************************************************************
+ * Function:     xtask_vc_stream_rx_frame                                     *
+ * Parameters:   vc      - Pointer to vchan structure.                        *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Receive a pending stream frame as one burst. A frame is      *
+ *               stored in one read buffer, when it does not fit in the rest  *
+ *               of the buffer that CS is filling this buffer is closed and   *
+ *               the next one is used. Words that do not fit in an empty      *
+ *               buffer are discarded. When no buffer is available the        *
+ *               hardware thread waits and events are disabled until the      *
+ *               task releases a buffer.                                      *
+ ******************************************************************************/
+void xtask_vc_stream_rx_frame(struct vchan *vc)
+{
+  unsigned int chan_end = vc->own_chanend;
+  unsigned int held = (vc->rd_task != VC_NO_BUF);
+  unsigned int size = vc->rx_len * 4;
+  unsigned int *word;
+  unsigned int room, w;
+  struct vc_buf *buf;
+  int j;
+
+  if (vc->rd_filled + held >= vc->nr_bufs) {
+    buf = NULL; // all buffers are filled or held by the task
+  } else {
+    buf = &vc->read_bufs[vc->rd_fill];
+
+    if (buf->data_size > 0 && buf->buf_size - buf->data_size < size) {
+      // close the partly filled buffer, continue with the next one
+      vc->rd_filled++;
+      vc->rd_fill = (vc->rd_fill + 1) % vc->nr_bufs;
+      buf = (vc->rd_filled + held < vc->nr_bufs) ? &vc->read_bufs[vc->rd_fill] : NULL;
+    }
+  }
+
+  if (buf == NULL) {
+    // wait for the task, a blocked task may now take the closed buffer
+    vc->state |= CS_RD_BLOCK;
+    __asm__ volatile ("edu res[%0]"::"r"(chan_end));
+    xtask_vc_wake_reader(vc, vc->csdata);
+    return;
+  }
+
+  // accept frame and receive it
+  __asm__ volatile ("outct res[%0], 0x01"::"r"(chan_end));
+
+  word = (unsigned int *)((unsigned int)buf->data + buf->data_size);
+  room = (buf->buf_size - buf->data_size) / 4;
+
+  for (j = 0; j < vc->rx_len; j++) {
+    __asm__ volatile ("in %0, res[%1]":"=r"(w):"r"(chan_end));
+    
+    if (j < room) {
+      word[j] = w;
+    }
+  }
+
+  __asm__ volatile ("chkct res[%0], 0x01"::"r"(chan_end));
+  __asm__ volatile ("outct res[%0], 0x01"::"r"(chan_end));
+
+  buf->data_size += ((vc->rx_len < room) ? vc->rx_len : room) * 4;
+  vc->state &= ~(VC_RX_PENDING);
+
+  if (buf->buf_size - buf->data_size < 4) {
+    // buffer is full
+    vc->rd_filled++;
+    vc->rd_fill = (vc->rd_fill + 1) % vc->nr_bufs;
+  }
+
+  xtask_vc_wake_reader(vc, vc->csdata);
+}
+
+/******************************************************************************
+ * Function:     xtask_vc_shm_event                                           *
+ * Parameters:   vc      - Pointer to vchan structure.                        *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Called when the hardware thread of a shared-memory channel   *
+ *               rings the doorbell. Read buffers filled by the thread are    *
+ *               added to the filled buffers and write buffers taken by the   *
+ *               thread are completed. One doorbell may cover several         *
+ *               buffers, a later doorbell may then find nothing new.         *
+ ******************************************************************************/
+void xtask_vc_shm_event(struct vchan *vc)
+{
+  struct vc_shm *shm = vc->shm;
+  unsigned int n2 = 2 * vc->nr_bufs;
+
+  __asm__ volatile ("chkct res[%0], 0x01"::"r"(vc->own_chanend));
+
+  // read buffers filled by the hardware thread
+  while (shm->rd_seen != shm->rd_put) {
+    shm->rd_seen = (shm->rd_seen + 1) % n2;
+    vc->rd_filled++;
+    vc->rd_fill = (vc->rd_fill + 1) % vc->nr_bufs;
+  }
+
+  // write buffers taken by the hardware thread
+  while (shm->wr_done != shm->wr_get) {
+    shm->wr_done = (shm->wr_done + 1) % n2;
+    xtask_vc_tx_complete(vc);
+  }
+
+  xtask_vc_wake_reader(vc, vc->csdata);
+}
+
+/******************************************************************************
+ * Function:     xtask_vc_shm_publish                                         *
+ * Parameters:   vc      - Pointer to vchan structure.                        *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Make all queued write buffers of a shared-memory channel     *
+ *               visible to the hardware thread, empty buffers included.      *
+ ******************************************************************************/
+void xtask_vc_shm_publish(struct vchan *vc)
+{
+  struct vc_shm *shm = vc->shm;
+
+  shm->wr_put = (shm->wr_done + vc->wr_queued) % (2 * vc->nr_bufs);
+  xtask_vc_shm_kick(vc, &shm->wr_wait);
+}
+
+/******************************************************************************
+ * Function:     xtask_vc_shm_kick                                            *
+ * Parameters:   vc      - Pointer to vchan structure.                        *
+ *               wait    - wait flag of the ring that changed                 *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Send a control token to the hardware thread if it waits on   *
+ *               the ring. Nothing is sent to an exited thread, it waits for  *
+ *               a restart message.                                           *
+ ******************************************************************************/
+void xtask_vc_shm_kick(struct vchan *vc, volatile unsigned int *wait)
+{
+  if (*wait && !(vc->state & VC_EXITED)) {
+    *wait = 0;
+    __asm__ volatile ("outct res[%0], 0x01"::"r"(vc->own_chanend));
+  }
+}
+
+/******************************************************************************
+ * Function:     xtask_vc_shm_attach                                          *
+ * Parameters:   vc      - Pointer to vchan structure.                        *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Send the address of the shared rings to a new hardware       *
+ *               thread of a shared-memory channel.                           *
+ ******************************************************************************/
+void xtask_vc_shm_attach(struct vchan *vc)
+{
+  unsigned int chan_end = vc->own_chanend;
+
+  vc->shm->c = vc->thread_chanend;
+
+  __asm__ volatile ("out res[%0], %1"::"r"(chan_end),"r"(vc->shm));
+  __asm__ volatile ("outct res[%0], 0x01"::"r"(chan_end));
+}
+
+/******************************************************************************
+ * Function:     xtask_hwt_stream_send                                        *
+ * Parameters:   c        - chanend of the hardware thread                    *
+ *               data     - words to send                                     *
+ *               nr_words - number of words                                   *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Send words to the task as one frame through a virtual        *
+ *               channel in streaming mode. Only the frame is synchronised    *
+ *               with CS, the words are sent back to back. This function is   *
+ *               executed by the dedicated hardware thread and is part of     *
+ *               the API.                                                     *
+ ******************************************************************************/
+void xtask_hwt_stream_send(chanend       c, 
+                           unsigned int *data, 
+                           unsigned int  nr_words)
+{
+  int j;
+
+  __asm__ volatile ("outct res[%0], 0x01"::"r"(c));
+  __asm__ volatile ("out res[%0], %1"::"r"(c),"r"(nr_words));
+  __asm__ volatile ("chkct res[%0], 0x01"::"r"(c)); // wait until CS accepts frame
+
+  for (j = 0; j < nr_words; j++) {
+    __asm__ volatile ("out res[%0], %1"::"r"(c),"r"(data[j]));
+  }
+
+  __asm__ volatile ("outct res[%0], 0x01"::"r"(c));
+  __asm__ volatile ("chkct res[%0], 0x01"::"r"(c));
+}
+
+/******************************************************************************
+ * Function:     xtask_hwt_stream_receive                                     *
+ * Parameters:   c         - chanend of the hardware thread                   *
+ *               data      - buffer to store received words                   *
+ *               max_words - size of buffer in words                          *
+ * Return:       number of words in the frame                                 *
+ *                                                                            *
+ *               Receive one frame (a buffer sent by the task) through a      *
+ *               virtual channel in streaming mode. Words that do not fit in  *
+ *               data are discarded. This function is executed by the         *
+ *               dedicated hardware thread and is part of the API.            *
+ ******************************************************************************/
+unsigned int xtask_hwt_stream_receive(chanend       c, 
+                                      unsigned int *data, 
+                                      unsigned int  max_words)
+{
+  unsigned int nr_words, w;
+  int j;
+
+  __asm__ volatile ("chkct res[%0], 0x01"::"r"(c));
+  __asm__ volatile ("outct res[%0], 0x01"::"r"(c)); // accept frame
+  __asm__ volatile ("in %0, res[%1]":"=r"(nr_words):"r"(c));
+
+  for (j = 0; j < nr_words; j++) {
+    __asm__ volatile ("in %0, res[%1]":"=r"(w):"r"(c));
+
+    if (j < max_words) {
+      data[j] = w;
+    }
+  }
+
+  __asm__ volatile ("chkct res[%0], 0x01"::"r"(c));
+  __asm__ volatile ("outct res[%0], 0x01"::"r"(c));
+
+  return nr_words;
+}
+
+/******************************************************************************
+ * Function:     xtask_hwt_shm_attach                                         *
+ * Parameters:   c        - chanend of the hardware thread                    *
+ * Return:       shared rings of the virtual channel                          *
+ *                                                                            *
+ *               Get the buffer rings of a virtual channel in shared-memory   *
+ *               mode. Must be called once at the start of the thread,        *
+ *               before any other use of the channel. This function is        *
+ *               executed by the dedicated hardware thread and is part of     *
+ *               the API.                                                     *
+ ******************************************************************************/
+struct vc_shm * xtask_hwt_shm_attach(chanend c)
+{
+  struct vc_shm *shm;
+
+  __asm__ volatile ("in %0, res[%1]":"=r"(shm):"r"(c));
+  __asm__ volatile ("chkct res[%0], 0x01"::"r"(c));
+
+  return shm;
+}
+
+/******************************************************************************
+ * Function:     xtask_hwt_shm_get_buf                                        *
+ * Parameters:   shm      - shared rings of the virtual channel               *
+ * Return:       empty read buffer to fill                                    *
+ *                                                                            *
+ *               Get the next read buffer of the task to fill, waits while    *
+ *               all read buffers are filled or held by the task. The thread  *
+ *               stores its data directly in the buffer and sets data_size.   *
+ *               This function is executed by the dedicated hardware thread   *
+ *               and is part of the API.                                      *
+ ******************************************************************************/
+struct vc_buf * xtask_hwt_shm_get_buf(struct vc_shm *shm)
+{
+  unsigned int n2 = 2 * shm->nr_bufs;
+  struct vc_buf *buf;
+
+  while ((shm->rd_put + n2 - shm->rd_get) % n2 >= shm->nr_bufs) {
+    // ask CS for a control token when a buffer is returned, check
+    // again because the task may have returned one meanwhile
+    shm->rd_wait = 1;
+
+    if ((shm->rd_put + n2 - shm->rd_get) % n2 >= shm->nr_bufs) {
+      __asm__ volatile ("chkct res[%0], 0x01"::"r"(shm->c));
+    } else {
+      shm->rd_wait = 0;
+    }
+  }
+
+  buf = &shm->read_bufs[shm->rd_put % shm->nr_bufs];
+  buf->data_size = 0;
+
+  return buf;
+}
+
+/******************************************************************************
+ * Function:     xtask_hwt_shm_put_buf                                        *
+ * Parameters:   shm      - shared rings of the virtual channel               *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Hand the read buffer from xtask_hwt_shm_get_buf to the task  *
+ *               and ring the doorbell of CS. This function is executed by    *
+ *               the dedicated hardware thread and is part of the API.        *
+ ******************************************************************************/
+void xtask_hwt_shm_put_buf(struct vc_shm *shm)
+{
+  shm->rd_put = (shm->rd_put + 1) % (2 * shm->nr_bufs);
+  __asm__ volatile ("outct res[%0], 0x01"::"r"(shm->c));
+}
+
+/******************************************************************************
+ * Function:     xtask_hwt_shm_receive                                        *
+ * Parameters:   shm      - shared rings of the virtual channel               *
+ * Return:       write buffer sent by the task                                *
+ *                                                                            *
+ *               Get the oldest write buffer sent by the task, waits until    *
+ *               the task sends one. The buffer may be empty. This function   *
+ *               is executed by the dedicated hardware thread and is part of  *
+ *               the API.                                                     *
+ ******************************************************************************/
+struct vc_buf * xtask_hwt_shm_receive(struct vc_shm *shm)
+{
+  while (shm->wr_get == shm->wr_put) {
+    // ask CS for a control token when the task sends a buffer
+    shm->wr_wait = 1;
+
+    if (shm->wr_get == shm->wr_put) {
+      __asm__ volatile ("chkct res[%0], 0x01"::"r"(shm->c));
+    } else {
+      shm->wr_wait = 0;
+    }
+  }
+
+  return &shm->write_bufs[shm->wr_get % shm->nr_bufs];
+}
+
+/******************************************************************************
+ * Function:     xtask_hwt_shm_release                                        *
+ * Parameters:   shm      - shared rings of the virtual channel               *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Return the write buffer from xtask_hwt_shm_receive to the    *
+ *               task and ring the doorbell of CS. This function is executed  *
+ *               by the dedicated hardware thread and is part of the API.     *
+ ******************************************************************************/
+void xtask_hwt_shm_release(struct vc_shm *shm)
+{
+  shm->wr_get = (shm->wr_get + 1) % (2 * shm->nr_bufs);
+  __asm__ volatile ("outct res[%0], 0x01"::"r"(shm->c));
+}
+
+/******************************************************************************
+ * Function:     xtask_hwt_exit                                               *
+ * Parameters:   c        - chanend of hardware thread                        *
+ *               status   - exit status, returned to the joining task         *
+ * Return:       does not return                                              *
+ *                                                                            *
+ *               Exit from a hardware thread, called by the hardware thread.  *
+ *               Returning from the thread function exits with status 0. A    *
+ *               thread on the same tile as its CS is parked and can be       *
+ *               started again for a new thread, other threads end.           *
+ ******************************************************************************/
+void xtask_hwt_exit(chanend c, unsigned int status)
+{
+  unsigned int ct;
+
+  // a data word instead of a control token tells CS that we exit
+  __asm__ volatile ("out res[%0], %1"::"r"(c),"r"(status));
+  __asm__ volatile ("outct res[%0], 0x01"::"r"(c));
+
+  // drop a request to accept an object that CS sent meanwhile,
+  // then wait until CS has taken the exit
+  __asm__ volatile ("testct %0, res[%1]":"=r"(ct):"r"(c));
+
+  while (ct) {
+    __asm__ volatile ("inct %0, res[%1]":"=r"(ct):"r"(c));
+    __asm__ volatile ("testct %0, res[%1]":"=r"(ct):"r"(c));
+  }
+
+  __asm__ volatile ("in %0, res[%1]":"=r"(ct):"r"(c));
+  __asm__ volatile ("chkct res[%0], 0x01"::"r"(c));
+
+  _xtask_hwt_park(c);
+}
+
+/******************************************************************************
+ * Function:     xtask_hwt_restart                                            *
+ * Parameters:   vc      - Pointer to vchan structure                         *
+ *               pc      - new thread function, NULL to end the thread        *
+ *               args    - argument of new thread function                    *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Start the exited hardware thread of a virtual channel again  *
+ *               with a new function at the top of its stack, or end it.      *
+ ******************************************************************************/
+void xtask_hwt_restart(struct vchan *vc, void *pc, unsigned int args)
+{
+  unsigned int chan_end = vc->own_chanend;
+  unsigned int sp = 0;
+
+  if (vc->stack != NULL) {
+    sp = (unsigned int)(vc->stack + (vc->stack_words - 1));
+  }
+
+  __asm__ volatile ("out res[%0], %1"::"r"(chan_end),"r"(pc));
+  __asm__ volatile ("out res[%0], %1"::"r"(chan_end),"r"(sp));
+  __asm__ volatile ("out res[%0], %1"::"r"(chan_end),"r"(args));
+  __asm__ volatile ("outct res[%0], 0x01"::"r"(chan_end));
+}
+
+/******************************************************************************
+ * Function:     xtask_vc_exit                                                *
+ * Parameters:   vc      - Pointer to vchan structure                         *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Called by the event vector when the hardware thread sends    *
+ *               its exit status. Buffers queued for transfer are dropped,    *
+ *               blocked tasks are unblocked and a joining task gets the      *
+ *               exit status.                                                 *
+ ******************************************************************************/
+void xtask_vc_exit(struct vchan *vc)
+{
+  unsigned int chan_end = vc->own_chanend;
+
+  __asm__ volatile ("in %0, res[%1]":"=r"(vc->exit_status):"r"(chan_end));
+  __asm__ volatile ("chkct res[%0], 0x01"::"r"(chan_end));
+
+  // no more events until the thread is started again
+  __asm__ volatile ("edu res[%0]"::"r"(chan_end));
+  vc->state |= VC_EXITED;
+
+  // the thread waits until we have taken the exit
+  __asm__ volatile ("out res[%0], %1"::"r"(chan_end),"r"(0));
+  __asm__ volatile ("outct res[%0], 0x01"::"r"(chan_end));
+
+  // drop queued buffers, a blocked writer gets its buffer back
+  vc->tx_state = VC_TX_IDLE;
+  xtask_vc_tx_start(vc);
+
+  // a blocked reader gets the data that is left, or a null pointer
+  xtask_vc_wake_reader(vc, vc->csdata);
+
+  if (vc->state & VC_JOIN_WAIT) {
+    xtask_vc_join(vc->csdata, vc);
+  }
+}
+
+/******************************************************************************
+ * Function:     xtask_vc_join                                                *
+ * Parameters:   csdata  - Pointer to cs_data structure                       *
+ *               vc      - Pointer to vchan structure of exited thread        *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Unblock the joining task with the exit status and release    *
+ *               the virtual channel. The handle is invalid afterwards.       *
+ ******************************************************************************/
+void xtask_vc_join(struct cs_data *csdata, struct vchan *vc)
+{
+  struct p_kreply *kr;
+
+  kr = xtask_get_free_kreply(csdata, vc->join_kernel);
+
+  if (kr != NULL) {
+    kr->reply.cmd = 0x04;
+    kr->reply.p0  = vc->join_tid;
+    kr->reply.p1  = 0; // return value, succeeded
+    kr->reply.p2  = vc->exit_status;
+        
+    xtask_notify_kernel(vc->join_kernel);
+  }
+
+  xtask_vc_release(csdata, vc);
+}
+
+/******************************************************************************
+ * Function:     xtask_vc_release                                             *
+ * Parameters:   csdata  - Pointer to cs_data structure                       *
+ *               vc      - Pointer to vchan structure of exited thread        *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Remove the virtual channel from the handle table and list.   *
+ *               A hardware thread on this tile is parked in the pool with    *
+ *               its chanends, stack, chan_event and buffers. A thread        *
+ *               started by code is ended and the channel is freed. The CS    *
+ *               that started it frees its stack, told over the ring bus when *
+ *               it is on another tile.                                       *
+ ******************************************************************************/
+void xtask_vc_release(struct cs_data *csdata, struct vchan *vc)
+{
+  struct vchan **vpp = &csdata->vchans;
+
+  csdata->vc_table[vc->handle] = NULL;
+
+  while (*vpp != vc) {
+    vpp = &(*vpp)->next;
+  }
+
+  *vpp = vc->next;
+
+  if (vc->stack != NULL) {
+    vc->next = csdata->hwt_pool;
+    csdata->hwt_pool = vc;
+  } else {
+    xtask_hwt_restart(vc, NULL, 0); // thread frees its chanend and itself
+
+    if (vc->host_cs == csdata->id) {
+      xtask_hwt_end(csdata, vc->thread_chanend);
+    } else {
+      struct ring_buf *rb = xtask_ring_alloc(csdata);
+
+      rb->cs_id    = csdata->id;
+      rb->msg_type = 0x0D;
+      rb->status   = 0;
+      rb->req_id   = 0;
+      rb->dest     = vc->host_cs;
+      rb->payload_size = 4;
+      *(unsigned int *)rb->payload = vc->thread_chanend;
+
+      xtask_ring_send(csdata, rb);
+    }
+
+    free(vc->event);
+    xtask_vc_free(vc);
+  }
+}
+
+/******************************************************************************
+ * Function:     xtask_ring_alloc                                             *
+ * Parameters:   csdata  - Pointer to cs_data structure                       *
+ * Return:       Pointer to ring bus buffer                                   *
+ *                                                                            *
+ *               Take a buffer from the pool of ring bus buffers. A new       *
+ *               buffer is allocated when the pool is empty, the number of    *
+ *               buffers is bounded by the number of messages in flight.      *
+ *               Only the server thread of CS allocates memory, the ring      *
+ *               thread uses xtask_ring_pool_get.                             *
+ ******************************************************************************/
+struct ring_buf * xtask_ring_alloc(struct cs_data *csdata)
+{
+  struct ring_buf *rb = xtask_ring_pool_get(csdata);
+
+  if (rb == NULL) {
+    rb          = malloc(sizeof(struct ring_buf));
+    rb->payload = malloc(RING_PAYLOAD_SIZE);
+  }
+
+  rb->req_id = 0;
+  rb->dest   = 0;
+  rb->next   = NULL;
+
+  return rb;
+}
+
+/******************************************************************************
+ * Function:     xtask_ring_free                                              *
+ * Parameters:   csdata  - Pointer to cs_data structure                       *
+ *               rb      - Ring bus buffer                                    *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Return a ring bus buffer to the pool.                        *
+ ******************************************************************************/
+void xtask_ring_free(struct cs_data *csdata, struct ring_buf *rb)
+{
+  xtask_ring_lock(csdata);
+  rb->next = csdata->rb_free;
+  csdata->rb_free = rb;
+  xtask_ring_unlock(csdata);
+}
+
+/******************************************************************************
+ * Function:     xtask_ring_pool_grow                                         *
+ * Parameters:   csdata  - Pointer to cs_data structure                       *
+ *               n       - number of buffers to add                           *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Allocate ring bus buffers and add them to the pool.          *
+ ******************************************************************************/
+void xtask_ring_pool_grow(struct cs_data *csdata, unsigned int n)
+{
+  struct ring_buf *rb;
+  int i;
+
+  for (i = 0; i < n; i++) {
+    rb          = malloc(sizeof(struct ring_buf));
+    rb->payload = malloc(RING_PAYLOAD_SIZE);
+    xtask_ring_free(csdata, rb);
+  }
+}
+
+/******************************************************************************
+ * Function:     xtask_ring_pool_get                                          *
+ * Parameters:   csdata  - Pointer to cs_data structure                       *
+ * Return:       Pointer to ring bus buffer, NULL when the pool is empty      *
+ *                                                                            *
+ *               Take a buffer from the pool of ring bus buffers.             *
+ ******************************************************************************/
+struct ring_buf * xtask_ring_pool_get(struct cs_data *csdata)
+{
+  struct ring_buf *rb;
+
+  xtask_ring_lock(csdata);
+  rb = csdata->rb_free;
+
+  if (rb != NULL) {
+    csdata->rb_free = rb->next;
+  }
+
+  xtask_ring_unlock(csdata);
+
+  return rb;
+}
+
+/******************************************************************************
+ * Function:     xtask_ring_lock                                              *
+ * Parameters:   csdata  - Pointer to cs_data structure                       *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Acquire the hardware lock that protects the buffer pool and  *
+ *               the hand-off lists shared by the server and ring thread.     *
+ *               Does nothing when CS has no ring thread.                     *
+ ******************************************************************************/
+void xtask_ring_lock(struct cs_data *csdata)
+{
+  unsigned int dummy;
+
+  if (csdata->rt_lock != 0) {
+    __asm__ volatile ("in %0, res[%1]":"=r"(dummy):"r"(csdata->rt_lock));
+  }
+}
+
+/******************************************************************************
+ * Function:     xtask_ring_unlock                                            *
+ * Parameters:   csdata  - Pointer to cs_data structure                       *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Release the lock acquired by xtask_ring_lock.                *
+ ******************************************************************************/
+void xtask_ring_unlock(struct cs_data *csdata)
+{
+  if (csdata->rt_lock != 0) {
+    __asm__ volatile ("out res[%0], %0"::"r"(csdata->rt_lock));
+  }
+}
+
+/******************************************************************************
+ * Function:     xtask_ring_send                                              *
+ * Parameters:   csdata  - Pointer to cs_data structure                       *
+ *               rb      - Ring bus message                                   *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Send a message to the next CS on the ring bus. Called by     *
+ *               the server thread of CS, the message is handed to the ring   *
+ *               thread if CS has one. The buffer returns to the pool when    *
+ *               the message has been sent.                                   *
+ ******************************************************************************/
+void xtask_ring_send(struct cs_data *csdata, struct ring_buf *rb)
+{
+  if (csdata->rt_c != 0) {
+    xtask_ring_put(csdata, &csdata->rt_tx_head, &csdata->rt_tx_tail, rb, csdata->rt_c);
+  } else {
+    xtask_ring_queue(csdata, rb);
+  }
+}
+
+/******************************************************************************
+ * Function:     xtask_ring_queue                                             *
+ * Parameters:   csdata  - Pointer to cs_data structure                       *
+ *               rb      - Ring bus message                                   *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Queue a message for the next CS on the ring bus and start    *
+ *               sending it when no other message is being sent. Called by    *
+ *               the thread that serves the ring bus chanends.                *
+ ******************************************************************************/
+void xtask_ring_queue(struct cs_data *csdata, struct ring_buf *rb)
+{
+  rb->next = NULL;
+
+  if (csdata->tx_head == NULL) {
+    csdata->tx_head = rb;
+    csdata->tx_tail = rb;
+    csdata->tx_word = 0;
+    xtask_ring_tx_word(csdata); // ring bus is idle, start sending
+  } else {
+    csdata->tx_tail->next = rb;
+    csdata->tx_tail = rb;
+  }
+}
+
+/******************************************************************************
+ * Function:     xtask_ring_tx_word                                           *
+ * Parameters:   csdata  - Pointer to cs_data structure                       *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Send the next word of the oldest queued ring bus message.    *
+ *               The header is sent first: cs_id, msg_type, status, req_id,   *
+ *               dest and payload_size, followed by the payload. One word is  *
+ *               outstanding at a time, so the word always fits in the        *
+ *               channel buffer and CS never waits for the next CS.           *
+ ******************************************************************************/
+void xtask_ring_tx_word(struct cs_data *csdata)
+{
+  struct ring_buf *rb = csdata->tx_head;
+  unsigned int i = csdata->tx_word++;
+  unsigned int w;
+
+  switch (i) {
+    case 0:  w = rb->cs_id;        break;
+    case 1:  w = rb->msg_type;     break;
+    case 2:  w = rb->status;       break;
+    case 3:  w = rb->req_id;       break;
+    case 4:  w = rb->dest;         break;
+    case 5:  w = rb->payload_size; break;
+    default: w = ((unsigned int *)rb->payload)[i - RING_HDR_WORDS]; break;
+  }
+
+  __asm__ volatile ("out res[%0], %1"::"r"(csdata->ring_out),"r"(w));
+}
+
+/******************************************************************************
+ * Function:     xtask_ring_tx_event                                          *
+ * Parameters:   csdata  - Pointer to cs_data structure                       *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Called by the event vector of ring_out when the next CS has  *
+ *               received a word. Sends the next word, or releases the buffer *
+ *               and starts the next queued message when the message is       *
+ *               complete.                                                    *
+ ******************************************************************************/
+void xtask_ring_tx_event(struct cs_data *csdata)
+{
+  struct ring_buf *rb = csdata->tx_head;
+
+  __asm__ volatile ("chkct res[%0], 0x01"::"r"(csdata->ring_out));
+
+  if (csdata->tx_word < RING_HDR_WORDS + (rb->payload_size + 3) / 4) {
+    xtask_ring_tx_word(csdata);
+    return;
+  }
+
+  // message has been sent
+  csdata->tx_head = rb->next;
+  csdata->tx_word = 0;
+  xtask_ring_free(csdata, rb);
+
+  if (csdata->tx_head != NULL) {
+    xtask_ring_tx_word(csdata);
+  }
+}
+
+/******************************************************************************
+ * Function:     xtask_ring_receive                                           *
+ * Parameters:   csdata  - Pointer to cs_data structure                       *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Called by the event vector of ring_in. Receives one word of  *
+ *               a ring bus message and acknowledges it. Each message is      *
+ *               received in its own buffer, so messages that are queued to   *
+ *               be passed on do not stop CS from receiving the next one.     *
+ *               The message is processed when the last word is received.     *
+ *               With a ring thread, only messages addressed to another CS    *
+ *               are passed on here, all others go to the server thread.      *
+ ******************************************************************************/
+void xtask_ring_receive(struct cs_data *csdata)
+{
+  struct ring_buf *rb;
+  unsigned int i;
+  unsigned int w;
+
+  if (csdata->rx_buf == NULL && csdata->rt_c != 0) {
+    // the ring thread does not allocate memory, when the pool is empty
+    // the word stays in the channel until the server thread adds buffers
+    csdata->rx_buf  = xtask_ring_pool_get(csdata);
+    csdata->rx_word = 0;
+
+    if (csdata->rx_buf == NULL) {
+      __asm__ volatile ("edu res[%0]"::"r"(csdata->ring_in));
+      csdata->rt_starved = 1;
+      __asm__ volatile ("outct res[%0], 0x01"::"r"(csdata->rt_hwt_c));
+      return;
+    }
+  } else if (csdata->rx_buf == NULL) {
+    csdata->rx_buf  = xtask_ring_alloc(csdata);
+    csdata->rx_word = 0;
+  }
+
+  rb = csdata->rx_buf;
+  i  = csdata->rx_word++;
+
+  __asm__ volatile ("in %0, res[%1]":"=r"(w):"r"(csdata->ring_in));
+  __asm__ volatile ("outct res[%0], 0x01"::"r"(csdata->ring_in));
+
+  switch (i) {
+    case 0:  rb->cs_id        = w; break;
+    case 1:  rb->msg_type     = w; break;
+    case 2:  rb->status       = w; break;
+    case 3:  rb->req_id       = w; break;
+    case 4:  rb->dest         = w; break;
+    case 5:  rb->payload_size = w; break;
+    default:
+      if (i - RING_HDR_WORDS < RING_PAYLOAD_SIZE / 4) {
+        ((unsigned int *)rb->payload)[i - RING_HDR_WORDS] = w;
+      }
+      break;
+  }
+
+  if (csdata->rx_word < RING_HDR_WORDS ||
+      csdata->rx_word < RING_HDR_WORDS + (rb->payload_size + 3) / 4) {
+    return; // more words to come
+  }
+
+  csdata->rx_buf = NULL;
+
+  if (csdata->rt_c == 0) {
+    xtask_process_ring_msg(csdata, rb);
+  } else if (rb->cs_id != csdata->id && rb->dest != 0 && rb->dest != csdata->id) {
+    // addressed to another CS, the ring thread passes it on at once
+    xtask_ring_queue(csdata, rb);
+  } else {
+    // the server thread processes the message
+    xtask_ring_put(csdata, &csdata->rt_rx_head, &csdata->rt_rx_tail, rb, csdata->rt_hwt_c);
+  }
+}
+
+/******************************************************************************
+ * Function:     xtask_ring_start_thread                                      *
+ * Parameters:   csdata  - Pointer to cs_data structure                       *
+ * Return:       1 when the ring thread has been started, 0 otherwise         *
+ *                                                                            *
+ *               Start a hardware thread that serves the ring bus chanends,   *
+ *               so the server thread of CS only handles kernels, virtual     *
+ *               channels and links. The ring thread receives and sends the   *
+ *               words of ring bus messages and passes on messages addressed  *
+ *               to other CS by itself. Every other message is handed to the  *
+ *               server thread, which keeps all other state of CS, such as    *
+ *               mailboxes, p_outbox and p_reqs. Messages are handed over in  *
+ *               lists protected by a hardware lock, together with the pool   *
+ *               of ring bus buffers, and a control token on a chanend pair   *
+ *               tells the other thread that its list is no longer empty.     *
+ ******************************************************************************/
+unsigned int xtask_ring_start_thread(struct cs_data *csdata)
+{
+  struct chan_event *ev;
+  unsigned int *stack;
+  unsigned int lock;
+  chanend a, b;
+
+  __asm__ volatile ("getr %0, 5":"=r"(lock));
+  a = _xtask_get_chanend();
+  b = _xtask_get_chanend();
+
+  if (lock == 0 || a == 0 || b == 0) {
+    if (lock != 0) {
+      __asm__ volatile ("freer res[%0]"::"r"(lock));
+    }
+
+    if (a != 0) {
+      _xtask_free_chanend(a);
+    }
+
+    if (b != 0) {
+      _xtask_free_chanend(b);
+    }
+
+    return 0;
+  }
+
+  _xtask_set_chanend_dest(a, b);
+  _xtask_set_chanend_dest(b, a);
+
+  csdata->rt_lock  = lock;
+  csdata->rt_c     = a;
+  csdata->rt_hwt_c = b;
+
+  // doorbell of the ring thread
+  ev = malloc(sizeof(struct chan_event));
+  ev->res    = a;
+  ev->vector = (void *) _xtask_ring_server_vec;
+  ev->env    = (void *) csdata;
+  _xtask_set_chan_event((void *)ev);
+
+  // events of the ring thread, enabled by the ring thread itself
+  ev = malloc(3 * sizeof(struct chan_event));
+  ev[0].res    = csdata->ring_in;
+  ev[0].vector = (void *) _xtask_ring_vec;
+  ev[0].env    = (void *) csdata;
+  ev[1].res    = csdata->ring_out;
+  ev[1].vector = (void *) _xtask_ring_tx_vec;
+  ev[1].env    = (void *) csdata;
+  ev[2].res    = b;
+  ev[2].vector = (void *) _xtask_ring_thread_vec;
+  ev[2].env    = (void *) csdata;
+
+  stack = malloc(RING_THREAD_STACK * WORD_SIZE);
+  _xtask_create_thread((void *)xtask_ring_thread, 
+                       (void *)(stack + (RING_THREAD_STACK - 1)), 
+                       (void *)ev, 
+                       b);
+  csdata->nr_threads++;
+
+  return 1;
+}
+
+/******************************************************************************
+ * Function:     xtask_ring_thread                                            *
+ * Parameters:   args    - chan_event structures of ring_in, ring_out and the *
+ *                         doorbell chanend of the ring thread                *
+ *               c       - doorbell chanend of the ring thread                *
+ * Return:       does not return, waits for event                             *
+ *                                                                            *
+ *               Ring thread of CS, started by xtask_ring_start_thread.       *
+ ******************************************************************************/
+void xtask_ring_thread(void *args, chanend c)
+{
+  struct chan_event *ev = args;
+  int i;
+
+  for (i = 0; i < 3; i++) {
+    _xtask_set_chan_event((void *)&ev[i]);
+  }
+
+  __asm__ volatile ("waiteu");
+}
+
+/******************************************************************************
+ * Function:     xtask_ring_put                                               *
+ * Parameters:   csdata  - Pointer to cs_data structure                       *
+ *               head    - head of hand-off list                              *
+ *               tail    - tail of hand-off list                              *
+ *               rb      - Ring bus message                                   *
+ *               c       - doorbell chanend of this thread                    *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Hand a message to the other thread of CS. A control token is *
+ *               sent only when the list was empty, the other thread takes    *
+ *               the whole list at once. So at most one token is on its way   *
+ *               for a list and sending it never waits.                       *
+ ******************************************************************************/
+void xtask_ring_put(struct cs_data *   csdata, 
+                    struct ring_buf ** head,
+                    struct ring_buf ** tail,
+                    struct ring_buf *  rb,
+                    chanend            c)
+{
+  unsigned int was_empty;
+
+  rb->next = NULL;
+
+  xtask_ring_lock(csdata);
+  was_empty = (*head == NULL);
+
+  if (was_empty) {
+    *head = rb;
+  } else {
+    (*tail)->next = rb;
+  }
+
+  *tail = rb;
+  xtask_ring_unlock(csdata);
+
+  if (was_empty) {
+    __asm__ volatile ("outct res[%0], 0x01"::"r"(c));
+  }
+}
+
+/******************************************************************************
+ * Function:     xtask_ring_take                                              *
+ * Parameters:   csdata  - Pointer to cs_data structure                       *
+ *               head    - head of hand-off list                              *
+ *               tail    - tail of hand-off list                              *
+ * Return:       messages handed over, oldest first                           *
+ *                                                                            *
+ *               Take all messages handed over by the other thread of CS.     *
+ ******************************************************************************/
+struct ring_buf * xtask_ring_take(struct cs_data *   csdata, 
+                                  struct ring_buf ** head,
+                                  struct ring_buf ** tail)
+{
+  struct ring_buf *rb;
+
+  xtask_ring_lock(csdata);
+  rb    = *head;
+  *head = NULL;
+  *tail = NULL;
+  xtask_ring_unlock(csdata);
+
+  return rb;
+}
+
+/******************************************************************************
+ * Function:     xtask_ring_server_event                                      *
+ * Parameters:   csdata  - Pointer to cs_data structure                       *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Called by the event vector of the server thread when the     *
+ *               ring thread rings its doorbell. Processes the received       *
+ *               messages in order and adds ring bus buffers when the ring    *
+ *               thread ran out of them.                                      *
+ ******************************************************************************/
+void xtask_ring_server_event(struct cs_data *csdata)
+{
+  struct ring_buf *rb, *next;
+
+  __asm__ volatile ("chkct res[%0], 0x01"::"r"(csdata->rt_c));
+
+  rb = xtask_ring_take(csdata, &csdata->rt_rx_head, &csdata->rt_rx_tail);
+
+  if (csdata->rt_starved) {
+    // let the ring thread continue receiving
+    xtask_ring_pool_grow(csdata, RING_NR_BUFS);
+    csdata->rt_starved = 0;
+    __asm__ volatile ("outct res[%0], 0x01"::"r"(csdata->rt_c));
+  }
+
+  while (rb != NULL) {
+    next = rb->next;
+    xtask_process_ring_msg(csdata, rb);
+    rb = next;
+  }
+}
+
+/******************************************************************************
+ * Function:     xtask_ring_thread_event                                      *
+ * Parameters:   csdata  - Pointer to cs_data structure                       *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Called by the event vector of the ring thread when the       *
+ *               server thread rings its doorbell. Queues the messages to     *
+ *               send and continues receiving, the server thread may have     *
+ *               added ring bus buffers.                                      *
+ ******************************************************************************/
+void xtask_ring_thread_event(struct cs_data *csdata)
+{
+  struct ring_buf *rb, *next;
+
+  __asm__ volatile ("chkct res[%0], 0x01"::"r"(csdata->rt_hwt_c));
+
+  rb = xtask_ring_take(csdata, &csdata->rt_tx_head, &csdata->rt_tx_tail);
+
+  while (rb != NULL) {
+    next = rb->next;
+    xtask_ring_queue(csdata, rb);
+    rb = next;
+  }
+
+  _xtask_chan_enable_events(csdata->ring_in);
+}
+
+/******************************************************************************
+ * Function:     xtask_ring_send_outbox                                       *
+ * Parameters:   csdata  - Pointer to cs_data structure                       *
+ *               send_mb - Mailbox of sender, outbox_dest is the recipient    *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Send outbox to a recipient on another tile over the ring     *
+ *               bus. The message is addressed to the CS of the recipient     *
+ *               when its location is known, other CS just pass it on.        *
+ *               A message that fits in the ring bus payload is sent at       *
+ *               once (type 0x03). A larger message first reserves the inbox  *
+ *               of the recipient (type 0x08) and is then sent in fragments   *
+ *               (type 0x09) by xtask_ring_send_frags.                        *
+ ******************************************************************************/
+void xtask_ring_send_outbox(struct cs_data *csdata, struct mailbox *send_mb)
+{
+  struct p_request *pr = xtask_get_free_p_request(csdata);
+  struct ring_buf *rb  = xtask_ring_alloc(csdata);
+  unsigned int *pl     = (unsigned int *)rb->payload;
+
+  // pending reply from ring bus
+  pr->kernel = send_mb->kernel;
+  pr->tid    = send_mb->tid;
+  pr->data   = (void *)send_mb;
+
+  rb->cs_id  = csdata->id;
+  rb->status = 0;
+  rb->req_id = pr->req_id;
+  rb->dest   = xtask_mb_loc_get(csdata, send_mb->outbox_dest); // 0 = search all CS
+  pl[0]      = send_mb->outbox_dest; // recipient mailbox id
+
+  if (4 + send_mb->outbox.data_size <= RING_PAYLOAD_SIZE) {
+    // first 4 bytes = mailbox id, remaining = message
+    pr->msg_type     = 0x03;
+    rb->msg_type     = 0x03;
+    rb->payload_size = 4 + send_mb->outbox.data_size;
+    memcpy(&pl[1], send_mb->outbox.data, send_mb->outbox.data_size);
+  } else {
+    // recipient mailbox id, message size
+    pr->msg_type     = 0x08;
+    rb->msg_type     = 0x08;
+    rb->payload_size = 8;
+    pl[1]            = send_mb->outbox.data_size;
+  }
+
+  xtask_ring_send(csdata, rb);
+}
+
+/******************************************************************************
+ * Function:     xtask_ring_send_frags                                        *
+ * Parameters:   csdata  - Pointer to cs_data structure                       *
+ *               pr      - Pending reply of the large message                 *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Send the next fragments of a large message. At most          *
+ *               RING_FRAG_WINDOW fragments are on the ring bus at once, the  *
+ *               next one is sent when a fragment returns to this CS. This    *
+ *               bounds the ring bus buffers a large message takes on each    *
+ *               CS and leaves room for other messages.                       *
+ ******************************************************************************/
+void xtask_ring_send_frags(struct cs_data *csdata, struct p_request *pr)
+{
+  struct mailbox *send_mb = pr->data;
+
+  while (pr->nr_frags < RING_FRAG_WINDOW && pr->offset < send_mb->outbox.data_size) {
+    struct ring_buf *rb = xtask_ring_alloc(csdata);
+    unsigned int *pl    = (unsigned int *)rb->payload;
+    unsigned int size   = send_mb->outbox.data_size - pr->offset;
+
+    if (size > RING_PAYLOAD_SIZE - 8) {
+      size = RING_PAYLOAD_SIZE - 8;
+    }
+
+    // payload: recipient mailbox id, offset in message, data
+    pl[0] = send_mb->outbox_dest;
+    pl[1] = pr->offset;
+    memcpy(&pl[2], (char *)send_mb->outbox.data + pr->offset, size);
+
+    rb->cs_id        = csdata->id;
+    rb->msg_type     = 0x09;
+    rb->status       = 0;
+    rb->req_id       = pr->req_id;
+    rb->dest         = pr->dest;
+    rb->payload_size = 8 + size;
+
+    xtask_ring_send(csdata, rb);
+
+    pr->offset += size;
+    pr->nr_frags++;
+  }
+}
+
+/******************************************************************************
+ * Function:     xtask_process_ring_msg                                       *
+ * Parameters:   csdata  - Pointer to cs_data structure                       *
+ *               rb      - Received ring bus message                          *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Process a message received from the ring bus. This can be    *
+ *               a message initiated by another CS or a message initiated     *
+ *               by this CS that has been passed to all CS and is now         *
+ *               returning. Replies are matched with the pending request by   *
+ *               request id, so any number of requests can be in flight.      *
+ *                                                                            * 
+ *               This function should be divided in subfunctions to           *
+ *               increase readability.                                        * 
+ ******************************************************************************/
+void xtask_process_ring_msg (struct cs_data *csdata, struct ring_buf *rb)
+{
+  unsigned int *up;
+
+  up = rb->payload;
+  //printf("CH[%u] ring packet: cs_id: %u msg_type: %u status: %u  payload_size: %u\n", 
+  //csdata->id, rb->cs_id, rb->msg_type, rb->status, rb->payload_size);
+  //printf("CH[%u] ring rec: %u\n", csdata->id, *up);
+  
+  if (rb->cs_id == csdata->id) {
+    // received own initiated message
+    struct p_request *pr = NULL;
+
+    if (rb->req_id != 0) {
+      pr = xtask_take_p_request(csdata, rb->req_id);
+    }
+    
+    if (rb->msg_type == 0x01) {
+      // used to test ring bus connectivity
+      // expects payload with the CS id's of each CS in the ring bus
+      int i;
+      unsigned int *up = rb->payload;
+      for (i=0; i < rb->payload_size; i+=4) {
+        //printf("CH[%u] Found CH: %u\n",csdata->id, *up);
+        up++;
+      }
+    } else if (rb->msg_type == 0x02 && pr != NULL) {
+        // Ring bus reply from creating a new hardware thread
+        // We gain access again to the previously allocated virtual
+        // channel structure and complete the initialisation.
+        if (rb->status == 1) {
+          xtask_hwt_connect(csdata, (struct vchan *)pr->data, pr->tid, 
+                            *(unsigned int *)rb->payload, 
+                            ((unsigned int *)rb->payload)[1]);
+        } else {
+          // target CS is unknown or no CS could start the code
+          xtask_hwt_fail(csdata, (struct vchan *)pr->data, pr->tid);
+        }
+        
+        // release pending ring bus reply
+        free((void *)pr);
+
+    } else if (rb->msg_type == 0x0C && pr != NULL) {
+        // all CS have added their load, start the hardware thread
+        // on the least loaded CS
+        unsigned int *pl = (unsigned int *)rb->payload;
+        struct ring_buf *tb;
+        chanend c;
+
+        if (pl[5] != 0 && pl[4] != csdata->id) {
+          // ask that CS to start the thread, reply as type 0x02
+          tb = xtask_ring_alloc(csdata);
+          tb->cs_id    = csdata->id;
+          tb->msg_type = 0x02;
+          tb->status   = 0;
+          tb->req_id   = pr->req_id;
+          tb->dest     = pl[4];
+          tb->payload_size = 16;
+          memcpy(tb->payload, pl, 16);
+
+          // still pending until the reply returns
+          pr->msg_type = 0x02;
+          pr->next = csdata->p_reqs;
+          csdata->p_reqs = pr;
+
+          xtask_ring_send(csdata, tb);
+        } else {
+          c = (pl[5] != 0) ? xtask_hwt_start(csdata, pl[0], pl[1], pl[2], pl[3]) : 0;
+
+          if (c != 0) {
+            xtask_hwt_connect(csdata, (struct vchan *)pr->data, pr->tid, c, csdata->id);
+          } else {
+            // no CS knows the code or has a free thread
+            xtask_hwt_fail(csdata, (struct vchan *)pr->data, pr->tid);
+          }
+        
+          free(pr);
+        }
+        
+    } else if (rb->msg_type == 0x08 && rb->status == 0x01 && pr != NULL) {
+        // inbox of recipient is reserved for the large message,
+        // stream the message to it in fragments
+        xtask_mb_loc_set(csdata, ((struct mailbox *)pr->data)->outbox_dest, rb->dest);
+        pr->msg_type = 0x09;
+        pr->dest     = rb->dest;
+        pr->offset   = 0;
+        pr->nr_frags = 0;
+        pr->failed   = 0;
+
+        // still pending until the last fragment returns
+        pr->next = csdata->p_reqs;
+        csdata->p_reqs = pr;
+
+        xtask_ring_send_frags(csdata, pr);
+
+    } else if (rb->msg_type == 0x09 && pr != NULL) {
+        // fragment of large message passed all CS
+        struct mailbox *reg = pr->data;
+        struct p_kreply *kr;
+
+        pr->nr_frags--;
+
+        if (rb->status != 0x01) {
+          // recipient is gone, don't send the rest
+          pr->failed = 1;
+          pr->offset = reg->outbox.data_size;
+        }
+
+        if (pr->nr_frags > 0 || pr->offset < reg->outbox.data_size) {
+          pr->next = csdata->p_reqs;
+          csdata->p_reqs = pr;
+          xtask_ring_send_frags(csdata, pr);
+        } else {
+          // all fragments are back, unblock sender
+          kr = xtask_get_free_kreply(csdata, reg->kernel);
+
+          if (kr != NULL) {
+            kr->reply.cmd = 0x04;
+            kr->reply.p0  = reg->tid;
+            kr->reply.p1  = pr->failed;
+          
+            xtask_notify_kernel(reg->kernel);
+          }
+
+          free(pr);
+        }
+
+    } else if ((rb->msg_type == 0x03 || rb->msg_type == 0x08) && pr != NULL) {
+        // Task wants to send outbox to recipient on remote tile
+        // We have now received a reply
+
+        if (rb->status != 0x00) {
+          // the CS of the recipient has put its id in dest
+          xtask_mb_loc_set(csdata, ((struct mailbox *)pr->data)->outbox_dest, rb->dest);
+        }
+      
+        if (rb->status == 0x00 && rb->dest != 0) {
+          // the location in the directory was stale, search all CS
+          struct mailbox *reg = pr->data;
+
+          free(pr);
+          xtask_mb_loc_remove(csdata, reg->outbox_dest, rb->dest);
+          xtask_ring_send_outbox(csdata, reg);
+
+        } else if (rb->status == 0x00 || rb->status == 0x03) {
+          // recipient not found or large message does not fit in its inbox!
+         
+          struct p_kreply *kr;
+          struct mailbox *reg; 
+          
+          reg = pr->data;
+                    
+          // add kernel reply to queue and notify kernel
+          kr = xtask_get_free_kreply(csdata, reg->kernel);
+
+          if (kr != NULL) {
+            kr->reply.cmd = 0x04;
+            kr->reply.p0  = reg->tid;
+            kr->reply.p1  = 1; // return value, delivery failed
+          
+            xtask_notify_kernel(reg->kernel);
+          }
+          
+          // release pending ring bus reply
+          free(pr);
+          
+          
+        } else if (rb->status == 0x01) {
+          // message delivered
+          
+          struct mailbox *reg;
+          struct p_kreply *kr;      
+    
+          // get mailbox from pending ring bus reply
+          reg = pr->data;
+          free(pr);
+
+          // add kernel reply to queue and notify kernel
+          kr = xtask_get_free_kreply(csdata, reg->kernel);
+
+          if (kr != NULL) {
+            kr->reply.cmd = 0x04;
+            kr->reply.p0  = reg->tid;
+            kr->reply.p1  = 0; // return value, delivery succeeded
+          
+            xtask_notify_kernel(reg->kernel);
+          }
+
+        } else if (rb->status == 0x02) {
+          // recipient was found but was not ready to receive message
+          struct mailbox *reg;
+          struct mailbox **rpp;  
+                  
+          // get mailbox from pending ring bus reply
+          reg = pr->data;
+          free(pr);
+
+          // add mailbox to end of pending outbox list
+          rpp = &csdata->p_outbox;
+        
+          while (*rpp != NULL) {
+            rpp = &(*rpp)->p_next;
+          }
+
+          reg->p_next = *rpp;
+          *rpp = reg; 
+          
+        }
+    } else if (rb->msg_type == 0x04) {
+      // notified other CS that task is ready to receive, do nothing
+    } else if (rb->msg_type == 0x05 && pr != NULL) {
+      // multicast passed all CS, unblock sender with number of failures
+      unsigned int *pl = rb->payload;
+      struct p_kreply *kr;
+
+      kr = xtask_get_free_kreply(csdata, pr->kernel);
+
+      if (kr != NULL) {
+        kr->reply.cmd = 0x04;
+        kr->reply.p0  = pr->tid;
+        kr->reply.p1  = rb->status + pl[0] - pl[1];
+          
+        xtask_notify_kernel(pr->kernel);
+      }
+
+      free(pr);
+    } else if (rb->msg_type == 0x06 && pr != NULL) {
+      // publication passed all CS, unblock sender with number of failures
+      unsigned int *pl = rb->payload;
+      struct p_kreply *kr;
+
+      kr = xtask_get_free_kreply(csdata, pr->kernel);
+
+      if (kr != NULL) {
+        kr->reply.cmd = 0x04;
+        kr->reply.p0  = pr->tid;
+        kr->reply.p1  = pl[1];
+          
+        xtask_notify_kernel(pr->kernel);
+      }
+
+      free(pr);
+    }
+
+    // message has passed all CS, buffer can be used again
+    xtask_ring_free(csdata, rb);
+  } else {
+    // The received ring bus message originate from another CS
+    
+    if (rb->dest != 0 && rb->dest != csdata->id) {
+      // addressed to another CS, pass without looking at it
+    } else if (rb->msg_type == 0x0A) {
+      // mailbox created on another tile
+      xtask_mb_loc_set(csdata, *(unsigned int *)rb->payload, rb->cs_id);
+    } else if (rb->msg_type == 0x0B) {
+      // mailbox deleted on another tile
+      xtask_mb_loc_remove(csdata, *(unsigned int *)rb->payload, rb->cs_id);
+    } else if (rb->msg_type == 0x01) {
+      // used for testing ring bus connectivity
+      // add own CS id to payload and pass the message
+      unsigned int *up = (unsigned int *)rb->payload;
+      up += (rb->payload_size / 4);
+      *up = csdata->id;
+      rb->payload_size += 4;
+    } else if (rb->msg_type == 0x02) {
+      // create a new remote hardware thread
+      // only when the status is still 0 and the code is
+      // registered on this tile, otherwise some other 
+      // CS has already created the hardware thread and
+      // we just pass the message without taking action
+      if (rb->status == 0) {
+        unsigned int *pl = (unsigned int *)rb->payload;
+        chanend own_c;
+
+        own_c = xtask_hwt_start(csdata, pl[0], pl[1], pl[2], pl[3]);
+
+        if (own_c != 0) {
+          // return hardware thread chanend and this CS id
+          rb->payload_size = 8;
+          pl[0] = own_c;
+          pl[1] = csdata->id;
+          rb->status = 1; // other CS should not take action anymore
+        }
+      }
+    } else if (rb->msg_type == 0x0D) {
+      // a hardware thread started by this CS has ended
+      xtask_hwt_end(csdata, *(unsigned int *)rb->payload);
+    } else if (rb->msg_type == 0x0C) {
+      // looking for the least loaded CS for a new hardware thread
+      // payload: code, stack, args, chanend, best CS id, best score
+      unsigned int *pl = (unsigned int *)rb->payload;
+      unsigned int score = xtask_hwt_score(csdata, pl[0]);
+
+      if (score > pl[5]) {
+        pl[4] = csdata->id;
+        pl[5] = score;
+      }
+    } else if (rb->msg_type == 0x03 && rb->status == 0) {
+      // A task wants to send his outbox to a task on
+      // another tile.    
+      // message status: 0: not found yet 1: delivered 2: task not ready
+      unsigned int *pl;
+      unsigned int receiver;
+      struct mailbox *recv_mb;
+      
+      pl = rb->payload;
+      receiver = *pl;  // get the receiver from the payload
+      pl++;
+
+      // is receiver on this tile?
+      recv_mb = xtask_get_mailbox(csdata, receiver);
+
+      if (recv_mb != NULL) {
+        // found receiver on this tile, the sender learns where it is
+        rb->dest = csdata->id;
+        
+        if (xtask_mb_offer(csdata, recv_mb, pl, rb->payload_size-4)) {
+          // task was waiting for a message or the message is queued
+          rb->status = 1;       // indicate that message has been delivered
+          rb->payload_size = 0; // don't need to keep the message in the payload
+        } else {
+          // recipient is not ready to receive the message
+          recv_mb->inbox_state     |= INBOX_SENDER_PEND; // recipient will know that someone tried to send
+          rb->status       = 2; // indicate that the recipient is not ready
+          rb->payload_size = 0; // don't need to keep the message in the payload
+        }   
+      } 
+    } else if (rb->msg_type == 0x08 && rb->status == 0) {
+      // A task on another tile wants to send a message that is larger than
+      // the ring bus payload. Reserve the inbox if the recipient is here.
+      // message status: 0: not found yet 1: reserved 2: task not ready 3: too large
+      unsigned int *pl = rb->payload;
+      struct mailbox *recv_mb = xtask_get_mailbox(csdata, pl[0]);
+
+      if (recv_mb != NULL) {
+        rb->dest = csdata->id; // the sender learns where the recipient is
+
+        if (!(recv_mb->inbox_state & INBOX_TASK_WAITING)) {
+          recv_mb->inbox_state |= INBOX_SENDER_PEND; // recipient will know that someone tried to send
+          rb->status = 2;
+        } else if (recv_mb->inbox.buf_size < pl[1]) {
+          rb->status = 3;
+        } else {
+          // the fragments are copied straight into the inbox
+          recv_mb->inbox_state &= ~(INBOX_TASK_WAITING);
+          recv_mb->inbox_state |= INBOX_RECEIVING;
+          recv_mb->inbox.data_size = 0;
+          recv_mb->rx_cs   = rb->cs_id;
+          recv_mb->rx_req  = rb->req_id;
+          recv_mb->rx_size = pl[1];
+          rb->status = 1;
+        }
+      }
+    } else if (rb->msg_type == 0x09 && rb->status == 0) {
+      // fragment of large message: recipient, offset, data
+      unsigned int *pl = rb->payload;
+      unsigned int size = rb->payload_size - 8;
+      struct mailbox *recv_mb = xtask_get_mailbox(csdata, pl[0]);
+
+      if (recv_mb != NULL && (recv_mb->inbox_state & INBOX_RECEIVING) &&
+          recv_mb->rx_cs == rb->cs_id && recv_mb->rx_req == rb->req_id &&
+          pl[1] + size <= recv_mb->rx_size) {
+        struct p_kreply *kr;
+
+        memcpy((char *)recv_mb->inbox.data + pl[1], &pl[2], size);
+        recv_mb->inbox.data_size += size;
+
+        rb->status       = 1; // fragment delivered
+        rb->payload_size = 0; // don't need to keep the fragment in the payload
+
+        if (recv_mb->inbox.data_size == recv_mb->rx_size) {
+          // message complete, unblock recipient
+          recv_mb->inbox_state &= ~(INBOX_RECEIVING);
+          kr = xtask_get_free_kreply(csdata, recv_mb->kernel);
+
+          if (kr != NULL) {
+            kr->reply.cmd = 0x03;
+            kr->reply.p0  = recv_mb->tid;
+            kr->reply.p1  = (unsigned int) &recv_mb->inbox;   
+      
+            xtask_notify_kernel(recv_mb->kernel);
+          }
+        }
+      }
+    } else if (rb->msg_type == 0x05) {
+      // multicast from a task on another tile, deliver to our recipients
+      unsigned int *pl = rb->payload;
+      unsigned int nr = pl[0];
+      struct mailbox *recv_mb;
+      int i;
+
+      for (i = 0; i < nr; i++) {
+        recv_mb = xtask_get_mailbox(csdata, pl[2 + i]);
+
+        if (recv_mb != NULL && 
+            xtask_mb_offer(csdata, recv_mb, &pl[2 + nr], 
+                           rb->payload_size - 8 - nr * 4)) {
+          pl[1]++; // number of delivered recipients
+        }
+      }
+    } else if (rb->msg_type == 0x06) {
+      // publication from a task on another tile, deliver to our subscribers
+      unsigned int *pl = rb->payload;
+
+      pl[1] += xtask_topic_deliver(csdata, pl[0], &pl[2], rb->payload_size - 8);
+    } else if (rb->msg_type == 0x04) {
+      /* a receiver task is read, check if there are pending senders */
+      struct mailbox **rpp;
+      unsigned int recv_task = *(unsigned int *)rb->payload;
+
+      rpp = &csdata->p_outbox;
+
+      // try to find pending senders, routed senders wait for their own notification
+      while (*rpp != NULL) {
+            
+        if ((*rpp)->outbox_dest == recv_task && (*rpp)->outbox_cs == 0) {
+          // send pending sender task message through ring bus to recipient
+          xtask_ring_send_outbox(csdata, *rpp);
+
+          // remove mailbox from pending outboxes list
+          *rpp = (*rpp)->p_next;
+      
+          // don't set the pointer-pointer to the next element!
+        } else {
+          rpp = &(*rpp)->p_next;
+        }
+      }
+    } 
+    // we always pass a message (modified or not) that did not originate from this CS
+    xtask_ring_send(csdata, rb);
+  } 
+}
+
+/******************************************************************************
+ * Function:     xtask_hwt_score                                              *
+ * Parameters:   csdata  - Pointer to cs_data structure                       *
+ *               code    - Function number of hardware thread                 *
+ * Return:       free hardware threads in upper half, free chanends in lower  *
+ *               half, or 0 when the thread can not be started on this tile   *
+ *                                                                            *
+ *               Tell how well this tile can take a new hardware thread.      *
+ *               Free chanends are counted by allocating all of them. The     *
+ *               number of free hardware threads is an estimate, it counts    *
+ *               the CS, the kernels and the threads started by the CS but    *
+ *               not threads started from main.                               *
+ ******************************************************************************/
+unsigned int xtask_hwt_score(struct cs_data *csdata, unsigned int code)
+{
+  struct cs_kernel *k;
+  chanend c[NR_CHANENDS];
+  unsigned int used = 1 + csdata->nr_threads; // the CS itself
+  unsigned int nr_c = 0;
+  unsigned int i;
+
+  if (xtask_get_hwt_code(csdata, code) == NULL) {
+    return 0;
+  }
+
+  for (k = csdata->kernels; k != NULL; k = k->next) {
+    used++;
+  }
+
+  if (used >= NR_HW_THREADS) {
+    return 0;
+  }
+
+  while (nr_c < NR_CHANENDS && (c[nr_c] = _xtask_get_chanend()) != 0) {
+    nr_c++;
+  }
+
+  for (i = 0; i < nr_c; i++) {
+    _xtask_free_chanend(c[i]);
+  }
+
+  if (nr_c == 0) {
+    return 0;
+  }
+
+  return ((NR_HW_THREADS - used) << 16) | nr_c;
+}
+
+/******************************************************************************
+ * Function:     xtask_hwt_start                                              *
+ * Parameters:   csdata     - Pointer to cs_data structure                    *
+ *               code       - Function number of hardware thread              *
+ *               stackwords - Stack size in words                             *
+ *               args       - Argument of hardware thread                     *
+ *               cs_c       - chanend of CS of the task                       *
+ * Return:       chanend of the new hardware thread, 0 on failure             *
+ *                                                                            *
+ *               Start the hardware thread registered with the code on this   *
+ *               tile, connected to the chanend of the CS of the task.        *
+ ******************************************************************************/
+chanend xtask_hwt_start(struct cs_data *csdata, 
+                        unsigned int    code, 
+                        unsigned int    stackwords,
+                        unsigned int    args,
+                        unsigned int    cs_c)
+{
+  struct hwt_entry *hc;
+  struct hwt_stack *hs;
+  unsigned int *new_stack;
+  chanend own_c;
+
+  if (xtask_hwt_score(csdata, code) == 0 || stackwords == 0) {
+    return 0;
+  }
+
+  hc = xtask_get_hwt_code(csdata, code);
+  new_stack = (unsigned int *)malloc(stackwords * WORD_SIZE);
+  hs = (struct hwt_stack *)malloc(sizeof(struct hwt_stack));
+
+  if (new_stack == NULL || hs == NULL) {
+    free(new_stack);
+    free(hs);
+    return 0;
+  }
+
+  own_c = _xtask_get_chanend();
+  _xtask_set_chanend_dest(own_c, cs_c);
+        
+  _xtask_create_thread(hc->pc, (void*)(new_stack + (stackwords - 1)), (void*)args, own_c);
+  csdata->nr_threads++;
+
+  // remember the stack until the CS of the task ends the thread
+  hs->c     = own_c;
+  hs->stack = new_stack;
+  hs->next  = csdata->hwt_stacks;
+  csdata->hwt_stacks = hs;
+
+  return own_c;
+}
+
+/******************************************************************************
+ * Function:     xtask_hwt_end                                                *
+ * Parameters:   csdata  - Pointer to cs_data structure                       *
+ *               c       - chanend of the ended hardware thread               *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               A hardware thread started by code on this tile has been      *
+ *               ended by the CS of its task. The thread is parked and does   *
+ *               not use its stack anymore, so the stack is freed and the     *
+ *               thread no longer counts for xtask_hwt_score.                 *
+ ******************************************************************************/
+void xtask_hwt_end(struct cs_data *csdata, chanend c)
+{
+  struct hwt_stack **hpp;
+  struct hwt_stack *hs;
+
+  for (hpp = &csdata->hwt_stacks; *hpp != NULL; hpp = &(*hpp)->next) {
+    if ((*hpp)->c == c) {
+      hs = *hpp;
+      *hpp = hs->next;
+      free(hs->stack);
+      free(hs);
+      csdata->nr_threads--;
+      return;
+    }
+  }
+}
+
+/******************************************************************************
+ * Function:     xtask_hwt_connect                                            *
+ * Parameters:   csdata   - Pointer to cs_data structure                      *
+ *               vc       - Virtual channel of the new hardware thread        *
+ *               tid      - Task id of requesting task                        *
+ *               thread_c - chanend of the new hardware thread                *
+ *               host_cs  - CS id that started the thread                     *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Complete the virtual channel to a hardware thread started    *
+ *               by code and return the handle to the task.                   *
+ ******************************************************************************/
+void xtask_hwt_connect(struct cs_data *csdata, 
+                       struct vchan   *vc, 
+                       unsigned int    tid, 
+                       unsigned int    thread_c,
+                       unsigned int    host_cs)
+{
+  struct p_kreply *kr;
+
+  // we now have the destination chanend
+  vc->thread_chanend = thread_c;
+  vc->host_cs        = host_cs;
+  _xtask_set_chanend_dest(vc->own_chanend, vc->thread_chanend);
+
+  // initialise chan_event structure for the event vector
+  vc->event         =  (struct chan_event*) malloc(sizeof(struct chan_event));
+  vc->event->res    = vc->own_chanend;
+  vc->event->vector = (void *) _xtask_vc_vect;
+  vc->event->env    = (void *) vc;
+        
+  // set up and enable events from chanend
+  _xtask_set_chan_event((void*)vc->event);
+        
+  // add virtual channel to handle table and list
+  xtask_vc_register(csdata, vc);
+        
+  // add kernel reply to queue and notify kernel
+  kr = xtask_get_free_kreply(csdata, vc->kernel);
+
+  if (kr != NULL) {
+    kr->reply.cmd = 2;
+    kr->reply.p0  = vc->handle;
+    kr->reply.p1  = tid;
+    kr->reply.p2 = 0; // return value, succeeded
+          
+    xtask_notify_kernel(vc->kernel);
+  }
+}
+
+/******************************************************************************
+ * Function:     xtask_hwt_fail                                               *
+ * Parameters:   csdata   - Pointer to cs_data structure                      *
+ *               vc       - Virtual channel prepared for the hardware thread  *
+ *               tid      - Task id of requesting task                        *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Release the virtual channel and return handle 0 to the task. *
+ ******************************************************************************/
+void xtask_hwt_fail(struct cs_data *csdata, 
+                    struct vchan   *vc, 
+                    unsigned int    tid)
+{
+  struct p_kreply *kr;
+
+  // add kernel reply to queue and notify kernel
+  kr = xtask_get_free_kreply(csdata, vc->kernel);
+
+  if (kr != NULL) {
+    kr->reply.cmd = 2;
+    kr->reply.p0  = 0; // invalid handle
+    kr->reply.p1  = tid;
+    kr->reply.p2 = 1; // return value, failure
+        
+    xtask_notify_kernel(vc->kernel);
+  }
+
+  xtask_vc_free(vc);
+}
+
+/******************************************************************************
+ * Function:     xtask_link_send                                              *
+ * Parameters:   csdata  - Pointer to cs_data structure                       *
+ *               dest    - CS id of the destination                           *
+ * Return:       1 when the message is queued, 0 when there is no route       *
+ *                                                                            *
+ *               Queue a copy of the message in the routed message buffer for *
+ *               the next CS on the route to dest. The routed message buffer  *
+ *               can be reused at once.                                       *
+ ******************************************************************************/
+unsigned int xtask_link_send(struct cs_data *csdata, unsigned int dest)
+{
+  struct ring_buf *rbuf = csdata->rbuf;
+  struct ring_buf *rb;
+
+  if (dest >= csdata->nr_routes || csdata->route[dest] >= csdata->nr_links) {
+    return 0;
+  }
+
+  rb = xtask_ring_alloc(csdata);
+  rb->cs_id        = rbuf->cs_id;
+  rb->dest         = dest;
+  rb->msg_type     = rbuf->msg_type;
+  rb->status       = rbuf->status;
+  rb->payload_size = rbuf->payload_size;
+  memcpy(rb->payload, rbuf->payload, rbuf->payload_size);
+
+  xtask_link_queue(&csdata->links[csdata->route[dest]], rb);
+
+  return 1;
+}
+
+/******************************************************************************
+ * Function:     xtask_link_queue                                             *
+ * Parameters:   link    - Pointer to cs_link structure                       *
+ *               rb      - Routed message                                     *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Queue a message on a link and start sending it when no       *
+ *               other message is being sent on the link.                     *
+ ******************************************************************************/
+void xtask_link_queue(struct cs_link *link, struct ring_buf *rb)
+{
+  rb->next = NULL;
+
+  if (link->tx_head == NULL) {
+    link->tx_head = rb;
+    link->tx_tail = rb;
+    link->tx_word = 0;
+    xtask_link_tx_word(link); // link is idle, start sending
+  } else {
+    link->tx_tail->next = rb;
+    link->tx_tail = rb;
+  }
+}
+
+/******************************************************************************
+ * Function:     xtask_link_tx_word                                           *
+ * Parameters:   link    - Pointer to cs_link structure                       *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Send the next word of the oldest queued routed message. The  *
+ *               header is sent first: cs_id, dest, msg_type, status and      *
+ *               payload_size, followed by the payload. As on the ring bus    *
+ *               one word is outstanding at a time, so two CS that send to    *
+ *               each other at the same moment never wait for each other.     *
+ ******************************************************************************/
+void xtask_link_tx_word(struct cs_link *link)
+{
+  struct ring_buf *rb = link->tx_head;
+  unsigned int i = link->tx_word++;
+  unsigned int w;
+
+  switch (i) {
+    case 0:  w = rb->cs_id;        break;
+    case 1:  w = rb->dest;         break;
+    case 2:  w = rb->msg_type;     break;
+    case 3:  w = rb->status;       break;
+    case 4:  w = rb->payload_size; break;
+    default: w = ((unsigned int *)rb->payload)[i - LINK_HDR_WORDS]; break;
+  }
+
+  __asm__ volatile ("out res[%0], %1"::"r"(link->c_out),"r"(w));
+}
+
+/******************************************************************************
+ * Function:     xtask_link_tx_event                                          *
+ * Parameters:   link    - Pointer to cs_link structure                       *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Called by the event vector of c_out when the neighbour CS    *
+ *               has received a word. Sends the next word, or releases the    *
+ *               buffer and starts the next queued message when the message   *
+ *               is complete.                                                 *
+ ******************************************************************************/
+void xtask_link_tx_event(struct cs_link *link)
+{
+  struct ring_buf *rb = link->tx_head;
+
+  __asm__ volatile ("chkct res[%0], 0x01"::"r"(link->c_out));
+
+  if (link->tx_word < LINK_HDR_WORDS + (rb->payload_size + 3) / 4) {
+    xtask_link_tx_word(link);
+    return;
+  }
+
+  // message has been sent
+  link->tx_head = rb->next;
+  link->tx_word = 0;
+  xtask_ring_free(link->csdata, rb);
+
+  if (link->tx_head != NULL) {
+    xtask_link_tx_word(link);
+  }
+}
+
+/******************************************************************************
+ * Function:     xtask_link_receive                                           *
+ * Parameters:   link    - Pointer to cs_link structure                       *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Called by the event vector of a link. Receives one word of a *
+ *               routed message and acknowledges it. When the last word is    *
+ *               received the message is processed when this CS is the        *
+ *               destination, or queued for the next CS on the route.         *
+ ******************************************************************************/
+void xtask_link_receive(struct cs_link *link)
+{
+  struct cs_data *csdata = link->csdata;
+  struct ring_buf *rb;
+  unsigned int i;
+  unsigned int w;
+
+  if (link->rx_buf == NULL) {
+    link->rx_buf  = xtask_ring_alloc(csdata);
+    link->rx_word = 0;
+  }
+
+  rb = link->rx_buf;
+  i  = link->rx_word++;
+
+  __asm__ volatile ("in %0, res[%1]":"=r"(w):"r"(link->c_in));
+  __asm__ volatile ("outct res[%0], 0x01"::"r"(link->c_in));
+
+  switch (i) {
+    case 0:  rb->cs_id        = w; break;
+    case 1:  rb->dest         = w; break;
+    case 2:  rb->msg_type     = w; break;
+    case 3:  rb->status       = w; break;
+    case 4:  rb->payload_size = w; break;
+    default:
+      if (i - LINK_HDR_WORDS < RING_PAYLOAD_SIZE / 4) {
+        ((unsigned int *)rb->payload)[i - LINK_HDR_WORDS] = w;
+      }
+      break;
+  }
+
+  if (link->rx_word < LINK_HDR_WORDS ||
+      link->rx_word < LINK_HDR_WORDS + (rb->payload_size + 3) / 4) {
+    return; // more words to come
+  }
+
+  link->rx_buf = NULL;
+
+  if (rb->dest == csdata->id) {
+    // the received buffer becomes the routed message buffer
+    xtask_ring_free(csdata, csdata->rbuf);
+    csdata->rbuf = rb;
+    xtask_process_routed_msg(csdata);
+  } else if (rb->dest < csdata->nr_routes && csdata->route[rb->dest] < csdata->nr_links) {
+    xtask_link_queue(&csdata->links[csdata->route[rb->dest]], rb); // one hop closer
+  } else {
+    xtask_ring_free(csdata, rb); // no route, dropped
+  }
+}
+
+/******************************************************************************
+ * Function:     xtask_mb_route_send                                          *
+ * Parameters:   csdata  - Pointer to cs_data structure                       *
+ *               send_mb - Mailbox of the sending task, outbox_dest and       *
+ *                         outbox_cs hold the recipient.                      *
+ * Return:       1 when the message is sent, 0 when there is no route or the  *
+ *               message is too large                                         *
+ *                                                                            *
+ *               Send an outbox directly to the CS of the recipient.          *
+ ******************************************************************************/
+unsigned int xtask_mb_route_send(struct cs_data *csdata, struct mailbox *send_mb)
+{
+  unsigned int *pl = (unsigned int *)csdata->rbuf->payload;
+
+  if (8 + send_mb->outbox.data_size > RING_PAYLOAD_SIZE) {
+    return 0;
+  }
+
+  // payload: recipient mailbox id, sender mailbox id, message
+  pl[0] = send_mb->outbox_dest;
+  pl[1] = send_mb->id;
+  memcpy(&pl[2], send_mb->outbox.data, send_mb->outbox.data_size);
+
+  csdata->rbuf->cs_id        = csdata->id;
+  csdata->rbuf->msg_type     = 0x03;
+  csdata->rbuf->status       = 0;
+  csdata->rbuf->payload_size = 8 + send_mb->outbox.data_size;
+
+  return xtask_link_send(csdata, send_mb->outbox_cs);
+}
+
+/******************************************************************************
+ * Function:     xtask_process_routed_msg                                     *
+ * Parameters:   csdata  - Pointer to cs_data structure                       *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Process a routed message addressed to this CS. Replies are   *
+ *               routed back to the CS that sent the message.                 *
+ *                                                                            *
+ *               0x03: outbox for a local mailbox                             *
+ *               0x04: recipient mailbox of a pending send is ready           *
+ *               0x07: delivery status of an outbox sent with 0x03            *
+ ******************************************************************************/
+void xtask_process_routed_msg(struct cs_data *csdata)
+{
+  unsigned int *pl = (unsigned int *)csdata->rbuf->payload;
+  unsigned int src = csdata->rbuf->cs_id;
+  struct mailbox *mb;
+  struct p_kreply *kr;
+
+  if (csdata->rbuf->msg_type == 0x03) {
+    unsigned int status;
+    unsigned int sender = pl[1];
+
+    mb = xtask_get_mailbox(csdata, pl[0]);
+
+    if (mb == NULL) {
+      status = 0; // not found
+    } else if (xtask_mb_offer(csdata, mb, &pl[2], csdata->rbuf->payload_size - 8)) {
+      status = 1; // delivered or queued
+    } else {
+      struct p_remote *rs = malloc(sizeof(struct p_remote));
+
+      // remember the sender, its CS is told when the recipient is ready
+      rs->cs_id = src;
+      rs->mb_id = mb->id;
+      rs->next  = csdata->p_remote;
+      csdata->p_remote = rs;
+      status = 2; // not ready
+    }
+
+    csdata->rbuf->cs_id        = csdata->id;
+    csdata->rbuf->msg_type     = 0x07;
+    csdata->rbuf->status       = status;
+    csdata->rbuf->payload_size = 4;
+    pl[0] = sender;
+    xtask_link_send(csdata, src);
+
+  } else if (csdata->rbuf->msg_type == 0x07) {
+    mb = xtask_get_mailbox(csdata, pl[0]);
+
+    if (mb == NULL || mb->outbox_cs == 0) {
+      return; // sender is gone
+    }
+
+    if (csdata->rbuf->status != 0) {
+      xtask_mb_loc_set(csdata, mb->outbox_dest, src);
+    } else if (csdata->ring) {
+      // not on that tile (anymore), search all CS on the ring bus
+      xtask_mb_loc_remove(csdata, mb->outbox_dest, src);
+      mb->outbox_cs = 0;
+      xtask_ring_send_outbox(csdata, mb);
+      return;
+    }
+
+    if (csdata->rbuf->status == 2) {
+      struct mailbox **rpp;
+
+      // recipient not ready, wait in the list of pending outboxes
+      for (rpp = &csdata->p_outbox; *rpp != NULL; rpp = &(*rpp)->p_next);
+      mb->p_next = NULL;
+      *rpp = mb;
+      return;
+    }
+
+    kr = xtask_get_free_kreply(csdata, mb->kernel);
+
+    if (kr != NULL) {
+      kr->reply.cmd = 0x04;
+      kr->reply.p0  = mb->tid;
+      kr->reply.p1  = (csdata->rbuf->status == 1) ? 0 : 1; // delivered or not found
+      
+      xtask_notify_kernel(mb->kernel);
+    }
+
+    mb->outbox_cs = 0;
+
+  } else if (csdata->rbuf->msg_type == 0x04) {
+    unsigned int recipient = pl[0];
+    struct mailbox **rpp = &csdata->p_outbox;
+
+    // send again to the recipient, the reply comes with 0x07
+    while (*rpp != NULL) {
+      if ((*rpp)->outbox_dest == recipient && (*rpp)->outbox_cs == src) {
+        mb = *rpp;
+        *rpp = mb->p_next;
+        xtask_mb_route_send(csdata, mb);
+      } else {
+        rpp = &(*rpp)->p_next;
+      }
+    }
+  }
+}
+
+/******************************************************************************
+ * Function:     xtask_get_vchan                                              *
+ * Parameters:   csdata  - Pointer to cs_data structure                       *
+ *               handle  - virtual channel handle                             *
+ * Return:       pointer to struct vchan, or NULL when the handle is invalid  *
+ *                                                                            *
+ *               Find the virtual channel given its handle. Handles index     *
+ *               the virtual channel table directly.                          *
+ ******************************************************************************/
+struct vchan * xtask_get_vchan(struct cs_data * csdata, 
+                               unsigned int     handle)
+{
+  if (handle == 0 || handle > csdata->nr_vchans) {
+    return NULL;
+  }
+
+  return csdata->vc_table[handle];
+}
+
+/******************************************************************************
+ * Function:     xtask_vc_register                                            *
+ * Parameters:   csdata  - Pointer to cs_data structure                       *
+ *               vc      - new virtual channel                                *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Give a new virtual channel the next free handle and add it   *
+ *               to the handle table and the list of virtual channels.        *
+ ******************************************************************************/
+void xtask_vc_register(struct cs_data * csdata, 
+                       struct vchan   * vc)
+{
+  if (csdata->nr_vchans + 1 >= csdata->vc_table_size) {
+    csdata->vc_table_size = (csdata->vc_table_size == 0) ? 8 : csdata->vc_table_size * 2;
+    csdata->vc_table = realloc(csdata->vc_table, 
+                               csdata->vc_table_size * sizeof(struct vchan *));
+  }
+
+  vc->handle = ++csdata->nr_vchans;
+  csdata->vc_table[vc->handle] = vc;
+
+  vc->next = csdata->vchans;
+  csdata->vchans = vc;
+}
+
+/******************************************************************************
+ * Function:     xtask_vc_nr_bufs                                             *
+ * Parameters:   obj_size - object size, number of buffers in upper half      *
+ * Return:       number of buffers in each buffer ring                        *
+ *                                                                            *
+ *               Get the number of buffers requested by the task, within the  *
+ *               limits of a buffer ring.                                     *
+ ******************************************************************************/
+unsigned int xtask_vc_nr_bufs(unsigned int obj_size)
+{
+  unsigned int n = (obj_size >> VC_BUFS_SHIFT) & ~VC_MODE_MASK;
+
+  if (n == 0) {
+    n = VC_DEFAULT_BUFS; // double buffering
+  } else if (n < VC_MIN_BUFS) {
+    n = VC_MIN_BUFS;
+  } else if (n > VC_MAX_BUFS) {
+    n = VC_MAX_BUFS;
+  }
+
+  return n;
+}
+
+/******************************************************************************
+ * Function:     xtask_vc_alloc_bufs                                          *
+ * Parameters:   vc       - new virtual channel                               *
+ *               obj_size - object size, number of buffers in upper half      *
+ *               rx_size  - size of each read buffer                          *
+ *               tx_size  - size of each write buffer                         *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Allocate the read and write buffer rings of a new virtual    *
+ *               channel. The buffers get a reference back to the virtual     *
+ *               channel, so a buffer passed by a task leads to its channel   *
+ *               directly.                                                    *
+ ******************************************************************************/
+void xtask_vc_alloc_bufs(struct vchan * vc,
+                         unsigned int   obj_size,
+                         unsigned int   rx_size,
+                         unsigned int   tx_size)
+{
+  unsigned int n = xtask_vc_nr_bufs(obj_size);
+  int i;
+
+  vc->obj_size   = obj_size & VC_OBJ_MASK;
+  vc->stream     = (obj_size >> VC_BUFS_SHIFT) & VC_MODE_MASK;
+  vc->rx_len     = 0;
+  vc->nr_bufs    = n;
+  vc->read_bufs  = malloc(n * sizeof(struct vc_buf));
+  vc->write_bufs = malloc(n * sizeof(struct vc_buf));
+
+  for (i = 0; i < n; i++) {
+    vc->read_bufs[i].data       = malloc(rx_size);
+    vc->read_bufs[i].buf_size   = rx_size;
+    vc->read_bufs[i].data_size  = 0;
+    vc->read_bufs[i].vc         = vc;
+    vc->read_bufs[i].nr         = i;
+    vc->write_bufs[i].data      = malloc(tx_size);
+    vc->write_bufs[i].buf_size  = tx_size;
+    vc->write_bufs[i].data_size = 0;
+    vc->write_bufs[i].vc        = vc;
+    vc->write_bufs[i].nr        = i;
+  }
+
+  if (vc->stream & VC_SHM) {
+    // the rings are shared with the hardware thread
+    vc->shm             = malloc(sizeof(struct vc_shm));
+    vc->shm->read_bufs  = vc->read_bufs;
+    vc->shm->write_bufs = vc->write_bufs;
+    vc->shm->nr_bufs    = n;
+  } else {
+    vc->shm = NULL;
+  }
+
+  xtask_vc_reset(vc);
+}
+
+/******************************************************************************
+ * Function:     xtask_vc_reset                                               *
+ * Parameters:   vc       - virtual channel                                   *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Empty the buffer rings of a virtual channel.                 *
+ ******************************************************************************/
+void xtask_vc_reset(struct vchan *vc)
+{
+  int i;
+
+  for (i = 0; i < vc->nr_bufs; i++) {
+    vc->read_bufs[i].data_size  = 0;
+    vc->write_bufs[i].data_size = 0;
+  }
+
+  vc->rx_len    = 0;
+  vc->rd_head   = 0;
+  vc->rd_fill   = 0;
+  vc->rd_filled = 0;
+  vc->rd_task   = VC_NO_BUF;
+  vc->wr_head   = 0;
+  vc->wr_queued = 0;
+  vc->wr_task   = VC_NO_BUF;
+  vc->tx_state  = VC_TX_IDLE;
+  vc->tx_offset = 0;
+
+  if (vc->shm != NULL) {
+    vc->shm->rd_put  = 0;
+    vc->shm->rd_get  = 0;
+    vc->shm->wr_put  = 0;
+    vc->shm->wr_get  = 0;
+    vc->shm->rd_wait = 0;
+    vc->shm->wr_wait = 0;
+    vc->shm->rd_seen = 0;
+    vc->shm->wr_done = 0;
+  }
+}
+
+/******************************************************************************
+ * Function:     xtask_vc_bufs_fit                                            *
+ * Parameters:   vc       - virtual channel of parked thread                  *
+ *               obj_size - object size, number of buffers in upper half      *
+ *               rx_size  - size of each read buffer                          *
+ *               tx_size  - size of each write buffer                         *
+ * Return:       1 if the buffer rings can be used as they are, 0 otherwise   *
+ *                                                                            *
+ *               Check if a new thread uses the same buffer rings.            *
+ ******************************************************************************/
+unsigned int xtask_vc_bufs_fit(struct vchan * vc,
+                               unsigned int   obj_size,
+                               unsigned int   rx_size,
+                               unsigned int   tx_size)
+{
+  return vc->nr_bufs  == xtask_vc_nr_bufs(obj_size) &&
+         vc->obj_size == (obj_size & VC_OBJ_MASK) &&
+         vc->stream   == ((obj_size >> VC_BUFS_SHIFT) & VC_MODE_MASK) &&
+         vc->read_bufs[0].buf_size  == rx_size &&
+         vc->write_bufs[0].buf_size == tx_size;
+}
+
+/******************************************************************************
+ * Function:     xtask_vc_free_bufs                                           *
+ * Parameters:   vc       - virtual channel                                   *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Free the buffer rings of a virtual channel.                  *
+ ******************************************************************************/
+void xtask_vc_free_bufs(struct vchan *vc)
+{
+  int i;
+
+  for (i = 0; i < vc->nr_bufs; i++) {
+    free(vc->read_bufs[i].data);
+    free(vc->write_bufs[i].data);
+  }
+
+  free(vc->read_bufs);
+  free(vc->write_bufs);
+  free(vc->shm);
+}
+
+/******************************************************************************
+ * Function:     xtask_vc_free                                                *
+ * Parameters:   vc      - virtual channel                                    *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Release a virtual channel that has not been registered,      *
+ *               because its hardware thread could not be started.            *
+ ******************************************************************************/
+void xtask_vc_free(struct vchan *vc)
+{
+  xtask_vc_free_bufs(vc);
+
+  if (vc->own_chanend != 0) {
+    _xtask_free_chanend(vc->own_chanend);
+  }
+
+  free(vc);
+}
+
+/******************************************************************************
+ * Function:     xtask_vc_take_rd_buf                                         *
+ * Parameters:   vc      - Pointer to vchan structure                         *
+ * Return:       read buffer for the task, or NULL when there is no           *
+ *               (sufficient) data                                            *
+ *                                                                            *
+ *               Hand the oldest completely filled read buffer to the task.   *
+ *               When no buffer is completely filled, the buffer that CS is   *
+ *               filling is handed over if it holds at least the minimum      *
+ *               amount of data of the task. If the minimum amount is 0, or   *
+ *               in shared-memory mode, only completely filled buffers are    *
+ *               handed over.                                                 *
+ ******************************************************************************/
+struct vc_buf * xtask_vc_take_rd_buf(struct vchan *vc)
+{
+  if (vc->rd_filled > 0) {
+    vc->rd_task = vc->rd_head;
+    vc->rd_filled--;
+  } else if (vc->min_read_size > 0 &&
+             vc->shm == NULL &&
+             vc->rd_task == VC_NO_BUF &&
+             vc->read_bufs[vc->rd_fill].data_size >= vc->min_read_size) {
+    // CS has partially filled the buffer and it meets the amount requirement,
+    // CS continues with the next buffer
+    vc->rd_task = vc->rd_fill;
+    vc->rd_fill = (vc->rd_fill + 1) % vc->nr_bufs;
+  } else {
+    return NULL;
+  }
+
+  vc->rd_head = (vc->rd_task + 1) % vc->nr_bufs;
+
+  return &vc->read_bufs[vc->rd_task];
+}
+
+/******************************************************************************
+ * Function:     xtask_get_mailbox                                            *
+ * Parameters:   csdata  - Pointer to cs_data structure                       *
+ *               id      - mailbox id                                         *
+ * Return:       pointer to struct mailbox, or NULL when mailbox              *
+ *               could not be found                                           *
+ *                                                                            *
+ *               Find the mailbox given the mailbox id. The index is an open  *
+ *               addressing hash table with linear probing, the load is kept  *
+ *               below 70% so a lookup probes only a few slots.               *
+ ******************************************************************************/
+struct mailbox * xtask_get_mailbox(struct cs_data * csdata, 
+                                   unsigned int     id)
+{
+  unsigned int i = (id * 2654435761u) >> (32 - csdata->mb_bits);
+  struct mailbox *temp_mb;
+
+  while ((temp_mb = csdata->mb_slots[i]) != NULL) {
+    if (temp_mb != MB_TOMBSTONE && temp_mb->id == id) {
+      return temp_mb;
+    }
+
+    i = (i + 1) & (csdata->mb_size - 1);
+  }
+
+  return NULL;
+}
+
+/******************************************************************************
+ * Function:     xtask_mb_index_resize                                        *
+ * Parameters:   csdata  - Pointer to cs_data structure                       *
+ *               bits    - log2 of the new number of slots                    *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Rebuild the mailbox index with 2^bits slots from the list    *
+ *               of all mailboxes. This also drops all tombstones.            *
+ ******************************************************************************/
+void xtask_mb_index_resize(struct cs_data * csdata, 
+                           unsigned int     bits)
+{
+  struct mailbox *temp_mb;
+
+  free(csdata->mb_slots);
+
+  csdata->mb_bits   = bits;
+  csdata->mb_size   = 1 << bits;
+  csdata->mb_used   = 0;
+  csdata->mb_filled = 0;
+  csdata->mb_slots  = calloc(csdata->mb_size, sizeof(struct mailbox *));
+
+  for (temp_mb = csdata->mailboxes; temp_mb != NULL; temp_mb = temp_mb->next) {
+    xtask_mb_index_insert(csdata, temp_mb);
+  }
+}
+
+/******************************************************************************
+ * Function:     xtask_mb_index_insert                                        *
+ * Parameters:   csdata  - Pointer to cs_data structure                       *
+ *               mb      - mailbox to add, the id must not be in the index    *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Add a mailbox to the index. The index grows when more than   *
+ *               70% of the slots is used, it is rebuilt at the same size     *
+ *               when most of the used slots are tombstones.                  *
+ ******************************************************************************/
+void xtask_mb_index_insert(struct cs_data * csdata, 
+                           struct mailbox * mb)
+{
+  unsigned int i;
+
+  if ((csdata->mb_filled + 1) * 10 > csdata->mb_size * 7) {
+    if ((csdata->mb_used + 1) * 10 > csdata->mb_size * 7 / 2) {
+      xtask_mb_index_resize(csdata, csdata->mb_bits + 1);
+    } else {
+      xtask_mb_index_resize(csdata, csdata->mb_bits);
+    }
+
+    // the resize has indexed the list, which may already contain mb
+    if (xtask_get_mailbox(csdata, mb->id) == mb) {
+      return;
+    }
+  }
+
+  i = (mb->id * 2654435761u) >> (32 - csdata->mb_bits);
+
+  while (csdata->mb_slots[i] != NULL && csdata->mb_slots[i] != MB_TOMBSTONE) {
+    i = (i + 1) & (csdata->mb_size - 1);
+  }
+
+  if (csdata->mb_slots[i] == NULL) {
+    csdata->mb_filled++;
+  }
+
+  csdata->mb_slots[i] = mb;
+  csdata->mb_used++;
+}
+
+/******************************************************************************
+ * Function:     xtask_mb_index_remove                                        *
+ * Parameters:   csdata  - Pointer to cs_data structure                       *
+ *               mb      - mailbox to remove                                  *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Remove a mailbox from the index. The slot becomes a          *
+ *               tombstone so the probe sequences of other ids stay intact.   *
+ ******************************************************************************/
+void xtask_mb_index_remove(struct cs_data * csdata, 
+                           struct mailbox * mb)
+{
+  unsigned int i = (mb->id * 2654435761u) >> (32 - csdata->mb_bits);
+
+  while (csdata->mb_slots[i] != NULL) {
+    if (csdata->mb_slots[i] == mb) {
+      csdata->mb_slots[i] = MB_TOMBSTONE;
+      csdata->mb_used--;
+      return;
+    }
+
+    i = (i + 1) & (csdata->mb_size - 1);
+  }
+}
+
+/******************************************************************************
+ * Function:     xtask_mb_loc_get                                             *
+ * Parameters:   csdata  - Pointer to cs_data structure                       *
+ *               id      - Mailbox id                                         *
+ * Return:       CS id of the tile of the mailbox, 0 when unknown             *
+ *                                                                            *
+ *               Look up a mailbox on another tile in the mailbox directory.  *
+ ******************************************************************************/
+unsigned int xtask_mb_loc_get(struct cs_data * csdata, 
+                              unsigned int     id)
+{
+  struct mb_location *loc;
+
+  loc = csdata->mb_locs[(id * 2654435761u) % MB_LOC_BUCKETS];
+
+  for (; loc != NULL; loc = loc->next) {
+    if (loc->id == id) {
+      return loc->cs_id;
+    }
+  }
+
+  return 0;
+}
+
+/******************************************************************************
+ * Function:     xtask_mb_loc_set                                             *
+ * Parameters:   csdata  - Pointer to cs_data structure                       *
+ *               id      - Mailbox id                                         *
+ *               cs_id   - CS id of the tile of the mailbox                   *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Add or update a mailbox location in the mailbox directory.   *
+ ******************************************************************************/
+void xtask_mb_loc_set(struct cs_data * csdata, 
+                      unsigned int     id, 
+                      unsigned int     cs_id)
+{
+  struct mb_location **bucket = &csdata->mb_locs[(id * 2654435761u) % MB_LOC_BUCKETS];
+  struct mb_location *loc;
+
+  if (cs_id == 0 || cs_id == csdata->id) {
+    return;
+  }
+
+  for (loc = *bucket; loc != NULL; loc = loc->next) {
+    if (loc->id == id) {
+      loc->cs_id = cs_id;
+      return;
+    }
+  }
+
+  loc        = malloc(sizeof(struct mb_location));
+  loc->id    = id;
+  loc->cs_id = cs_id;
+  loc->next  = *bucket;
+  *bucket    = loc;
+}
+
+/******************************************************************************
+ * Function:     xtask_mb_loc_remove                                          *
+ * Parameters:   csdata  - Pointer to cs_data structure                       *
+ *               id      - Mailbox id                                         *
+ *               cs_id   - CS id that no longer has the mailbox               *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Remove a mailbox location from the mailbox directory, only   *
+ *               when it still refers to cs_id. A newer location is kept.     *
+ ******************************************************************************/
+void xtask_mb_loc_remove(struct cs_data * csdata, 
+                         unsigned int     id, 
+                         unsigned int     cs_id)
+{
+  struct mb_location **lpp = &csdata->mb_locs[(id * 2654435761u) % MB_LOC_BUCKETS];
+
+  for (; *lpp != NULL; lpp = &(*lpp)->next) {
+    if ((*lpp)->id == id) {
+      struct mb_location *loc = *lpp;
+
+      if (loc->cs_id == cs_id) {
+        *lpp = loc->next;
+        free(loc);
+      }
+
+      return;
+    }
+  }
+}
+
+/******************************************************************************
+ * Function:     xtask_mb_loc_announce                                        *
+ * Parameters:   csdata   - Pointer to cs_data structure                      *
+ *               msg_type - 0x0A mailbox created, 0x0B mailbox deleted        *
+ *               id       - Mailbox id                                        *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Tell all CS on the ring bus that a mailbox was created or    *
+ *               deleted on this tile, so they update their directory.        *
+ ******************************************************************************/
+void xtask_mb_loc_announce(struct cs_data * csdata, 
+                           unsigned int     msg_type, 
+                           unsigned int     id)
+{
+  struct ring_buf *rb;
 
-        // we now have the destination chanend
-        vc->thread_chanend = *pl;
-        _xtask_set_chanend_dest(vc->own_chanend, vc->thread_chanend);
+  if (!csdata->ring) {
+    return;
+  }
 
-        vc->handle = vc->thread_chanend;
-        
-        // initialise chan_event structure for the event vector
-        vc->event         =  (struct chan_event*) malloc(sizeof(struct chan_event));
-        vc->event->res    = vc->own_chanend;
-        vc->event->vector = (void *) _xtask_vc_vect;
-        vc->event->env    = (void *) vc;
-        
-        // set up and enable events from chanend
-        _xtask_set_chan_event((void*)vc->event);
-        
-        // add virtual channel to the list
-        vc->next = csdata->vchans;
-        csdata->vchans = vc;
-        
-        pr = csdata->p_reqs;
-        
-        // add kernel reply to queue and notify kernel
-        kr = xtask_get_free_kreply(csdata);
+  rb = xtask_ring_alloc(csdata);
+  rb->cs_id        = csdata->id;
+  rb->msg_type     = msg_type;
+  rb->status       = 0;
+  rb->payload_size = 4;
+  *(unsigned int *)rb->payload = id;
 
-        if (kr != NULL) {
-          kr->state    |= KR_USED;
-          kr->k         = vc->kernel;
-          kr->reply.cmd = 2;
-          kr->reply.p0  = vc->thread_chanend;
-          kr->reply.p1  = pr->tid;
-          kr->reply.p2 = 0; // return value, succeeded
-          
-          _xtask_notify_kernel(vc->kernel->c_async);
-        }
-        
-        // remove pending ring bus reply from list and release memory
-        csdata->p_reqs = csdata->p_reqs->next;
-        free((void *)pr);
-        
-    } else if (csdata->rbuf->msg_type == 0x03) {
-        // Task wants to send outbox to recipient on remote tile
-        // We have now received a reply
-      
-        if (csdata->rbuf->status == 0x00) {
-          // recipient not found!
-         
-          struct p_request *pr;
-          struct p_kreply *kr;
-          struct mailbox *reg; 
-          
-          pr = csdata->p_reqs;
-          reg = pr->data;
-                    
-          // add kernel reply to queue and notify kernel
-          kr = xtask_get_free_kreply(csdata);
+  xtask_ring_send(csdata, rb);
+}
 
-          if (kr != NULL) {
-            kr->state    |= KR_USED;
-            kr->k         = reg->kernel;
-            kr->reply.cmd = 0x04;
-            kr->reply.p0  = reg->tid;
-            kr->reply.p1  = 1; // return value, delivery failed
-          
-            _xtask_notify_kernel(reg->kernel->c_async);
-          }
-          
-          // remove pending ring bus reply from list and free memory
-          csdata->p_reqs = csdata->p_reqs->next;
-          free(pr);
-          
-          
-        } else if (csdata->rbuf->status == 0x01) {
-          // message delivered
-          
-          struct p_request *pr;
-          struct mailbox *reg;
-          struct p_kreply *kr;      
-    
-          // get mailbox from pending ring bus replies list
-          pr = csdata->p_reqs;
-          reg = pr->data;
+/******************************************************************************
+ * Function:     xtask_mb_move                                                *
+ * Parameters:   dst     - Buffer to move the message to.                     *
+ *               src     - Buffer holding the message.                        *
+ * Return:       1 when the message is moved, 0 when it does not fit in dst   *
+ *                                                                            *
+ *               Move a message between mailbox buffers on the same tile.     *
+ *               When the buffers have the same size the ownership of the     *
+ *               buffers is swapped instead of copying the message, src then  *
+ *               gets the old buffer of dst. This is only allowed when the    *
+ *               tasks do not use the buffers, e.g. when both are blocked.    *
+ ******************************************************************************/
+unsigned int xtask_mb_move(struct vc_buf *dst, struct vc_buf *src)
+{
+  void *data;
 
-          // remove pending reply from list
-          csdata->p_reqs = csdata->p_reqs->next;
-          free(pr);
+  if (src->data_size > dst->buf_size) {
+    return 0;
+  }
 
-          // add kernel reply to queue and notify kernel
-          kr = xtask_get_free_kreply(csdata);
+  if (src->buf_size == dst->buf_size) {
+    data = dst->data;
+    dst->data = src->data;
+    src->data = data;
+  } else {
+    memcpy(dst->data, src->data, src->data_size);
+  }
 
-          if (kr != NULL) {
-            kr->state    |= KR_USED;
-            kr->k         = reg->kernel;
-            kr->reply.cmd = 0x04;
-            kr->reply.p0  = reg->tid;
-            kr->reply.p1  = 0; // return value, delivery succeeded
-          
-            _xtask_notify_kernel(reg->kernel->c_async);
-          }
+  dst->data_size = src->data_size;
 
-        } else if (csdata->rbuf->status == 0x02) {
-          // recipient was found but was not ready to receive message
-          struct p_request *pr;
-          struct mailbox *reg;
-          struct mailbox **rpp;  
-                  
-          // get mailbox from pending ring bus reply list
-          pr = csdata->p_reqs;
-          reg = pr->data;
+  return 1;
+}
 
-          // remove pending ring bus reply from list and free memory
-          csdata->p_reqs = csdata->p_reqs->next;
-          free(pr);
+/******************************************************************************
+ * Function:     xtask_mb_queue_put                                           *
+ * Parameters:   mb      - Mailbox of the recipient.                          *
+ *               msg     - Buffer holding the message.                        *
+ * Return:       1 when the message is queued, 0 when the mailbox has no      *
+ *               queue, the queue is full or the message does not fit.        *
+ *                                                                            *
+ *               Add a message to the message queue of a mailbox.             *
+ ******************************************************************************/
+unsigned int xtask_mb_queue_put(struct mailbox *mb, struct vc_buf *msg)
+{
+  if (mb->q_count == mb->q_depth ||
+      !xtask_mb_move(&mb->queue[(mb->q_head + mb->q_count) % mb->q_depth], msg)) {
+    return 0;
+  }
 
-          // add mailbox to end of pending outbox list
-          rpp = &csdata->p_outbox;
-        
-          while (*rpp != NULL) {
-            rpp = &(*rpp)->p_next;
-          }
+  mb->q_count++;
 
-          reg->p_next = *rpp;
-          *rpp = reg; 
-          
-        }
-    } else if (csdata->rbuf->msg_type == 0x04) {
-      // notified other CS that task is ready to receive, do nothing
-    }
-  } else {
-    // The received ring bus message originate from another CS
-    
-    if (csdata->rbuf->msg_type == 0x01) {
-      // used for testing ring bus connectivity
-      // add own CS id to payload and pass the message
-      unsigned int *up = (unsigned int *)csdata->rbuf->payload;
-      up += (csdata->rbuf->payload_size / 4);
-      *up = csdata->id;
-      csdata->rbuf->payload_size += 4;
-    } else if (csdata->rbuf->msg_type == 0x02) {
-      // create a new remote hardware thread
-      // only when the status is still 0
-      // otherwise some other CS has already
-      // created the hardware thread and we just
-      // pass the message without taking action
-      if (csdata->rbuf->status == 0) {
-        unsigned int code;
-        unsigned int stacksize;
-        unsigned int cs_c;
-        chanend own_c;
-        unsigned int *pl = (unsigned int *)csdata->rbuf->payload;
-        code = *pl++;
-        stacksize = *pl++;
-        cs_c = *pl;
+  return 1;
+}
 
-        unsigned int * new_stack = (unsigned int *)malloc(128 * WORD_SIZE);
-        void * new_sp = (void*) (new_stack + (128 - 1));
+/******************************************************************************
+ * Function:     xtask_mb_queue_get                                           *
+ * Parameters:   mb      - Mailbox of the recipient.                          *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Move the oldest queued message of a mailbox to its inbox.    *
+ *               The queue must not be empty. The queue buffers have the size *
+ *               of the inbox so this never copies the message.               *
+ ******************************************************************************/
+void xtask_mb_queue_get(struct mailbox *mb)
+{
+  xtask_mb_move(&mb->inbox, &mb->queue[mb->q_head]);
+  mb->q_head = (mb->q_head + 1) % mb->q_depth;
+  mb->q_count--;
+}
 
-        own_c = _xtask_get_chanend();
-        _xtask_set_chanend_dest(own_c, cs_c);
-        
-        _xtask_create_thread((void*)test_hardware_thread, (void*)new_sp, (void*)0, own_c);
+/******************************************************************************
+ * Function:     xtask_mb_offer                                               *
+ * Parameters:   csdata  - Pointer to cs_data structure.                      *
+ *               mb      - Mailbox of the recipient.                          *
+ *               data    - Message.                                           *
+ *               size    - Message size in bytes.                             *
+ * Return:       1 when the message is delivered or queued, 0 when the        *
+ *               recipient is busy or the message does not fit its inbox.     *
+ *                                                                            *
+ *               Copy a message to a recipient that waits for a message or    *
+ *               that has room in its queue. Used when the sender can not     *
+ *               hand over its buffer, for ring bus and multicast messages.   *
+ ******************************************************************************/
+unsigned int xtask_mb_offer(struct cs_data * csdata,
+                            struct mailbox * mb,
+                            void *           data,
+                            unsigned int     size)
+{
+  struct p_kreply *kr;
+  struct vc_buf msg;
 
-        // return hardware thread chanend
-        csdata->rbuf->payload_size = 4;
-        pl = (unsigned int *)csdata->rbuf->payload;
-        *pl = own_c;
-        csdata->rbuf->status = 1; // other CS should not take action anymore
+  if (size > mb->inbox.buf_size) {
+    return 0; // queue buffers have the size of the inbox too
+  }
 
-      }
-    } else if (csdata->rbuf->msg_type == 0x03 && csdata->rbuf->status == 0) {
-      // A task wants to send his outbox to a task on
-      // another tile.    
-      // message status: 0: not found yet 1: delivered 2: task not ready
-      unsigned int *pl;
-      unsigned int receiver;
-      struct mailbox *recv_mb;
-      
-      pl = csdata->rbuf->payload;
-      receiver = *pl;  // get the receiver from the payload
-      pl++;
+  if (mb->inbox_state & INBOX_TASK_WAITING) {
+    memcpy(mb->inbox.data, data, size);
+    mb->inbox.data_size = size;
 
-      // is receiver on this tile?
-      recv_mb = xtask_get_mailbox(csdata, receiver);
+    // task not waiting anymore after this
+    mb->inbox_state &= ~(INBOX_TASK_WAITING);
 
-      if (recv_mb != NULL) {
-        // found receiver on this tile
-        
-        if (recv_mb->inbox_state & INBOX_TASK_WAITING) {
-          // task is waiting for a message
-          
-          struct p_kreply *kr;
+    kr = xtask_get_free_kreply(csdata, mb->kernel);
 
-          // copy message from ring bus to recipient inbox
-          memcpy(recv_mb->inbox.data, pl, csdata->rbuf->payload_size-4);
-          recv_mb->inbox.data_size = csdata->rbuf->payload_size-4;
+    // add pending kernel reply and notify kernel
+    if (kr != NULL) {
+      kr->reply.cmd = 0x03;
+      kr->reply.p0  = mb->tid;
+      kr->reply.p1  = (unsigned int) &mb->inbox;   
+      
+      xtask_notify_kernel(mb->kernel);
+    }
 
-          // task not waiting anymore after this
-          recv_mb->inbox_state &= ~(INBOX_TASK_WAITING);
-        
-          kr = xtask_get_free_kreply(csdata);
+    return 1;
+  }
 
-          // add pending kernel reply and notify kernel
-          if (kr != NULL) {
-            kr->state    |= KR_USED;
-            kr->k         = recv_mb->kernel;
-            kr->reply.cmd = 0x03;
-            kr->reply.p0  = recv_mb->tid;
-            kr->reply.p1  = (unsigned int) &recv_mb->inbox;   
-            
-            _xtask_notify_kernel(recv_mb->kernel->c_async);
-          }
+  msg.data      = data;
+  msg.buf_size  = 0; // not a mailbox buffer, always copy
+  msg.data_size = size;
 
-          csdata->rbuf->status = 1;       // indicate that message has been delivered
-          csdata->rbuf->payload_size = 0; // don't need to keep the message in the payload
-        } else {
-          // recipient is not ready to receive the message
-          recv_mb->inbox_state     |= INBOX_SENDER_PEND; // recipient will know that someone tried to send
-          csdata->rbuf->status       = 2; // indicate that the recipient is not ready
-          csdata->rbuf->payload_size = 0; // don't need to keep the message in the payload
-        }   
-      } 
-    } else if (csdata->rbuf->msg_type == 0x04) {
-      /* a receiver task is read, check if there are pending senders */
-      struct mailbox **rpp;
-      unsigned int *pl;
-      unsigned int rbuf_cs_id, rbuf_msg_type, rbuf_status, 
-                   rbuf_payload_size, rbuf_recv_task, state;
+  return xtask_mb_queue_put(mb, &msg);
+}
 
-      // copy the ring bus buffer, 
-      // because we might create new bus messages before passing this one
-      rbuf_cs_id        = csdata->rbuf->cs_id;
-      rbuf_msg_type     = csdata->rbuf->msg_type;
-      rbuf_status       = csdata->rbuf->status;
-      rbuf_payload_size = csdata->rbuf->payload_size;
-      pl                = csdata->rbuf->payload;
-      rbuf_recv_task    = *pl;
+/******************************************************************************
+ * Function:     xtask_topic_deliver                                          *
+ * Parameters:   csdata  - Pointer to cs_data structure.                      *
+ *               topic   - Topic id.                                          *
+ *               data    - Message.                                           *
+ *               size    - Message size in bytes.                             *
+ * Return:       number of subscribers that did not get the message           *
+ *                                                                            *
+ *               Offer a published message to the subscribers of a topic on   *
+ *               this tile.                                                   *
+ ******************************************************************************/
+unsigned int xtask_topic_deliver(struct cs_data * csdata,
+                                 unsigned int     topic,
+                                 void *           data,
+                                 unsigned int     size)
+{
+  struct subscription *sub;
+  unsigned int failed = 0;
 
-      state = 0; // indicates whether we modified the original message, 0 means no      
+  for (sub = csdata->subs; sub != NULL; sub = sub->next) {
+    if (sub->topic == topic && !xtask_mb_offer(csdata, sub->mb, data, size)) {
+      failed++; // subscriber busy
+    }
+  }
 
-      rpp = &csdata->p_outbox;
+  return failed;
+}
 
-      // try to find pending senders
-      while (*rpp != NULL) {
-            
-        if ((*rpp)->outbox_dest == rbuf_recv_task) {
-          struct p_request *pr;
+/******************************************************************************
+ * Function:     xtask_get_ev_group                                           *
+ * Parameters:   csdata  - Pointer to cs_data structure                       *
+ *               id      - event flag group id                                *
+ * Return:       pointer to struct ev_group, or NULL when the group           *
+ *               could not be found                                           *
+ *                                                                            *
+ *               Find the registered event flag group given the group id.     *
+ ******************************************************************************/
+struct ev_group * xtask_get_ev_group(struct cs_data * csdata, 
+                                     unsigned int     id)
+{
+  struct ev_group *temp_eg = csdata->ev_groups;
+  
+  while (temp_eg != NULL) {
+    if (temp_eg->id == id) {
+      break;
+    }
 
-          // send pending sender task message through ring bus to recipient
-          csdata->rbuf->cs_id        = csdata->id;
-          csdata->rbuf->msg_type     = 0x03;
-          csdata->rbuf->status       = 0x00;
-          csdata->rbuf->payload_size = 0x04 + (*rpp)->outbox.data_size;
-          pl  = csdata->rbuf->payload;
-          *pl = (*rpp)->outbox_dest;
-          pl++;
-          memcpy(pl, (*rpp)->outbox.data, (*rpp)->outbox.data_size);
-          
-          _xtask_ring_send(csdata);
-          
-          // add pending bus reply to list
-          pr = xtask_get_free_p_request(csdata);
-          pr->kernel   = (*rpp)->kernel;
-          pr->tid      = (*rpp)->tid;
-          pr->msg_type = 0x03;
-          pr->data     = *rpp;  
+    temp_eg = temp_eg->next;
+  }
 
-          // remove mailbox from pending outboxes list
-          *rpp = (*rpp)->p_next;
-          
-          /* we have modified the ring bus buffer */
-          state = 1;
-      
-          // don't set the pointer-pointer to the next element!
-        } else {
-          rpp = &(*rpp)->p_next;
-        }
-      }
-      
-      // restore ring bus buffer if modified
-      if (state != 0) {
-        csdata->rbuf->cs_id        = rbuf_cs_id;
-        csdata->rbuf->msg_type     = rbuf_msg_type;
-        csdata->rbuf->status       = rbuf_status;
-        csdata->rbuf->payload_size = rbuf_payload_size;
-        pl  = csdata->rbuf->payload;
-        *pl = rbuf_recv_task;
-      }
-    } 
-    // we always pass a message (modified or not) that did not originate from this CS
-    _xtask_ring_send(csdata);
-  } 
+  return temp_eg;
 }
 
 /******************************************************************************
- * Function:     xtask_get_mailbox                                            *
+ * Function:     xtask_get_hwt_code                                           *
  * Parameters:   csdata  - Pointer to cs_data structure                       *
- *               id      - mailbox id                                         *
- * Return:       pointer to struct mailbox, or NULL when mailbox              *
- *               could not be found                                           *
+ *               code    - Function number of hardware thread                 *
+ * Return:       pointer to struct hwt_entry, or NULL when not registered     *
  *                                                                            *
- *               Find the mailbox given the mailbox id.                       *
+ *               Find a registered hardware thread entry point by its code.   *
  ******************************************************************************/
-struct mailbox * xtask_get_mailbox(struct cs_data * csdata, 
-                                   unsigned int     id)
+struct hwt_entry * xtask_get_hwt_code(struct cs_data * csdata, 
+                                      unsigned int     code)
 {
-  struct mailbox *temp_mb = csdata->mailboxes;
+  struct hwt_entry *hc = csdata->hwt_codes;
   
-  while (temp_mb != NULL) {
-    if (temp_mb->id == id) {
+  while (hc != NULL) {
+    if (hc->code == code) {
       break;
     }
 
-    temp_mb = temp_mb->next;
+    hc = hc->next;
+  }
+
+  return hc;
+}
+
+/******************************************************************************
+ * Function:     xtask_kreply_pool_grow                                       *
+ * Parameters:   csdata  - Pointer to cs_data structure                       *
+ *               n       - Number of pending kernel replies to add            *
+ * Return:       none                                                         *
+ *                                                                            *
+ *               Allocate n pending kernel reply structures and add them      *
+ *               to the pool of free pending kernel replies.                  *
+ ******************************************************************************/
+void xtask_kreply_pool_grow(struct cs_data *csdata, unsigned int n)
+{
+  struct p_kreply *kr = malloc(n * sizeof(struct p_kreply));
+  int i;
+
+  if (kr == NULL) {
+    return; // out of memory, try again at next allocation
+  }
+
+  for (i = 0; i < n; i++) {
+    kr[i].state = KR_FREE;
+    kr[i].k     = NULL;
+    kr[i].next  = csdata->kr_pool;
+    csdata->kr_pool = &kr[i];
   }
 
-  return temp_mb;
+  csdata->kr_pool_size += n;
 }
 
 /******************************************************************************
  * Function:     xtask_get_free_kreply                                        *
  * Parameters:   csdata  - Pointer to cs_data structure                       *
+ *               k       - Pointer to kernel that receives the reply          *
  * Return:       pointer to free p_kreply structure, or NULL when             *
- *               could not be found                                           *
+ *               no memory is left                                            *
  *                                                                            *
- *               Find a free pending kernel reply structure                   *
+ *               Take a pending kernel reply structure from the pool and      *
+ *               add it to the end of the reply queue of the kernel.          *
+ *               The pool grows when it is empty. The caller fills in the     *
+ *               reply and notifies the kernel with xtask_notify_kernel.      *
  ******************************************************************************/
-struct p_kreply * xtask_get_free_kreply(struct cs_data *csdata)
+struct p_kreply * xtask_get_free_kreply(struct cs_data   * csdata,
+                                        struct cs_kernel * k)
 {
-  int i;
-  
-  for (i = 0; i < 8; i++) {
-    if (! (csdata->k_replies[i].state & KR_USED)) {
-      return &csdata->k_replies[i];
-    }
+  struct p_kreply *kr;
+
+  if (csdata->kr_pool == NULL) {
+    xtask_kreply_pool_grow(csdata, KR_POOL_SIZE);
   }
-  
-  return NULL; // not found, big trouble
+
+  kr = csdata->kr_pool;
+
+  if (kr == NULL) {
+    return NULL; // out of memory, big trouble
+  }
+
+  csdata->kr_pool = kr->next;
+
+  kr->state     = KR_USED;
+  kr->k         = k;
+  kr->reply.cmd = 0;
+  kr->reply.p0  = 0;
+  kr->reply.p1  = 0;
+  kr->reply.p2  = 0;
+  kr->reply.p3  = 0;
+  kr->reply.p4  = 0;
+  kr->reply.p5  = 0;
+  kr->next      = NULL;
+
+  // add to end of queue of kernel, replies are delivered in order
+  if (k->kr_tail == NULL) {
+    k->kr_head = kr;
+  } else {
+    k->kr_tail->next = kr;
+  }
+
+  k->kr_tail = kr;
+
+  // occupancy and high-water statistics
+  if (++k->nr_kr > k->max_kr) {
+    k->max_kr = k->nr_kr;
+  }
+
+  if (++csdata->nr_kr > csdata->max_kr) {
+    csdata->max_kr = csdata->nr_kr;
+  }
+
+  return kr;
 }
 
 /******************************************************************************
  * Function:     xtask_get_kreply                                             *
  * Parameters:   csdata  - Pointer to cs_data structure                       *
  *               k       - Pointer to kernel structure                        *
- * Return:       pointer to the p_kreply structure with the pending reply     *
- *               for the specific kernel                                      *
+ * Return:       pointer to the p_kreply structure with the oldest pending    *
+ *               reply for the specific kernel, or NULL when none is pending  *
  *                                                                            *
- *               Find pending kernel reply for the given kernel.              *
+ *               Remove the first pending kernel reply from the reply queue   *
+ *               of the given kernel. The caller returns it to the pool       *
+ *               with xtask_free_kreply after copying the reply.              *
  ******************************************************************************/
 struct p_kreply * xtask_get_kreply(struct cs_data * csdata, 
                                 struct cs_kernel  * k)
 {
-  int i;
-  
-  for (i = 0; i < 8; i++) {
-    if ((csdata->k_replies[i].state & KR_USED) && 
-        (csdata->k_replies[i].k == k)) {
-      return &csdata->k_replies[i];
-    }
+  struct p_kreply *kr = k->kr_head;
+
+  if (kr == NULL) {
+    return NULL;
   }
-  
-  return NULL;
+
+  k->kr_head = kr->next;
+
+  if (k->kr_head == NULL) {
+    k->kr_tail = NULL;
+  }
+
+  k->nr_kr--;
+  csdata->nr_kr--;
+
+  return kr;
+}
+
+/******************************************************************************
+ * Function:     xtask_notify_kernel                                          *
+ * Parameters:   k       - Pointer to kernel that has pending replies         *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Send a notification to the kernel unless one is outstanding. *
+ *               The kernel reads all pending replies for one notification,   *
+ *               so at most one control token is in the channel and the CS    *
+ *               never blocks in outct however many replies are queued.       *
+ *               xtask_man_get_kreply clears kr_notified when the queue has   *
+ *               been drained.                                                *
+ ******************************************************************************/
+void xtask_notify_kernel(struct cs_kernel *k)
+{
+  if (!k->kr_notified) {
+    k->kr_notified = 1;
+    _xtask_notify_kernel(k->c_async);
+  }
+}
+
+/******************************************************************************
+ * Function:     xtask_free_kreply                                            *
+ * Parameters:   csdata  - Pointer to cs_data structure                       *
+ *               kr      - Pointer to pending kernel reply                    *
+ * Return:       none                                                         *
+ *                                                                            *
+ *               Return a delivered pending kernel reply to the pool.         *
+ ******************************************************************************/
+void xtask_free_kreply(struct cs_data *csdata, struct p_kreply *kr)
+{
+  kr->state = KR_FREE;
+  kr->k     = NULL;
+  kr->next  = csdata->kr_pool;
+  csdata->kr_pool = kr;
 }
 
 /******************************************************************************
@@ -1480,6 +5203,13 @@ struct p_request * xtask_get_free_p_request(struct cs_data *csdata)
 
   pr = malloc(sizeof(struct p_request));
 
+  // request id is returned in the reply, 0 is used for messages without reply
+  if (++csdata->next_req_id == 0) {
+    csdata->next_req_id = 1;
+  }
+
+  pr->req_id = csdata->next_req_id;
+
   // add new structure to end of list of pending replies
   ppr = &csdata->p_reqs;
 
@@ -1493,15 +5223,30 @@ struct p_request * xtask_get_free_p_request(struct cs_data *csdata)
   return pr;
 }
 
-void test_hardware_thread(void *args, chanend c)
+/******************************************************************************
+ * Function:     xtask_take_p_request                                         *
+ * Parameters:   csdata  - Pointer to cs_data structure                       *
+ *               req_id  - Request id of received reply                       *
+ * Return:       Pointer to p_request structure, NULL when not found          *
+ *                                                                            *
+ *               Remove the pending ring bus reply with the request id from   *
+ *               the list. Replies can be matched in any order. The caller    *
+ *               releases the structure.                                      *
+ ******************************************************************************/
+struct p_request * xtask_take_p_request(struct cs_data *csdata, unsigned int req_id)
 {
-  //unsigned int temp;
-  unsigned int i = 0;
-  //printf("Test process running!\n");
-  while(i<10000) {
-    //temp = receive_something(c);
-    //send_something(c, i);
-    printf("Remote thread running\n");
-    i++;
+  struct p_request *pr;
+  struct p_request **ppr = &csdata->p_reqs;
+
+  while (*ppr != NULL) {
+    if ((*ppr)->req_id == req_id) {
+      pr = *ppr;
+      *ppr = pr->next;
+      return pr;
+    }
+
+    ppr = &(*ppr)->next;
   }
+
+  return NULL;
 }
@@ -9,17 +9,21 @@
 
 void dump_k_replies(struct cs_data *csdata, unsigned int id)
 {
-  int i;
+  struct cs_kernel *k;
+  struct p_kreply *kr;
   
-  printf("Dump k_replies [%u]: ", id);
+  printf("Dump k_replies [%u]: pool %u pending %u max %u\n", id,
+         csdata->kr_pool_size, csdata->nr_kr, csdata->max_kr);
   
-  for (i= 0; i< 8; i++) {
-    if (csdata->k_replies[i].state & KR_USED) {
-      printf("[%p %u(0x%x)] ", csdata->k_replies[i].k, csdata->k_replies[i].state, csdata->k_replies[i].state);
+  for (k = csdata->kernels; k != NULL; k = k->next) {
+    printf("  kernel %p pending %u max %u: ", k, k->nr_kr, k->max_kr);
+
+    for (kr = k->kr_head; kr != NULL; kr = kr->next) {
+      printf("[cmd %u p0 0x%x] ", kr->reply.cmd, kr->reply.p0);
     }
+
+    printf("\n");
   }
-  
-  printf("\n");
 }
 
 void dump_kernels(struct cs_kernel *head)
@@ -47,7 +51,7 @@ void dump_queues(struct k_data *kdata)
     printf("current_task: %u\n",kdata->current_task->tid);
   }
 
-  for (i=0; i<8; i++) {
+  for (i=0; i<NR_PRIORITIES; i++) {
     p = kdata->sched_head[i];
 
     //if (p == NULL) printf("Q: %d empty\n",i);
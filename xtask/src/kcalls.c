@@ -15,12 +15,35 @@
  * xtask_vc_get_write_buf     - get virtual channel write buffer              *
  * xtask_vc_send              - send virtual channel write buffer             *
  * xtask_create_mailbox       - register mailbox for inter-task communication *
+ * xtask_create_queued_mailbox - register mailbox with message queue        *
+ * xtask_create_remote_thread_on - create ded. hardware thread on chosen tile *
  * xtask_create_remote_thread - create new (other tile) ded. hardware thread  *
+ * xtask_register_thread_code - register hardware thread for other tiles      *
+ * xtask_join_thread          - wait until dedicated hardware thread exits    *
  * xtask_get_outbox           - get mailbox outbox buffer                     *
  * xtask_send_outbox          - send outbox to recipient task                 *
+ * xtask_send_outbox_to       - send outbox to recipient task on known tile   *
  * xtask_get_inbox            - receive a message from another task           *
  * xtask_create_task          - create a new task                             *
  * xtask_exit                 - exit from task                                * 
+ * xtask_create_timer         - create a software timer                       *
+ * xtask_start_timer          - start a one-shot or periodic software timer   *
+ * xtask_stop_timer           - stop a software timer                         *
+ * xtask_delete_timer         - delete a software timer                       *
+ * xtask_set_preempt_threshold - set preemption threshold of current task     *
+ * xtask_yield                - move current task to back of its queue        *
+ * xtask_set_reservation      - set CPU budget reservation of current task    *
+ * xtask_create_event_group   - create an event flag group                    *
+ * xtask_set_event_flags      - set flags of an event flag group              *
+ * xtask_clear_event_flags    - clear flags of an event flag group            *
+ * xtask_wait_event_flags     - wait for flags of an event flag group         *
+ * xtask_set_event_flags_id   - set flags of an event flag group by id        *
+ * xtask_delete_event_group   - delete an event flag group                    *
+ * xtask_delete_mailbox       - remove a mailbox                              *
+ * xtask_send_outbox_multi    - send outbox to a set of recipient tasks       *
+ * xtask_subscribe            - subscribe mailbox to a topic                  *
+ * xtask_unsubscribe          - remove subscription of mailbox to a topic     *
+ * xtask_publish              - send outbox to all subscribers of a topic     *
  *                                                                            *
  ******************************************************************************/
 
@@ -63,6 +86,10 @@ void xtask_delay_ticks(unsigned int ticks)
  *                              object size).                                 *
  *               tx_buf_Size  - Task transfer buffer size (must be multiple   *
  *                              of object size).                              *
+ *               nr_bufs      - Number of receive and of transfer buffers,    *
+ *                              0 for double buffering. Or VC_STREAM in to    *
+ *                              transfer buffers as frames, or VC_SHM in to   *
+ *                              share the buffers with the hardware thread.   *
  * Return:       handle                                                       *
  *                                                                            *
  *               Create a new dedicated hardware thread (local, same tile)    *
@@ -72,14 +99,15 @@ unsigned int xtask_create_thread(hwt_code     pc,
                                  void *       args, 
                                  unsigned int obj_size, 
                                  unsigned int rx_buf_size, 
-                                 unsigned int tx_buf_size)
+                                 unsigned int tx_buf_size,
+                                 unsigned int nr_bufs)
 {
   struct kcall_data kcall_params;
   struct kcall_data *p = &kcall_params;
   kcall_params.p0 = (unsigned int) pc;
   kcall_params.p1 = (unsigned int) stackwords;
   kcall_params.p2 = (unsigned int) args;
-  kcall_params.p3 = (unsigned int) obj_size;
+  kcall_params.p3 = (unsigned int) obj_size | (nr_bufs << VC_BUFS_SHIFT);
   kcall_params.p4 = (unsigned int) rx_buf_size;
   kcall_params.p5 = (unsigned int) tx_buf_size;
 
@@ -147,22 +175,27 @@ struct vc_buf * xtask_vc_get_write_buf(unsigned int handle)
 
 /******************************************************************************
  * Function:     xtask_vc_send                                                *
- * Parameters:   buf   - Pointer to struct vc_buf.                            *
+ * Parameters:   handle - Handle to dedicated hardware thread                 *
+ *               buf    - Pointer to struct vc_buf.                           *
  * Return:       A pointer to a vc_buf struct that contains the information   *
  *               about the buffer that can be filled by the task and          *
  *               transmitted to the dedicated hardware thread.                *
- *               Null pointer when no buffer was available but this should    *
- *               not happen in regular operation.                             *
+ *               Null pointer when buf is not the write buffer of the task    *
+ *               for this handle.                                             *
  *                                                                            *
  *               Instruct the Communication Server to send the write buffer   *
  *               to the dedicated hardware thread. Receive a new empty        *
  *               write buffer that can be immediately filled by the task.     *
+ *               The transfer completes in the background. When all write     *
+ *               buffers are still being transferred the task blocks until    *
+ *               one is free.                                                 *
  ******************************************************************************/
-struct vc_buf * xtask_vc_send(struct vc_buf *buf)
+struct vc_buf * xtask_vc_send(unsigned int handle, struct vc_buf *buf)
 {
   struct kcall_data kcall_params;
   struct kcall_data *p = &kcall_params;
-  kcall_params.p0 = (unsigned int)buf;
+  kcall_params.p0 = handle;
+  kcall_params.p1 = (unsigned int)buf;
 
   __asm__ volatile ("add r0, %0, 0"::"r"(p));
   __asm__ volatile ("kcall 4");
@@ -176,7 +209,7 @@ struct vc_buf * xtask_vc_send(struct vc_buf *buf)
  *                             Must be unique system wide.                    *
  *               inbox_size  - Inbox size in bytes.                           *
  *               outbox_size - Outbox size in bytes.                          *
- * Return:       Always returns 0 currently.                                  *
+ * Return:       0 on success, 1 when the id is already registered.           *
  *                                                                            *
  *               Create a new mailbox for inter-task communication.           *
  ******************************************************************************/
@@ -189,6 +222,39 @@ unsigned int xtask_create_mailbox(unsigned int id,
   kcall_params.p0 = id;
   kcall_params.p1 = inbox_size;
   kcall_params.p2 = outbox_size;
+  kcall_params.p3 = 0; // no queue
+  
+  __asm__ volatile ("add r0, %0, 0"::"r"(p));
+  __asm__ volatile ("kcall 5");
+
+  return kcall_params.p0;
+}
+
+/******************************************************************************
+ * Function:     xtask_create_queued_mailbox                                  *
+ * Parameters:   id          - ID for the mailbox to create.                  *
+ *                             Must be unique system wide.                    *
+ *               inbox_size  - Inbox size in bytes, also the size of each     *
+ *                             queued message.                                *
+ *               outbox_size - Outbox size in bytes.                          *
+ *               depth       - Number of messages that can be queued.         *
+ * Return:       0 on success, 1 when the id is already registered.           *
+ *                                                                            *
+ *               Create a new mailbox with a message queue. Sending to this   *
+ *               mailbox returns as soon as the message is queued and only    *
+ *               blocks when the queue is full.                               *
+ ******************************************************************************/
+unsigned int xtask_create_queued_mailbox(unsigned int id, 
+                                         unsigned int inbox_size, 
+                                         unsigned int outbox_size,
+                                         unsigned int depth)
+{
+  struct kcall_data kcall_params;
+  struct kcall_data *p = &kcall_params;
+  kcall_params.p0 = id;
+  kcall_params.p1 = inbox_size;
+  kcall_params.p2 = outbox_size;
+  kcall_params.p3 = depth;
   
   __asm__ volatile ("add r0, %0, 0"::"r"(p));
   __asm__ volatile ("kcall 5");
@@ -196,12 +262,63 @@ unsigned int xtask_create_mailbox(unsigned int id,
   return kcall_params.p0;
 }
 
+/******************************************************************************
+ * Function:     xtask_create_remote_thread_on                                *
+ * Parameters:   cs_id        - CS id of the tile that starts the thread,     *
+ *                              ANY_TILE for the first tile on the ring bus   *
+ *                              that has the function registered or           *
+ *                              LEAST_LOADED_TILE for the tile with the most  *
+ *                              free hardware threads and chanends.           *
+ *               code         - The function number (not a function pointer)  *
+ *                              registered on the tile that starts the thread.*
+ *               stackwords   - Stack size in words.                          *
+ *               args         - Argument of the hardware thread. Passed by    *
+ *                              value, a pointer has no meaning on another    *
+ *                              tile.                                         *
+ *               obj_size     - The size of objects transferred through the   *
+ *                              channel (must be a multiple of four bytes)    *
+ *               rx_buf_size  - Task receive buffer size (must be multiple of *
+ *                              object size).                                 *
+ *               tx_buf_Size  - Task transfer buffer size (must be multiple   *
+ *                              of object size).                              *
+ *               nr_bufs      - Number of receive and of transfer buffers,    *
+ *                              0 for double buffering. Or VC_STREAM in to    *
+ *                              transfer buffers as frames.                   *
+ * Return:       handle, 0 when the thread could not be started               *
+ *                                                                            *
+ *               Create a new dedicated hardware thread on a chosen tile.     *
+ *               The buffer sizes are limited to 64KB.                        *
+ ******************************************************************************/
+unsigned int xtask_create_remote_thread_on(unsigned int cs_id,
+                                           unsigned int code,
+                                           unsigned int stackwords,
+                                           unsigned int args,
+                                           unsigned int obj_size,
+                                           unsigned int rx_buf_size,
+                                           unsigned int tx_buf_size,
+                                           unsigned int nr_bufs)
+{
+  struct kcall_data kcall_params;
+  struct kcall_data *p = &kcall_params;
+  kcall_params.p0 = (unsigned int) code | (cs_id << HWT_CS_SHIFT);
+  kcall_params.p1 = (unsigned int) stackwords;
+  kcall_params.p2 = (unsigned int) obj_size | (nr_bufs << VC_BUFS_SHIFT);
+  kcall_params.p3 = (unsigned int) rx_buf_size;
+  kcall_params.p4 = (unsigned int) tx_buf_size;
+  kcall_params.p5 = (unsigned int) args;
+
+  __asm__ volatile ("add r0, %0, 0"::"r"(p));
+  __asm__ volatile ("kcall 6");
+
+  return kcall_params.p0; 
+}
+
 /******************************************************************************
  * Function:     xtask_create_remote_thread                                   *
  * Parameters:   code         - The function number (not a function pointer)  *
  *                              that will be executed by this hardware thread.*
- *                              The code of the function should already be on *
- *                              the tile that starts the hardware thread.     *
+ *                              The function should be registered with this   *
+ *                              number on the tile that starts the thread.    *
  *               stackwords   - Stack size in words.                          *
  *               obj_size     - The size of objects transferred through the   *
  *                              channel (must be a multiple of four bytes)    *
@@ -209,29 +326,48 @@ unsigned int xtask_create_mailbox(unsigned int id,
  *                              object size).                                 *
  *               tx_buf_Size  - Task transfer buffer size (must be multiple   *
  *                              of object size).                              *
- * Return:       handle                                                       *
+ *               nr_bufs      - Number of receive and of transfer buffers,    *
+ *                              0 for double buffering. Or VC_STREAM in to    *
+ *                              transfer buffers as frames.                   *
+ * Return:       handle, 0 when no tile could start the thread                *
  *                                                                            *
  *               Create a new dedicated hardware thread (remote, different    *
- *               tile) This function is highly expirimental.                  *
+ *               tile) on the first tile on the ring bus that has the         *
+ *               function registered.                                         *
  ******************************************************************************/
 unsigned int xtask_create_remote_thread(unsigned int code,
                                         unsigned int stackwords,
                                         unsigned int obj_size,
                                         unsigned int rx_buf_size,
-                                        unsigned int tx_buf_size)
+                                        unsigned int tx_buf_size,
+                                        unsigned int nr_bufs)
+{
+  return xtask_create_remote_thread_on(ANY_TILE, code, stackwords, 0, obj_size,
+                                       rx_buf_size, tx_buf_size, nr_bufs);
+}
+
+/******************************************************************************
+ * Function:     xtask_register_thread_code                                   *
+ * Parameters:   code         - Function number, at most 0xFFFF.              *
+ *               pc           - Function executed by the hardware thread.     *
+ * Return:       0 on success, 1 when the number is invalid or already used.  *
+ *                                                                            *
+ *               Register a hardware thread function on this tile, so that    *
+ *               tasks on other tiles can start it by its number with         *
+ *               xtask_create_remote_thread.                                  *
+ ******************************************************************************/
+unsigned int xtask_register_thread_code(unsigned int code, hwt_code pc)
 {
   struct kcall_data kcall_params;
   struct kcall_data *p = &kcall_params;
-  kcall_params.p0 = (unsigned int) code;
-  kcall_params.p1 = (unsigned int) stackwords;
-  kcall_params.p2 = (unsigned int) obj_size;
-  kcall_params.p3 = (unsigned int) rx_buf_size;
-  kcall_params.p4 = (unsigned int) tx_buf_size;
-
+  
+  kcall_params.p0 = code;
+  kcall_params.p1 = (unsigned int) pc;
+  
   __asm__ volatile ("add r0, %0, 0"::"r"(p));
-  __asm__ volatile ("kcall 6");
-
-  return kcall_params.p0; 
+  __asm__ volatile ("kcall 31");
+  
+  return kcall_params.p0;
 }
 
 /******************************************************************************
@@ -266,6 +402,8 @@ struct vc_buf * xtask_get_outbox(unsigned int id)
  *               blocked until the recipient task has actively received the   *
  *               message. The recipient task can be on the same kernel,       *
  *               on the same tile or on a different tile.                     *
+ *               On the same tile the buffer of the outbox can be handed to   *
+ *               the recipient, read buf->data again after sending.           *
  ******************************************************************************/
 unsigned int xtask_send_outbox(unsigned int sender, 
                                unsigned int receiver)
@@ -274,6 +412,36 @@ unsigned int xtask_send_outbox(unsigned int sender,
   struct kcall_data *p = &kcall_params;
   kcall_params.p0 = sender;
   kcall_params.p1 = receiver;
+  kcall_params.p2 = 0; // location unknown
+  
+  __asm__ volatile ("add r0, %0, 0"::"r"(p));
+  __asm__ volatile ("kcall 8");
+
+  return kcall_params.p0; 
+}
+
+/******************************************************************************
+ * Function:     xtask_send_outbox_to                                         *
+ * Parameters:   sender    - sender mailbox id                                *
+ *               receiver  - recipient mailbox id                             *
+ *               cs_id     - id of the CS of the recipient                    *
+ * Return:       Returns 0 when the message has been delivered. 1 when the    *
+ *               recipient could not be found.                                * 
+ *                                                                            *
+ *               Send outbox to a recipient task on a known tile. When the    *
+ *               CS are connected by links the message is routed directly to  *
+ *               the CS of the recipient instead of passing all CS on the     *
+ *               ring bus. Otherwise the same as xtask_send_outbox.           *
+ ******************************************************************************/
+unsigned int xtask_send_outbox_to(unsigned int sender, 
+                                  unsigned int receiver,
+                                  unsigned int cs_id)
+{
+  struct kcall_data kcall_params;
+  struct kcall_data *p = &kcall_params;
+  kcall_params.p0 = sender;
+  kcall_params.p1 = receiver;
+  kcall_params.p2 = cs_id;
   
   __asm__ volatile ("add r0, %0, 0"::"r"(p));
   __asm__ volatile ("kcall 8");
@@ -361,3 +529,456 @@ void xtask_exit(unsigned int status)
   __asm__ volatile ("add r0, %0, 0"::"r"(p));
   __asm__ volatile ("kcall 11");  
 }
+
+/******************************************************************************
+ * Function:     xtask_create_timer                                           *
+ * Parameters:   code         - Pointer to the callback function. This        *
+ *                              function must return void and accept a void * *
+ *                              as argument. It is executed by the kernel on  *
+ *                              the kernel tick and may not perform any       *
+ *                              kernel calls.                                 *
+ *               args         - Pointer to argument buffer (or use the        *
+ *                              pointer value itself as argument)             *
+ * Return:       Timer handle, 0 when the timer could not be allocated.       *
+ *                                                                            *
+ *               Create a new software timer. The timer is created stopped.   *
+ ******************************************************************************/
+unsigned int xtask_create_timer(timer_code code, 
+                                void *     args)
+{
+  struct kcall_data kcall_params;
+  struct kcall_data *p = &kcall_params;
+  
+  kcall_params.p0 = (unsigned int) code;
+  kcall_params.p1 = (unsigned int) args;
+  
+  __asm__ volatile ("add r0, %0, 0"::"r"(p));
+  __asm__ volatile ("kcall 12");
+
+  return kcall_params.p0;  
+}
+
+/******************************************************************************
+ * Function:     xtask_start_timer                                            *
+ * Parameters:   timer        - Timer handle.                                 *
+ *               ticks        - Number of kernel ticks until the first        *
+ *                              expiry.                                       *
+ *               period       - Number of kernel ticks between expiries of a  *
+ *                              periodic timer, 0 for a one-shot timer.       *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Start a software timer. If the timer is already running it   *
+ *               is restarted with the new values.                            *
+ ******************************************************************************/
+void xtask_start_timer(unsigned int timer, 
+                       unsigned int ticks, 
+                       unsigned int period)
+{
+  struct kcall_data kcall_params;
+  struct kcall_data *p = &kcall_params;
+  
+  kcall_params.p0 = timer;
+  kcall_params.p1 = ticks;
+  kcall_params.p2 = period;
+  
+  __asm__ volatile ("add r0, %0, 0"::"r"(p));
+  __asm__ volatile ("kcall 13");
+}
+
+/******************************************************************************
+ * Function:     xtask_stop_timer                                             *
+ * Parameters:   timer        - Timer handle.                                 *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Stop a software timer. The timer can be started again.       *
+ ******************************************************************************/
+void xtask_stop_timer(unsigned int timer)
+{
+  struct kcall_data kcall_params;
+  struct kcall_data *p = &kcall_params;
+  
+  kcall_params.p0 = timer;
+  
+  __asm__ volatile ("add r0, %0, 0"::"r"(p));
+  __asm__ volatile ("kcall 14");
+}
+
+/******************************************************************************
+ * Function:     xtask_delete_timer                                           *
+ * Parameters:   timer        - Timer handle.                                 *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Stop a software timer and release its resources.             *
+ ******************************************************************************/
+void xtask_delete_timer(unsigned int timer)
+{
+  struct kcall_data kcall_params;
+  struct kcall_data *p = &kcall_params;
+  
+  kcall_params.p0 = timer;
+  
+  __asm__ volatile ("add r0, %0, 0"::"r"(p));
+  __asm__ volatile ("kcall 15");
+}
+
+/******************************************************************************
+ * Function:     xtask_set_preempt_threshold                                  *
+ * Parameters:   threshold    - New preemption threshold.                     *
+ * Return:       Previous preemption threshold.                               *
+ *                                                                            *
+ *               Set the preemption threshold of the calling task. Only tasks *
+ *               with a priority number lower than the threshold can preempt  *
+ *               the calling task. Setting the threshold to 0 makes the task  *
+ *               non-preemptible until it blocks, yields or restores the old  *
+ *               threshold. The threshold is limited to priority + 1.         *
+ ******************************************************************************/
+unsigned int xtask_set_preempt_threshold(unsigned int threshold)
+{
+  struct kcall_data kcall_params;
+  struct kcall_data *p = &kcall_params;
+  
+  kcall_params.p0 = threshold;
+  
+  __asm__ volatile ("add r0, %0, 0"::"r"(p));
+  __asm__ volatile ("kcall 16");
+  
+  return kcall_params.p0;
+}
+
+/******************************************************************************
+ * Function:     xtask_yield                                                  *
+ * Parameters:   none                                                         *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Give up the processor to the next ready task of the highest  *
+ *               priority. The calling task is moved to the back of its       *
+ *               scheduling queue.                                            *
+ ******************************************************************************/
+void xtask_yield(void)
+{
+  struct kcall_data kcall_params;
+  struct kcall_data *p = &kcall_params;
+  
+  __asm__ volatile ("add r0, %0, 0"::"r"(p));
+  __asm__ volatile ("kcall 17");
+}
+
+/******************************************************************************
+ * Function:     xtask_set_reservation                                        *
+ * Parameters:   budget       - CPU time in timer cycles per period, 0 to     *
+ *                              remove the reservation.                       *
+ *               period       - Replenishment period in kernel ticks.         *
+ * Return:       0 on success, 1 on failure.                                  *
+ *                                                                            *
+ *               Reserve a CPU budget for the calling task. When the task has *
+ *               used up its budget it runs at background priority until the  *
+ *               budget is replenished at the start of the next period.       *
+ ******************************************************************************/
+unsigned int xtask_set_reservation(unsigned int budget, unsigned int period)
+{
+  struct kcall_data kcall_params;
+  struct kcall_data *p = &kcall_params;
+  
+  kcall_params.p0 = budget;
+  kcall_params.p1 = period;
+  
+  __asm__ volatile ("add r0, %0, 0"::"r"(p));
+  __asm__ volatile ("kcall 18");
+  
+  return kcall_params.p0;
+}
+
+/******************************************************************************
+ * Function:     xtask_create_event_group                                     *
+ * Parameters:   id           - Group id, unique on the tile. 0 creates a     *
+ *                              group that is only used on this kernel.       *
+ * Return:       Group handle, 0 on failure.                                  *
+ *                                                                            *
+ *               Create a group of 32 event flags. All flags start cleared.   *
+ ******************************************************************************/
+unsigned int xtask_create_event_group(unsigned int id)
+{
+  struct kcall_data kcall_params;
+  struct kcall_data *p = &kcall_params;
+  
+  kcall_params.p0 = id;
+  
+  __asm__ volatile ("add r0, %0, 0"::"r"(p));
+  __asm__ volatile ("kcall 19");
+  
+  return kcall_params.p0;
+}
+
+/******************************************************************************
+ * Function:     xtask_set_event_flags                                        *
+ * Parameters:   group        - Group handle.                                 *
+ *               flags        - Flags to set.                                 *
+ * Return:       Flags of the group after setting.                            *
+ *                                                                            *
+ *               Set event flags and wake the tasks waiting for them.         *
+ ******************************************************************************/
+unsigned int xtask_set_event_flags(unsigned int group, unsigned int flags)
+{
+  struct kcall_data kcall_params;
+  struct kcall_data *p = &kcall_params;
+  
+  kcall_params.p0 = group;
+  kcall_params.p1 = flags;
+  
+  __asm__ volatile ("add r0, %0, 0"::"r"(p));
+  __asm__ volatile ("kcall 20");
+  
+  return kcall_params.p0;
+}
+
+/******************************************************************************
+ * Function:     xtask_clear_event_flags                                      *
+ * Parameters:   group        - Group handle.                                 *
+ *               flags        - Flags to clear.                               *
+ * Return:       Flags of the group before clearing.                          *
+ *                                                                            *
+ *               Clear event flags.                                           *
+ ******************************************************************************/
+unsigned int xtask_clear_event_flags(unsigned int group, unsigned int flags)
+{
+  struct kcall_data kcall_params;
+  struct kcall_data *p = &kcall_params;
+  
+  kcall_params.p0 = group;
+  kcall_params.p1 = flags;
+  
+  __asm__ volatile ("add r0, %0, 0"::"r"(p));
+  __asm__ volatile ("kcall 21");
+  
+  return kcall_params.p0;
+}
+
+/******************************************************************************
+ * Function:     xtask_wait_event_flags                                       *
+ * Parameters:   group        - Group handle.                                 *
+ *               flags        - Flags to wait for.                            *
+ *               options      - EF_WAIT_ANY or EF_WAIT_ALL, optionally or'ed  *
+ *                              with EF_CLEAR to clear the flags on return.   *
+ * Return:       Flags of the group that satisfied the wait.                  *
+ *                                                                            *
+ *               Block until any or all of the given flags are set.           *
+ ******************************************************************************/
+unsigned int xtask_wait_event_flags(unsigned int group, unsigned int flags, 
+                                    unsigned int options)
+{
+  struct kcall_data kcall_params;
+  struct kcall_data *p = &kcall_params;
+  
+  kcall_params.p0 = group;
+  kcall_params.p1 = flags;
+  kcall_params.p2 = options;
+  
+  __asm__ volatile ("add r0, %0, 0"::"r"(p));
+  __asm__ volatile ("kcall 22");
+  
+  return kcall_params.p0;
+}
+
+/******************************************************************************
+ * Function:     xtask_set_event_flags_id                                     *
+ * Parameters:   id           - Group id.                                     *
+ *               flags        - Flags to set.                                 *
+ * Return:       0 on success, 1 when the group is unknown.                   *
+ *                                                                            *
+ *               Set the event flags of a group that may belong to another    *
+ *               kernel on the same tile.                                     *
+ ******************************************************************************/
+unsigned int xtask_set_event_flags_id(unsigned int id, unsigned int flags)
+{
+  struct kcall_data kcall_params;
+  struct kcall_data *p = &kcall_params;
+  
+  kcall_params.p0 = id;
+  kcall_params.p1 = flags;
+  
+  __asm__ volatile ("add r0, %0, 0"::"r"(p));
+  __asm__ volatile ("kcall 23");
+  
+  return kcall_params.p0;
+}
+
+/******************************************************************************
+ * Function:     xtask_delete_event_group                                     *
+ * Parameters:   group        - Group handle.                                 *
+ * Return:       0 on success, 1 when tasks wait on the group.                *
+ *                                                                            *
+ *               Delete an event flag group of this kernel and release its    *
+ *               id. Flags set by id that were not delivered yet are lost.    *
+ ******************************************************************************/
+unsigned int xtask_delete_event_group(unsigned int group)
+{
+  struct kcall_data kcall_params;
+  struct kcall_data *p = &kcall_params;
+  
+  kcall_params.p0 = group;
+  
+  __asm__ volatile ("add r0, %0, 0"::"r"(p));
+  __asm__ volatile ("kcall 33");
+  
+  return kcall_params.p0;
+}
+
+/******************************************************************************
+ * Function:     xtask_delete_mailbox                                         *
+ * Parameters:   id           - Mailbox id.                                   *
+ * Return:       0 on success, 1 when the mailbox is unknown, busy or not     *
+ *               owned by the calling task.                                   *
+ *                                                                            *
+ *               Remove a mailbox from the CS of this tile. Local tasks that  *
+ *               wait to send to the mailbox get a delivery failure. The      *
+ *               mailbox is busy while its own send is in progress or while   *
+ *               a task waits on its inbox.                                   *
+ ******************************************************************************/
+unsigned int xtask_delete_mailbox(unsigned int id)
+{
+  struct kcall_data kcall_params;
+  struct kcall_data *p = &kcall_params;
+  
+  kcall_params.p0 = id;
+  
+  __asm__ volatile ("add r0, %0, 0"::"r"(p));
+  __asm__ volatile ("kcall 27");
+  
+  return kcall_params.p0;
+}
+
+/******************************************************************************
+ * Function:     xtask_send_outbox_multi                                      *
+ * Parameters:   sender        - sender mailbox id                            *
+ *               recipients    - array with recipient mailbox ids             *
+ *               nr_recipients - number of recipients                         *
+ * Return:       Number of recipients that did not get the message.           *
+ *                                                                            *
+ *               Send outbox to a set of recipient tasks. The message is      *
+ *               delivered to each recipient that waits for a message or has  *
+ *               room in its message queue. Recipients on the same tile are   *
+ *               served at once, recipients on other tiles in one pass over   *
+ *               the ring bus. The sending task is blocked until all          *
+ *               recipients have been tried, but does not wait for busy       *
+ *               recipients.                                                  *
+ ******************************************************************************/
+unsigned int xtask_send_outbox_multi(unsigned int  sender,
+                                     unsigned int *recipients,
+                                     unsigned int  nr_recipients)
+{
+  struct kcall_data kcall_params;
+  struct kcall_data *p = &kcall_params;
+  
+  kcall_params.p0 = sender;
+  kcall_params.p1 = (unsigned int) recipients;
+  kcall_params.p2 = nr_recipients;
+  
+  __asm__ volatile ("add r0, %0, 0"::"r"(p));
+  __asm__ volatile ("kcall 28");
+  
+  return kcall_params.p0;
+}
+
+/******************************************************************************
+ * Function:     xtask_subscribe                                              *
+ * Parameters:   topic        - Topic id.                                     *
+ *               id           - Mailbox id, the mailbox must be on this tile. *
+ * Return:       0 on success, 1 when the mailbox is unknown.                 *
+ *                                                                            *
+ *               Subscribe a mailbox to a topic. Messages published on the    *
+ *               topic arrive in the inbox of the mailbox like any other      *
+ *               message.                                                     *
+ ******************************************************************************/
+unsigned int xtask_subscribe(unsigned int topic, unsigned int id)
+{
+  struct kcall_data kcall_params;
+  struct kcall_data *p = &kcall_params;
+  
+  kcall_params.p0 = topic;
+  kcall_params.p1 = id;
+  kcall_params.p2 = SUB_ADD;
+  
+  __asm__ volatile ("add r0, %0, 0"::"r"(p));
+  __asm__ volatile ("kcall 29");
+  
+  return kcall_params.p0;
+}
+
+/******************************************************************************
+ * Function:     xtask_unsubscribe                                            *
+ * Parameters:   topic        - Topic id.                                     *
+ *               id           - Mailbox id.                                   *
+ * Return:       0 on success, 1 when the subscription does not exist.        *
+ *                                                                            *
+ *               Remove the subscription of a mailbox to a topic.             *
+ ******************************************************************************/
+unsigned int xtask_unsubscribe(unsigned int topic, unsigned int id)
+{
+  struct kcall_data kcall_params;
+  struct kcall_data *p = &kcall_params;
+  
+  kcall_params.p0 = topic;
+  kcall_params.p1 = id;
+  kcall_params.p2 = SUB_REMOVE;
+  
+  __asm__ volatile ("add r0, %0, 0"::"r"(p));
+  __asm__ volatile ("kcall 29");
+  
+  return kcall_params.p0;
+}
+
+/******************************************************************************
+ * Function:     xtask_publish                                                *
+ * Parameters:   topic        - Topic id.                                     *
+ *               sender       - Sender mailbox id.                            *
+ * Return:       Number of subscribers that did not get the message.          *
+ *                                                                            *
+ *               Send the outbox to all subscribers of a topic on all tiles.  *
+ *               The message is delivered to each subscriber that waits for a *
+ *               message or has room in its message queue. The sending task   *
+ *               is blocked until the message has passed all CS.              *
+ ******************************************************************************/
+unsigned int xtask_publish(unsigned int topic, unsigned int sender)
+{
+  struct kcall_data kcall_params;
+  struct kcall_data *p = &kcall_params;
+  
+  kcall_params.p0 = topic;
+  kcall_params.p1 = sender;
+  
+  __asm__ volatile ("add r0, %0, 0"::"r"(p));
+  __asm__ volatile ("kcall 30");
+  
+  return kcall_params.p0;
+}
+
+/******************************************************************************
+ * Function:     xtask_join_thread                                            *
+ * Parameters:   handle       - Dedicated hardware thread handle.             *
+ *               status       - Receives the exit status, can be NULL.        *
+ * Return:       0 on success, 1 when the handle is unknown or another task   *
+ *               already waits for the thread.                                *
+ *                                                                            *
+ *               Wait until a dedicated hardware thread exits with            *
+ *               xtask_hwt_exit or returns from its function. Data left in    *
+ *               the read buffers should be read before. The handle is        *
+ *               invalid afterwards. A thread on this tile is parked and      *
+ *               reused by the next xtask_create_thread with a stack that     *
+ *               fits, a thread on another tile ends.                         *
+ ******************************************************************************/
+unsigned int xtask_join_thread(unsigned int handle, unsigned int *status)
+{
+  struct kcall_data kcall_params;
+  struct kcall_data *p = &kcall_params;
+  
+  kcall_params.p0 = handle;
+  
+  __asm__ volatile ("add r0, %0, 0"::"r"(p));
+  __asm__ volatile ("kcall 32");
+
+  if (status != NULL) {
+    *status = kcall_params.p1;
+  }
+  
+  return kcall_params.p0;
+}
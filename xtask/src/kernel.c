@@ -11,8 +11,15 @@
  *                                                                            *
  * xtask_kernel              - Initialize the kernel and initial tasks. Start *
  *                             the kernel. This function is part of the API.  *
+ * xtask_set_sched_mode      - Select preemptive or cooperative scheduling.   *
+ *                             This function is part of the API.              *
  * xtask_kcall_handler       - Kernel call handler.                           *
  * xtask_check_delayed_tasks - Unblock tasks for which the delay has expired. *
+ * xtask_check_timers        - Run callbacks of expired software timers.      *
+ * xtask_timer_arm           - Add software timer to the timer wheel.         *
+ * xtask_timer_disarm        - Remove software timer from the timer wheel.    *
+ * xtask_event_flags_set     - Set event flags and wake satisfied waiters.    *
+ * xtask_check_shobj_waiters - Unblock tasks woken by a shared object.        *
  * xtask_get_not_chan        - get notification channel resource id.          *
  * xtask_not_handler         - handle notifications from CS.                  *
  *                                                                            *
@@ -29,6 +36,28 @@
  * xtask_kcall_get_inbox                                                      *
  * xtask_kcall_create_task                                                    *
  * xtask_kcall_exit                                                           *
+ * xtask_kcall_create_timer                                                   *
+ * xtask_kcall_start_timer                                                    *
+ * xtask_kcall_stop_timer                                                     *
+ * xtask_kcall_delete_timer                                                   *
+ * xtask_kcall_set_threshold                                                  *
+ * xtask_kcall_yield                                                          *
+ * xtask_kcall_set_reservation                                                *
+ * xtask_kcall_create_event_group                                             *
+ * xtask_kcall_set_event_flags                                                *
+ * xtask_kcall_clear_event_flags                                              *
+ * xtask_kcall_wait_event_flags                                               *
+ * xtask_kcall_set_event_flags_id                                             *
+ * xtask_kcall_delete_event_group                                             *
+ * xtask_kcall_shobj_alloc                                                    *
+ * xtask_kcall_shobj_block                                                    *
+ * xtask_kcall_shobj_kick                                                     *
+ * xtask_kcall_delete_mailbox                                                 *
+ * xtask_kcall_send_outbox_multi                                              *
+ * xtask_kcall_subscribe                                                      *
+ * xtask_kcall_publish                                                        *
+ * xtask_kcall_register_thread_code                                           *
+ * xtask_kcall_join_thread                                                    *
  *                                                                            *
  ******************************************************************************/
 
@@ -37,6 +66,7 @@
 #include <xccompat.h>
 #include "../include/kernel.h"
 #include "../include/comserver.h"
+#include "../include/shobj.h"
 
 /******************************************************************************
  * Function:     xtask_kernel                                                 *
@@ -73,10 +103,14 @@ void xtask_kernel(init_code    init_tasks,
   void *kstack = malloc(KSTACK_SIZE * WORD_SIZE);       // allocate kernel stack
   struct k_data *kdata = malloc(sizeof(struct k_data)); // allocate kdata struct
 
-  for (i=0; i<8; i++) {
+  for (i=0; i<NR_PRIORITIES; i++) {
     kdata->sched_head[i] = NULL; // init task scheduling queues
   }
 
+  for (i=0; i<TIMER_WHEEL_SIZE; i++) {
+    kdata->timer_wheel[i] = NULL; // init software timer wheel
+  }
+
   kdata->timer_cycles = tick_rate;
   kdata->time         = 0;  
   kdata->current_task = NULL;
@@ -84,6 +118,11 @@ void xtask_kernel(init_code    init_tasks,
   kdata->block_head   = NULL;
   kdata->cs_async     = cs_man_async;
   kdata->cs_sync      = cs_man_sync;
+  kdata->sched_mode   = SCHED_PREEMPTIVE;
+  kdata->resv_head    = NULL;
+  kdata->acct_timer   = 0;
+  kdata->cs_handle    = 0;
+  kdata->shobj_waiters = NULL;
   
   kdata->kcall_table[0]  = xtask_kcall_delay_ticks;
   kdata->kcall_table[1]  = xtask_kcall_create_thread;
@@ -97,9 +136,32 @@ void xtask_kernel(init_code    init_tasks,
   kdata->kcall_table[9]  = xtask_kcall_get_inbox;
   kdata->kcall_table[10] = xtask_kcall_create_task;
   kdata->kcall_table[11] = xtask_kcall_exit;
+  kdata->kcall_table[12] = xtask_kcall_create_timer;
+  kdata->kcall_table[13] = xtask_kcall_start_timer;
+  kdata->kcall_table[14] = xtask_kcall_stop_timer;
+  kdata->kcall_table[15] = xtask_kcall_delete_timer;
+  kdata->kcall_table[16] = xtask_kcall_set_threshold;
+  kdata->kcall_table[17] = xtask_kcall_yield;
+  kdata->kcall_table[18] = xtask_kcall_set_reservation;
+  kdata->kcall_table[19] = xtask_kcall_create_event_group;
+  kdata->kcall_table[20] = xtask_kcall_set_event_flags;
+  kdata->kcall_table[21] = xtask_kcall_clear_event_flags;
+  kdata->kcall_table[22] = xtask_kcall_wait_event_flags;
+  kdata->kcall_table[23] = xtask_kcall_set_event_flags_id;
+  kdata->kcall_table[24] = xtask_kcall_shobj_alloc;
+  kdata->kcall_table[25] = xtask_kcall_shobj_block;
+  kdata->kcall_table[26] = xtask_kcall_shobj_kick;
+  kdata->kcall_table[27] = xtask_kcall_delete_mailbox;
+  kdata->kcall_table[28] = xtask_kcall_send_outbox_multi;
+  kdata->kcall_table[29] = xtask_kcall_subscribe;
+  kdata->kcall_table[30] = xtask_kcall_publish;
+  kdata->kcall_table[31] = xtask_kcall_register_thread_code;
+  kdata->kcall_table[32] = xtask_kcall_join_thread;
+  kdata->kcall_table[33] = xtask_kcall_delete_event_group;
 
   _xtask_init_kdata(kstack, ((KSTACK_SIZE-2)*WORD_SIZE), kdata); // init kernel stack
-  xtask_create_init_task(idle_task, 64, 7, 0, (void *)0);
+  xtask_create_init_task(idle_task, 64, IDLE_PRIORITY, 0, (void *)0);
+  kdata->idle_task = kdata->sched_head[IDLE_PRIORITY]; // only task in its queue yet
 
   (*init_tasks)();  // create all other tasks by executing the given function 
 
@@ -111,6 +173,25 @@ void xtask_kernel(init_code    init_tasks,
   
 }
 
+/******************************************************************************
+ * Function:     xtask_set_sched_mode                                         *
+ * Parameters:   mode            - SCHED_PREEMPTIVE or SCHED_COOPERATIVE.     *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Select the scheduling mode of the kernel. This function      *
+ *               should be called from the function that creates the initial  *
+ *               tasks. In cooperative mode the kernel tick only wakes        *
+ *               delayed tasks and runs software timers, a task switch only   *
+ *               happens when the running task blocks in a kernel call or     *
+ *               yields. This function is part of the API.                    *
+ ******************************************************************************/
+void xtask_set_sched_mode(unsigned int mode)
+{
+  struct k_data *kdata = _xtask_get_kdata();
+
+  kdata->sched_mode = mode;
+}
+
 /******************************************************************************
  * Function:      xtask_kcall_delay_ticks                                     *
  * Parameters:    callnr  - Kernel call number.                               *
@@ -160,7 +241,8 @@ void xtask_kcall_delay_ticks(unsigned int        callnr,
  * Kcall params:  p0      - program counter                                   *
  *                p1      - stack words                                       *
  *                p2      - args                                              *
- *                p3      - object transfer size                              *
+ *                p3      - object transfer size, number of buffers in upper  *
+ *                          half                                              *
  *                p4      - rx buffer size                                    *
  *                p5      - tx buffer size                                    *
  *                                                                            *
@@ -285,12 +367,14 @@ void xtask_kcall_vc_get_write_buf(unsigned int        callnr,
  *                                                                            *
  * Return:        void                                                        *
  *                                                                            *
- * Kcall params:  p0      - pointer to vc_buf structure with write buffer     *
+ * Kcall params:  p0      - handle                                            *
+ *                p1      - pointer to vc_buf structure with write buffer     *
  *                                                                            *
  * Return params: p0      - pointer to vc_buf structure with write buffer     *
  *                                                                            *
  *                Kernel call implementation for sending write buffer to      *
- *                dedicated hardware thread                                   *
+ *                dedicated hardware thread. The task is blocked when all     *
+ *                write buffers are still queued for transfer.                *
  ******************************************************************************/
 void xtask_kcall_vc_send(unsigned int        callnr,
                          struct k_data     * kdata, 
@@ -298,17 +382,38 @@ void xtask_kcall_vc_send(unsigned int        callnr,
 {
   /*     
     Make a request at CS.
-    Return p0 to task, pointer to new vc_buf for writing
+    Return p0 to task, pointer to new vc_buf for writing.
+    If all buffers are queued for transfer, CS returns
+    the handle in p1 and the task blocks until a 
+    buffer has been transferred.
   */
 
   struct man_msg msg;
     
   msg.cmd = 4;
-  msg.p0 = kcall->p0;
+  msg.p0 = kcall->p0; // handle
+  msg.p1 = kcall->p1; // write buffer
     
   _xtask_man_sendrec(kdata->cs_sync, (void*)&msg);
     
-  kcall->p0 = msg.p0;      
+  if (msg.p0 == 0 && msg.p1 != 0) { // no free write buffer
+
+    // save block data, the handle is used to find the task
+    kcall->p1 = msg.p1;
+    kdata->current_task->kcall_nr = callnr;
+    kdata->current_task->kcall_params =  kcall;    
+
+    // add process to block list
+    kdata->current_task->next = kdata->block_head;
+    kdata->block_head = kdata->current_task;
+
+    // pick next task to run
+    kdata->current_task = NULL;
+    xtask_pick_task(kdata);
+
+  } else {
+    kcall->p0 = msg.p0;      
+  }
 }
 
 /******************************************************************************
@@ -320,8 +425,11 @@ void xtask_kcall_vc_send(unsigned int        callnr,
  * Return:        void                                                        *
  *                                                                            *
  * Kcall params:  p0      - new mailbox id                                    *
+ *                p1      - inbox size                                        *
+ *                p2      - outbox size                                       *
+ *                p3      - queue depth                                       *
  *                                                                            *
- * Return params: p0      - p0                                                *
+ * Return params: p0      - 0 on success, 1 when the id is already registered *
  *                                                                            *
  *                Kernel call implementation for creating a new mailbox.      *
  ******************************************************************************/
@@ -340,6 +448,8 @@ void xtask_kcall_create_mailbox(unsigned int        callnr,
   msg.p1 = kdata->current_task->tid; // task id
   msg.p2 = kcall->p1; // inbox size
   msg.p3 = kcall->p2; // outbox size
+  msg.p4 = MB_CREATE;
+  msg.p5 = kcall->p3; // queue depth
     
   _xtask_man_sendrec(kdata->cs_sync, (void*)&msg);
     
@@ -354,11 +464,13 @@ void xtask_kcall_create_mailbox(unsigned int        callnr,
  *                                                                            *
  * Return:        void                                                        *
  *                                                                            *
- * Kcall params:  p0      - function number                                   *
+ * Kcall params:  p0      - function number, target CS id in upper half       *
  *                p1      - stack words                                       *
- *                p2      - object transfer size                              *
+ *                p2      - object transfer size, number of buffers in upper  *
+ *                          half                                              *
  *                p3      - rx buffer size                                    *
  *                p4      - tx buffer size                                    *
+ *                p5      - argument of hardware thread                       *
  *                                                                            *
  * Return params: set at CS message handler                                   *
  *                                                                            *
@@ -378,11 +490,11 @@ void xtask_kcall_create_remote_thread(unsigned int        callnr,
     
   msg.cmd = 6;
   msg.p0 = kdata->current_task->tid; // calling task id
-  msg.p1 = kcall->p0; // code
+  msg.p1 = kcall->p0; // code, target CS id
   msg.p2 = kcall->p1; // nstackwords
   msg.p3 = kcall->p2; // obj size
-  msg.p4 = kcall->p3; // rx buf size
-  msg.p5 = kcall->p4; // tx buf size
+  msg.p4 = kcall->p3 | (kcall->p4 << VC_SIZE_SHIFT); // rx and tx buf size
+  msg.p5 = kcall->p5; // args
     
   _xtask_man_send(kdata->cs_sync, (void*)&msg);
     
@@ -444,6 +556,7 @@ void xtask_kcall_get_outbox(unsigned int        callnr,
  *                                                                            *
  * Kcall params:  p0      - sender mailbox id                                 *
  *                p1      - recipient mailbox id                              * 
+ *                p2      - CS id of recipient, 0 when unknown                *
  *                                                                            *
  * Return params: set at CS message handler                                   *
  *                                                                            *
@@ -464,6 +577,7 @@ void xtask_kcall_send_outbox(unsigned int        callnr,
   msg.cmd = 8;
   msg.p0 = kcall->p0;
   msg.p1 = kcall->p1;
+  msg.p2 = kcall->p2;
     
   _xtask_man_send(kdata->cs_sync, (void *)&msg);
     
@@ -563,6 +677,8 @@ void xtask_kcall_create_task(unsigned int        callnr,
   // initialize task entry
   pe->bottom_stack = (unsigned long*)stack;
   pe->priority     = priority;
+  pe->threshold    = priority + 1;
+  pe->resv         = NULL;
   pe->next         = NULL;
   pe->stack_size   = stack_size;    
   pe->sp           = sp;
@@ -593,6 +709,7 @@ void xtask_kcall_exit(unsigned int        callnr,
                       struct kcall_data * kcall)
 {
   /* task exit */
+  xtask_resv_release(kdata, kdata->current_task);
   free(kdata->current_task->bottom_stack);
   free(kdata->current_task);
     
@@ -603,259 +720,1365 @@ void xtask_kcall_exit(unsigned int        callnr,
   // need to check for other resources such as mailboxes etc    
 }
 
-
 /******************************************************************************
- * Function:     xtask_kcall_handler                                          *
- * Parameters:   callnr  - Kernel call number.                                *
- *               kdata   - Pointer to the kdata structure                     *
- *               kcall   - Pointer to kcall_data structure. This structure is *
- *                         provided by the calling task and contains optional *
- *                         arguments for the kernel call. It is also used to  *
- *                         pass back return values from the kernel to         *
- *                         the calling task.                                  *
- * Return:       void                                                         *
+ * Function:      xtask_kcall_create_timer                                    *
+ * Parameters:    callnr  - Kernel call number.                               *
+ *                kdata   - Pointer to k_data structure.                      *
+ *                kcall   - kernel call parameters.                           *
  *                                                                            *
- *               kernel call handler dispatch.                                *
- *               This function is redundant and the handlers can be called    *
- *               directly from the kernel assembly code, however this is      *
- *               not implemented yet.                                         *   
+ * Return:        void                                                        *
+ *                                                                            *
+ * Kcall params:  p0      - callback                                          *
+ *                p1      - callback argument                                 *
+ *                                                                            *
+ * Return params: p0      - timer handle, 0 when out of memory                *
+ *                                                                            *
+ *                Kernel call implementation for creating a software timer.   *
+ *                The timer is created stopped.                               *
  ******************************************************************************/
-void xtask_kcall_handler(unsigned int        callnr,
-                         struct k_data     * kdata,
-                         struct kcall_data * kcall)
+void xtask_kcall_create_timer(unsigned int        callnr,
+                              struct k_data     * kdata, 
+                              struct kcall_data * kcall)
 {
-  /*switch (callnr) {
-    case 0: xtask_kcall_delay_ticks(callnr, kdata, kcall);          break;
-    case 1: xtask_kcall_create_thread(callnr, kdata, kcall);        break;
-    case 2: xtask_kcall_vc_receive(callnr, kdata, kcall);           break;
-    case 3: xtask_kcall_vc_get_write_buf(callnr, kdata, kcall);     break;
-    case 4: xtask_kcall_vc_send(callnr, kdata, kcall);              break;
-    case 5: xtask_kcall_create_mailbox(callnr, kdata, kcall);       break;
-    case 6: xtask_kcall_create_remote_thread(callnr, kdata, kcall); break;
-    case 7: xtask_kcall_get_outbox(callnr, kdata, kcall);           break;
-    case 8: xtask_kcall_send_outbox(callnr, kdata, kcall);          break;
-    case 9: xtask_kcall_get_inbox(callnr, kdata, kcall);            break;
-    case 10: xtask_kcall_create_task(callnr, kdata, kcall);         break;
-    case 11: xtask_kcall_exit(callnr, kdata, kcall);                break;
-  }*/
-  
-  (*kdata->kcall_table[callnr])(callnr, kdata, kcall);
+  struct timer_entry *te = malloc(sizeof(struct timer_entry));
+
+  if (te != NULL) {
+    te->code   = (timer_code) kcall->p0;
+    te->args   = (void *) kcall->p1;
+    te->expiry = 0;
+    te->period = 0;
+    te->state  = 0;
+    te->next   = NULL;
+  }
+
+  kcall->p0 = (unsigned int) te;
 }
 
 /******************************************************************************
- * Function:     xtask_check_delayed_tasks                                    *
- * Parameters:   kdata  - pointer to kdata structure.                         *
- * Return:       void                                                         *
+ * Function:      xtask_kcall_start_timer                                     *
+ * Parameters:    callnr  - Kernel call number.                               *
+ *                kdata   - Pointer to k_data structure.                      *
+ *                kcall   - kernel call parameters.                           *
  *                                                                            *
- *               This function checks the list of delayed tasks and           *
- *               removes all tasks for which the delay is expired.            *
- *               These tasks are then moved to their corresponding ready      *
- *               queue. The list is sorted by expiring delays, so we can stop *
- *               searching when we find the first task for which the delay    *
- *               has not expired. This function is called on each kernel tick.*
+ * Return:        void                                                        *
+ *                                                                            *
+ * Kcall params:  p0      - timer handle                                      *
+ *                p1      - ticks until first expiry                          *
+ *                p2      - period in ticks, 0 for a one-shot timer           *
+ *                                                                            *
+ * Return params: none                                                        *
+ *                                                                            *
+ *                Kernel call implementation for (re)starting a software      *
+ *                timer. A running timer is restarted with the new values.    *
  ******************************************************************************/
-void xtask_check_delayed_tasks(struct k_data *kdata)
+void xtask_kcall_start_timer(unsigned int        callnr,
+                             struct k_data     * kdata, 
+                             struct kcall_data * kcall)
 {
-  struct task_entry *pe;
+  struct timer_entry *te = (struct timer_entry *) kcall->p0;
 
-  while (kdata->delay_head != NULL && kdata->delay_head->delay == kdata->time) {
-    pe = kdata->delay_head->next;
-    xtask_enqueue(kdata, kdata->delay_head);
-    kdata->delay_head = pe;
-  }
+  xtask_timer_disarm(kdata, te);
+  te->period = kcall->p2;
+  xtask_timer_arm(kdata, te, kcall->p1);
 }
 
 /******************************************************************************
- * Function:     xtask_get_not_chan                                           *
- * Parameters:   kdata  - pointer to kdata structure.                         *
- * Return:       chanend resource id for asynchronous management channel      *
+ * Function:      xtask_kcall_stop_timer                                      *
+ * Parameters:    callnr  - Kernel call number.                               *
+ *                kdata   - Pointer to k_data structure.                      *
+ *                kcall   - kernel call parameters.                           *
  *                                                                            *
- *               This function provides easy access to this data datastructure*
- *               for one or more asm functions. This dependency needs to be   *
- *               removed!                                                     *
+ * Return:        void                                                        *
+ *                                                                            *
+ * Kcall params:  p0      - timer handle                                      *
+ *                                                                            *
+ * Return params: none                                                        *
+ *                                                                            *
+ *                Kernel call implementation for stopping a software timer.   *
  ******************************************************************************/
-unsigned int xtask_get_not_chan(struct k_data *kdata)
+void xtask_kcall_stop_timer(unsigned int        callnr,
+                            struct k_data     * kdata, 
+                            struct kcall_data * kcall)
 {
-  return kdata->cs_async;
+  xtask_timer_disarm(kdata, (struct timer_entry *) kcall->p0);
 }
 
 /******************************************************************************
- * Function:     xtask_not_handler                                            *
- * Parameters:   k      - pointer to kdata structure.                         *
- * Return:       void                                                         *
+ * Function:      xtask_kcall_delete_timer                                    *
+ * Parameters:    callnr  - Kernel call number.                               *
+ *                kdata   - Pointer to k_data structure.                      *
+ *                kcall   - kernel call parameters.                           *
  *                                                                            *
- *               This function is called when an asynchronous notification    *
- *               is received from the CS. The notification does not contain   *
- *               any further information other than that something has        *
- *               happened that interests this kernel. This function will then *
- *               ask the CS about the details and processes the reply from CS.*
+ * Return:        void                                                        *
  *                                                                            *
- *               To Do: move duplicate code to function.                      *
- *               For example removing tasks from block list.                  *
- *               Divide in subfunctions.                                      * 
+ * Kcall params:  p0      - timer handle                                      *
+ *                                                                            *
+ * Return params: none                                                        *
+ *                                                                            *
+ *                Kernel call implementation for deleting a software timer.   *
  ******************************************************************************/
-void xtask_not_handler(struct k_data *k)
+void xtask_kcall_delete_timer(unsigned int        callnr,
+                              struct k_data     * kdata, 
+                              struct kcall_data * kcall)
 {
-  struct man_msg msg;
+  struct timer_entry *te = (struct timer_entry *) kcall->p0;
 
-  // ask CS about the event details
-  msg.cmd = 10;
-  _xtask_man_sendrec(k->cs_sync,(void *)&msg);
-  
-  // The event details are now in msg  
-  
-  if (msg.cmd == 1) {
-    /*  
-       unblock task waiting for data from VC
-       msg.p0 = handle
-       msg.p1 = pointer to vc_buf
-    */
-    struct task_entry **xpp;
-    struct task_entry *xp;
-    xpp = &k->block_head;
-
-    // find task in block list
-    while (*xpp != NULL && (*xpp)->kcall_params->p0 != msg.p0) {
-      xpp = &(*xpp)->next;
-    }
+  xtask_timer_disarm(kdata, te);
+  free(te);
+}
 
-    if (*xpp != NULL) {
-      // remove task from block list
-      xp = *xpp;
-      *xpp = (*xpp)->next;
+
+/******************************************************************************
+ * Function:      xtask_kcall_set_threshold                                   *
+ * Parameters:    callnr  - Kernel call number.                               *
+ *                kdata   - Pointer to k_data structure.                      *
+ *                kcall   - kernel call parameters.                           *
+ *                                                                            *
+ * Return:        void                                                        *
+ *                                                                            *
+ * Kcall params:  p0      - new preemption threshold                          *
+ *                                                                            *
+ * Return params: p0      - previous preemption threshold                     *
+ *                                                                            *
+ *                Kernel call implementation for setting the preemption       *
+ *                threshold of the calling task. Only tasks with a priority   *
+ *                number lower than the threshold may preempt the task. The   *
+ *                threshold is limited to priority + 1, which is the default  *
+ *                and lets tasks of the same priority share the processor.    *
+ *                While the task has used up the budget of its reservation    *
+ *                the new threshold is stored until the replenishment.        *
+ ******************************************************************************/
+void xtask_kcall_set_threshold(unsigned int        callnr,
+                               struct k_data     * kdata, 
+                               struct kcall_data * kcall)
+{
+  struct task_entry *pe = kdata->current_task;
+  unsigned int old;
+
+  if (pe->resv != NULL && pe->resv->remaining == 0) {
+    // budget used up, the threshold takes effect after replenishment
+    old = pe->resv->threshold;
+
+    if (kcall->p0 > pe->resv->priority + 1) {
+      pe->resv->threshold = pe->resv->priority + 1;
     } else {
-      // task not found
-      return;
+      pe->resv->threshold = kcall->p0;
     }
 
-    // return pointer to vc_buf
-    xp->kcall_params->p0 = msg.p1;
-    
-    // schedule unblocked task
-    xtask_enqueue(k, xp);
-    
-    // add interrupted task back to scheduling queue 
-    xtask_enqueue(k, k->current_task);
-    
-    // pick next task to run
-    k->current_task = NULL;
-    xtask_pick_task(k);
-    
-  } else if (msg.cmd == 2) {
-    /*  
-       Result from creating remote hardware thread
-       msg.p0 = new handle
-       msg.p1 = task id of requesting task
-    */
-
-    struct task_entry **xpp;
-    struct task_entry *xp;
-    xpp = &k->block_head;
-
-    // find blocked task in block list
-    while (*xpp != NULL && (*xpp)->tid != msg.p1) {
-      xpp = &(*xpp)->next;
-    }
+    kcall->p0 = old;
+    return;
+  }
 
-    if (*xpp != NULL) {
-      // remove task from block list
-      xp = *xpp;
-      *xpp = (*xpp)->next;
-    } else {
-      // task not found
+  old = pe->threshold;
+
+  if (kcall->p0 > pe->priority + 1) {
+    pe->threshold = pe->priority + 1;
+  } else {
+    pe->threshold = kcall->p0;
+  }
+
+  kcall->p0 = old;
+}
+
+/******************************************************************************
+ * Function:      xtask_kcall_yield                                           *
+ * Parameters:    callnr  - Kernel call number.                               *
+ *                kdata   - Pointer to k_data structure.                      *
+ *                kcall   - kernel call parameters.                           *
+ *                                                                            *
+ * Return:        void                                                        *
+ *                                                                            *
+ * Kcall params:  none                                                        *
+ *                                                                            *
+ * Return params: none                                                        *
+ *                                                                            *
+ *                Kernel call implementation for yielding the processor.      *
+ *                The calling task is moved to the back of its scheduling     *
+ *                queue, regardless of threshold and scheduling mode.         *
+ ******************************************************************************/
+void xtask_kcall_yield(unsigned int        callnr,
+                       struct k_data     * kdata, 
+                       struct kcall_data * kcall)
+{
+  xtask_enqueue(kdata, kdata->current_task);
+  kdata->current_task = NULL;
+  xtask_pick_task(kdata);
+}
+
+/******************************************************************************
+ * Function:      xtask_kcall_set_reservation                                 *
+ * Parameters:    callnr  - Kernel call number.                               *
+ *                kdata   - Pointer to k_data structure.                      *
+ *                kcall   - kernel call parameters.                           *
+ *                                                                            *
+ * Return:        void                                                        *
+ *                                                                            *
+ * Kcall params:  p0      - budget in timer cycles per period, 0 to remove    *
+ *                p1      - period in ticks                                   *
+ *                                                                            *
+ * Return params: p0      - 0 on success, 1 on failure                        *
+ *                                                                            *
+ *                Kernel call implementation for setting the CPU budget       *
+ *                reservation of the calling task. The first period starts    *
+ *                with a full budget. The free running accounting timer is    *
+ *                allocated with the first reservation on this kernel.        *
+ ******************************************************************************/
+void xtask_kcall_set_reservation(unsigned int        callnr,
+                                 struct k_data     * kdata, 
+                                 struct kcall_data * kcall)
+{
+  struct task_entry *pe = kdata->current_task;
+  struct reservation *rp = pe->resv;
+  unsigned int res;
+
+  if (kcall->p0 == 0) {
+    xtask_resv_release(kdata, pe);
+    kcall->p0 = 0;
+    return;
+  }
+
+  if (kcall->p1 == 0) {
+    kcall->p0 = 1;
+    return;
+  }
+
+  if (kdata->acct_timer == 0) {
+    __asm__ volatile ("getr %0, 1":"=r"(res));
+
+    if (res == 0) {
+      kcall->p0 = 1; // out of timers
       return;
     }
-    
-    // return new handle
-    xp->kcall_params->p0 = msg.p0;
-    
-    // schedule unblocked task
-    xtask_enqueue(k, xp);
-    
-    // move interrupted task back to scheduling queue
-    xtask_enqueue(k, k->current_task);
-    
-    // pick next task to run
-    k->current_task = NULL;
-    xtask_pick_task(k);
-
-  } else if (msg.cmd == 3) {
-    /*  
-       Unblock recipient task
-       msg.p0 = task id
-       msg.p1 = pointer to vc_buf
-    */
-  
-    struct task_entry **xpp;
-    struct task_entry *xp;
-    xpp = &k->block_head;
-    
-    // find task in block list
-    while (*xpp != NULL && (*xpp)->tid != msg.p0) {
-      xpp = &(*xpp)->next;
-    }
 
-    if (*xpp != NULL) {
-      // remove task from block list
-      xp = *xpp;
-      *xpp = (*xpp)->next;
-    } else {
-      // task not found
+    __asm__ volatile ("in %0, res[%1]":"=r"(kdata->acct_stamp):"r"(res));
+    kdata->acct_timer = res;
+  }
+
+  if (rp == NULL) {
+    rp = malloc(sizeof(struct reservation));
+
+    if (rp == NULL) {
+      kcall->p0 = 1;
       return;
     }
+
+    rp->task      = pe;
+    rp->priority  = pe->priority;
+    rp->threshold = pe->threshold;
+    rp->next      = kdata->resv_head;
+    kdata->resv_head = rp;
+    pe->resv      = rp;
+  } else if (rp->remaining == 0) {
+    pe->priority  = rp->priority;
+    pe->threshold = rp->threshold;
+  }
+
+  rp->budget    = kcall->p0;
+  rp->remaining = kcall->p0;
+  rp->period    = kcall->p1;
+  rp->replenish = kdata->time + kcall->p1;
+
+  kcall->p0 = 0;
+}
+
+/******************************************************************************
+ * Function:      xtask_kcall_create_event_group                              *
+ * Parameters:    callnr  - Kernel call number.                               *
+ *                kdata   - Pointer to k_data structure.                      *
+ *                kcall   - kernel call parameters.                           *
+ *                                                                            *
+ * Return:        void                                                        *
+ *                                                                            *
+ * Kcall params:  p0      - group id, 0 for a group that is only used on      *
+ *                          this kernel                                       *
+ *                                                                            *
+ * Return params: p0      - group handle, 0 on failure                        *
+ *                                                                            *
+ *                Kernel call implementation for creating an event flag       *
+ *                group. A group with an id is registered at the CS, so       *
+ *                other kernels on the same tile can set its flags.           *
+ ******************************************************************************/
+void xtask_kcall_create_event_group(unsigned int        callnr,
+                                    struct k_data     * kdata, 
+                                    struct kcall_data * kcall)
+{
+  struct event_group *eg = malloc(sizeof(struct event_group));
+  struct man_msg msg;
+
+  if (eg == NULL) {
+    kcall->p0 = 0;
+    return;
+  }
+
+  eg->id        = kcall->p0;
+  eg->flags     = 0;
+  eg->wait_head = NULL;
+
+  if (eg->id != 0) {
+    msg.cmd = 11;
+    msg.p0  = eg->id;             // group id
+    msg.p1  = (unsigned int) eg;  // group handle
     
-    // return pointer to vc_buf
-    xp->kcall_params->p0 = msg.p1;
-    
-    // schedule unblocked task
-    xtask_enqueue(k, xp);
-    
-    // move interrupted task back to scheduling queue
-    xtask_enqueue(k, k->current_task);
+    _xtask_man_sendrec(kdata->cs_sync, (void*)&msg);
     
-    // pick next task to run
-    k->current_task = NULL;
-    xtask_pick_task(k);
-  
-  } else if (msg.cmd == 4) {
-    /*  
-       Unblock sending task
-       msg.p0 = task id
-       msg.p1 = pointer to vc_buf
-       msg.p2 = return value
-    */
-
-    struct task_entry **xpp;
-    struct task_entry *xp;
-    xpp = &k->block_head;
-
-    // find task in block list
-    while (*xpp != NULL && (*xpp)->tid != msg.p0) {
-      xpp = &(*xpp)->next;
-    }
-
-    if (*xpp != NULL) {
-      // remove task from block list
-      xp = *xpp;
-      *xpp = (*xpp)->next;
-    } else {
-      // task not found
+    if (msg.p0 != 0) {
+      // id already registered
+      free(eg);
+      kcall->p0 = 0;
       return;
     }
-    
-    // return value
-    xp->kcall_params->p0 = msg.p1;
-    
-    // schedule unblocked task
-    xtask_enqueue(k, xp);
-    
-    // move interrupted task back to scheduling queue
-    xtask_enqueue(k, k->current_task);
-    
-    // pick next task to run
-    k->current_task = NULL;
-    xtask_pick_task(k);
-  } else {
-    // unknown message id received
+  }
+
+  kcall->p0 = (unsigned int) eg;
+}
+
+/******************************************************************************
+ * Function:      xtask_kcall_set_event_flags                                 *
+ * Parameters:    callnr  - Kernel call number.                               *
+ *                kdata   - Pointer to k_data structure.                      *
+ *                kcall   - kernel call parameters.                           *
+ *                                                                            *
+ * Return:        void                                                        *
+ *                                                                            *
+ * Kcall params:  p0      - group handle                                      *
+ *                p1      - flags to set                                      *
+ *                                                                            *
+ * Return params: p0      - flags of the group after setting                  *
+ *                                                                            *
+ *                Kernel call implementation for setting event flags. A       *
+ *                woken task of higher priority runs immediately.             *
+ ******************************************************************************/
+void xtask_kcall_set_event_flags(unsigned int        callnr,
+                                 struct k_data     * kdata, 
+                                 struct kcall_data * kcall)
+{
+  struct event_group *eg = (struct event_group *) kcall->p0;
+  int woken;
+
+  woken = xtask_event_flags_set(kdata, eg, kcall->p1);
+  kcall->p0 = eg->flags;
+
+  if (woken) {
+    xtask_preempt(kdata);
+  }
+}
+
+/******************************************************************************
+ * Function:      xtask_kcall_clear_event_flags                               *
+ * Parameters:    callnr  - Kernel call number.                               *
+ *                kdata   - Pointer to k_data structure.                      *
+ *                kcall   - kernel call parameters.                           *
+ *                                                                            *
+ * Return:        void                                                        *
+ *                                                                            *
+ * Kcall params:  p0      - group handle                                      *
+ *                p1      - flags to clear                                    *
+ *                                                                            *
+ * Return params: p0      - flags of the group before clearing                *
+ *                                                                            *
+ *                Kernel call implementation for clearing event flags.        *
+ ******************************************************************************/
+void xtask_kcall_clear_event_flags(unsigned int        callnr,
+                                   struct k_data     * kdata, 
+                                   struct kcall_data * kcall)
+{
+  struct event_group *eg = (struct event_group *) kcall->p0;
+
+  kcall->p0 = eg->flags;
+  eg->flags &= ~(kcall->p1);
+}
+
+/******************************************************************************
+ * Function:      xtask_kcall_wait_event_flags                                *
+ * Parameters:    callnr  - Kernel call number.                               *
+ *                kdata   - Pointer to k_data structure.                      *
+ *                kcall   - kernel call parameters.                           *
+ *                                                                            *
+ * Return:        void                                                        *
+ *                                                                            *
+ * Kcall params:  p0      - group handle                                      *
+ *                p1      - flags to wait for                                 *
+ *                p2      - options: EF_WAIT_ANY or EF_WAIT_ALL, optionally   *
+ *                          or'ed with EF_CLEAR                               *
+ *                                                                            *
+ * Return params: p0      - flags of the group that satisfied the wait,       *
+ *                          before they were cleared                          *
+ *                                                                            *
+ *                Kernel call implementation for waiting on event flags.      *
+ *                The task blocks in the wait queue of the group until the    *
+ *                condition holds.                                            *
+ ******************************************************************************/
+void xtask_kcall_wait_event_flags(unsigned int        callnr,
+                                  struct k_data     * kdata, 
+                                  struct kcall_data * kcall)
+{
+  struct event_group *eg = (struct event_group *) kcall->p0;
+  struct task_entry **xpp;
+  unsigned int match = eg->flags & kcall->p1;
+
+  if ((kcall->p2 & EF_WAIT_ALL) ? (match == kcall->p1) : (match != 0)) {
+    kcall->p0 = eg->flags;
+    
+    if (kcall->p2 & EF_CLEAR) {
+      eg->flags &= ~(kcall->p1);
+    }
+    
+    return;
+  }
+
+  /* save block data */
+  kdata->current_task->kcall_nr = callnr;
+  kdata->current_task->kcall_params = kcall;
+
+  /* add task to the back of the wait queue of the group */
+  xpp = &eg->wait_head;
+  
+  while (*xpp != NULL) {
+    xpp = &(*xpp)->next;
+  }
+
+  kdata->current_task->next = NULL;
+  *xpp = kdata->current_task;
+
+  /* invoke scheduler */
+  kdata->current_task = NULL;
+  xtask_pick_task(kdata);
+}
+
+/******************************************************************************
+ * Function:      xtask_kcall_set_event_flags_id                              *
+ * Parameters:    callnr  - Kernel call number.                               *
+ *                kdata   - Pointer to k_data structure.                      *
+ *                kcall   - kernel call parameters.                           *
+ *                                                                            *
+ * Return:        void                                                        *
+ *                                                                            *
+ * Kcall params:  p0      - group id                                          *
+ *                p1      - flags to set                                      *
+ *                                                                            *
+ * Return params: p0      - 0 on success, 1 when the group is unknown         *
+ *                                                                            *
+ *                Kernel call implementation for setting the event flags of   *
+ *                a group of any kernel on the same tile. The CS forwards the *
+ *                flags to the kernel that owns the group through its         *
+ *                notification channel.                                       *
+ ******************************************************************************/
+void xtask_kcall_set_event_flags_id(unsigned int        callnr,
+                                    struct k_data     * kdata, 
+                                    struct kcall_data * kcall)
+{
+  struct man_msg msg;
+    
+  msg.cmd = 12;
+  msg.p0 = kcall->p0; // group id
+  msg.p1 = kcall->p1; // flags
+    
+  _xtask_man_sendrec(kdata->cs_sync, (void*)&msg);
+    
+  kcall->p0 = msg.p0;
+}
+
+/******************************************************************************
+ * Function:      xtask_kcall_delete_event_group                              *
+ * Parameters:    callnr  - Kernel call number.                               *
+ *                kdata   - Pointer to k_data structure.                      *
+ *                kcall   - kernel call parameters.                           *
+ *                                                                            *
+ * Return:        void                                                        *
+ *                                                                            *
+ * Kcall params:  p0      - group handle                                      *
+ *                                                                            *
+ * Return params: p0      - 0 on success, 1 when tasks wait on the group      *
+ *                                                                            *
+ *                Kernel call implementation for deleting an event flag       *
+ *                group. A group with an id is first removed from the CS.     *
+ ******************************************************************************/
+void xtask_kcall_delete_event_group(unsigned int        callnr,
+                                    struct k_data     * kdata, 
+                                    struct kcall_data * kcall)
+{
+  struct event_group *eg = (struct event_group *) kcall->p0;
+  struct man_msg msg;
+
+  if (eg->wait_head != NULL) {
+    kcall->p0 = 1;
+    return;
+  }
+
+  if (eg->id != 0) {
+    msg.cmd = 21;
+    msg.p0  = eg->id; // group id
+    
+    _xtask_man_sendrec(kdata->cs_sync, (void*)&msg);
+  }
+
+  free(eg);
+
+  kcall->p0 = 0;
+}
+
+/******************************************************************************
+ * Function:      xtask_kcall_shobj_alloc                                     *
+ * Parameters:    callnr  - Kernel call number.                               *
+ *                kdata   - Pointer to k_data structure.                      *
+ *                kcall   - kernel call parameters.                           *
+ *                                                                            *
+ * Return:        void                                                        *
+ *                                                                            *
+ * Kcall params:  p0      - size of shared object in bytes                    *
+ *                                                                            *
+ * Return params: p0      - pointer to shared object, 0 on failure            *
+ *                                                                            *
+ *                Kernel call implementation for allocating a shared object.  *
+ *                The CS hands out the hardware lock, which is stored in the  *
+ *                first word of the object.                                   *
+ ******************************************************************************/
+void xtask_kcall_shobj_alloc(unsigned int        callnr,
+                             struct k_data     * kdata, 
+                             struct kcall_data * kcall)
+{
+  unsigned int *obj = malloc(kcall->p0);
+  struct man_msg msg;
+
+  if (obj == NULL) {
+    kcall->p0 = 0;
+    return;
+  }
+
+  msg.cmd = 13;
+  _xtask_man_sendrec(kdata->cs_sync, (void*)&msg);
+
+  if (msg.p0 == 0) {
+    // no hardware lock
+    free(obj);
+    kcall->p0 = 0;
+    return;
+  }
+
+  obj[0] = msg.p0;
+  kcall->p0 = (unsigned int) obj;
+}
+
+/******************************************************************************
+ * Function:      xtask_kcall_shobj_block                                     *
+ * Parameters:    callnr  - Kernel call number.                               *
+ *                kdata   - Pointer to k_data structure.                      *
+ *                kcall   - kernel call parameters.                           *
+ *                                                                            *
+ * Return:        void                                                        *
+ *                                                                            *
+ * Kcall params:  p0      - pointer to shared object                          *
+ *                p1      - shared object type                                *
+ *                p2      - pointer to waiter on the stack of the task        *
+ *                                                                            *
+ * Return params: none                                                        *
+ *                                                                            *
+ *                Kernel call implementation for blocking on a shared object. *
+ *                The task does not block when the object became available.   *
+ ******************************************************************************/
+void xtask_kcall_shobj_block(unsigned int        callnr,
+                             struct k_data     * kdata, 
+                             struct kcall_data * kcall)
+{
+  struct shobj_waiter *w = (struct shobj_waiter *) kcall->p2;
+  struct man_msg msg;
+
+  if (kdata->cs_handle == 0) {
+    // ask CS how it knows this kernel, wakers pass it back to the CS
+    msg.cmd = 14;
+    _xtask_man_sendrec(kdata->cs_sync, (void*)&msg);
+    kdata->cs_handle = msg.p0;
+  }
+
+  w->task    = kdata->current_task;
+  w->kernel  = kdata->cs_handle;
+  w->granted = 0;
+
+  if (!xtask_shobj_prepare_wait((void *) kcall->p0, kcall->p1, w)) {
+    return;
+  }
+
+  /* add waiter to list of shared object waiters */
+  w->k_next = kdata->shobj_waiters;
+  kdata->shobj_waiters = w;
+
+  /* invoke scheduler */
+  kdata->current_task = NULL;
+  xtask_pick_task(kdata);
+}
+
+/******************************************************************************
+ * Function:      xtask_kcall_shobj_kick                                      *
+ * Parameters:    callnr  - Kernel call number.                               *
+ *                kdata   - Pointer to k_data structure.                      *
+ *                kcall   - kernel call parameters.                           *
+ *                                                                            *
+ * Return:        void                                                        *
+ *                                                                            *
+ * Kcall params:  p0      - CS handle of the kernel of a woken waiter         *
+ *                                                                            *
+ * Return params: none                                                        *
+ *                                                                            *
+ *                Kernel call implementation for waking the kernel of a task  *
+ *                that got a shared object. Waiters on this kernel are        *
+ *                unblocked directly, another kernel is notified by the CS.   *
+ ******************************************************************************/
+void xtask_kcall_shobj_kick(unsigned int        callnr,
+                            struct k_data     * kdata, 
+                            struct kcall_data * kcall)
+{
+  struct man_msg msg;
+
+  if (kcall->p0 == kdata->cs_handle) {
+    if (xtask_check_shobj_waiters(kdata)) {
+      xtask_preempt(kdata);
+    }
+
+    return;
+  }
+
+  msg.cmd = 15;
+  msg.p0  = kcall->p0; // kernel to notify
+  _xtask_man_send(kdata->cs_sync, (void*)&msg);
+}
+
+/******************************************************************************
+ * Function:      xtask_kcall_delete_mailbox                                  *
+ * Parameters:    callnr  - Kernel call number.                               *
+ *                kdata   - Pointer to k_data structure.                      *
+ *                kcall   - kernel call parameters.                           *
+ *                                                                            *
+ * Return:        void                                                        *
+ *                                                                            *
+ * Kcall params:  p0      - mailbox id                                        *
+ *                                                                            *
+ * Return params: p0      - 0 on success, 1 when unknown, busy or not owned   *
+ *                          by the calling task                               *
+ *                                                                            *
+ *                Kernel call implementation for removing a mailbox.          *
+ ******************************************************************************/
+void xtask_kcall_delete_mailbox(unsigned int        callnr,
+                                struct k_data     * kdata, 
+                                struct kcall_data * kcall)
+{
+  struct man_msg msg;
+    
+  msg.cmd = 5;
+  msg.p0 = kcall->p0; // mailbox id
+  msg.p1 = kdata->current_task->tid; // calling task id
+  msg.p4 = MB_DELETE;
+    
+  _xtask_man_sendrec(kdata->cs_sync, (void*)&msg);
+    
+  kcall->p0 = msg.p0;      
+}
+
+/******************************************************************************
+ * Function:      xtask_kcall_send_outbox_multi                               *
+ * Parameters:    callnr  - Kernel call number.                               *
+ *                kdata   - Pointer to k_data structure.                      *
+ *                kcall   - kernel call parameters.                           *
+ *                                                                            *
+ * Return:        void                                                        *
+ *                                                                            *
+ * Kcall params:  p0      - sender mailbox id                                 *
+ *                p1      - pointer to array with recipient mailbox ids       *
+ *                p2      - number of recipients                              *
+ *                                                                            *
+ * Return params: set at CS message handler                                   *
+ *                                                                            *
+ *                Kernel call implementation for sending outbox to a set of   *
+ *                recipients.                                                 *
+ ******************************************************************************/
+void xtask_kcall_send_outbox_multi(unsigned int        callnr,
+                                   struct k_data     * kdata, 
+                                   struct kcall_data * kcall)
+{
+  /*     
+    Make a request at CS.
+    Block task until CS has offered the message
+    to all recipients.
+  */
+  struct man_msg msg;
+    
+  msg.cmd = 16;
+  msg.p0 = kcall->p0;
+  msg.p1 = kcall->p1;
+  msg.p2 = kcall->p2;
+  msg.p3 = kdata->current_task->tid; // calling task id
+    
+  _xtask_man_send(kdata->cs_sync, (void *)&msg);
+    
+  /* save block data */
+  kdata->current_task->kcall_nr = callnr;
+  kdata->current_task->kcall_params =  kcall;    
+
+  /* add process to block list */
+  kdata->current_task->next = kdata->block_head;
+  kdata->block_head = kdata->current_task;
+
+  /* invoke scheduler */
+  kdata->current_task = NULL;
+  xtask_pick_task(kdata);      
+}
+
+/******************************************************************************
+ * Function:      xtask_kcall_subscribe                                       *
+ * Parameters:    callnr  - Kernel call number.                               *
+ *                kdata   - Pointer to k_data structure.                      *
+ *                kcall   - kernel call parameters.                           *
+ *                                                                            *
+ * Return:        void                                                        *
+ *                                                                            *
+ * Kcall params:  p0      - topic id                                          *
+ *                p1      - mailbox id                                        *
+ *                p2      - SUB_ADD or SUB_REMOVE                             *
+ *                                                                            *
+ * Return params: p0      - 0 on success, 1 when the mailbox is unknown or    *
+ *                          the subscription does not exist                   *
+ *                                                                            *
+ *                Kernel call implementation for subscribing a mailbox to a   *
+ *                topic or removing the subscription.                         *
+ ******************************************************************************/
+void xtask_kcall_subscribe(unsigned int        callnr,
+                           struct k_data     * kdata, 
+                           struct kcall_data * kcall)
+{
+  struct man_msg msg;
+    
+  msg.cmd = 17;
+  msg.p0 = kcall->p0; // topic id
+  msg.p1 = kcall->p1; // mailbox id
+  msg.p2 = kcall->p2; // operation
+    
+  _xtask_man_sendrec(kdata->cs_sync, (void*)&msg);
+    
+  kcall->p0 = msg.p0;      
+}
+
+/******************************************************************************
+ * Function:      xtask_kcall_publish                                         *
+ * Parameters:    callnr  - Kernel call number.                               *
+ *                kdata   - Pointer to k_data structure.                      *
+ *                kcall   - kernel call parameters.                           *
+ *                                                                            *
+ * Return:        void                                                        *
+ *                                                                            *
+ * Kcall params:  p0      - topic id                                          *
+ *                p1      - sender mailbox id                                 *
+ *                                                                            *
+ * Return params: set at CS message handler                                   *
+ *                                                                            *
+ *                Kernel call implementation for publishing the outbox to     *
+ *                the subscribers of a topic.                                 *
+ ******************************************************************************/
+void xtask_kcall_publish(unsigned int        callnr,
+                         struct k_data     * kdata, 
+                         struct kcall_data * kcall)
+{
+  /*     
+    Make a request at CS.
+    Block task until the publication has 
+    passed all CS.
+  */
+  struct man_msg msg;
+    
+  msg.cmd = 18;
+  msg.p0 = kcall->p0;
+  msg.p1 = kcall->p1;
+  msg.p2 = kdata->current_task->tid; // calling task id
+    
+  _xtask_man_send(kdata->cs_sync, (void *)&msg);
+    
+  /* save block data */
+  kdata->current_task->kcall_nr = callnr;
+  kdata->current_task->kcall_params =  kcall;    
+
+  /* add process to block list */
+  kdata->current_task->next = kdata->block_head;
+  kdata->block_head = kdata->current_task;
+
+  /* invoke scheduler */
+  kdata->current_task = NULL;
+  xtask_pick_task(kdata);      
+}
+
+/******************************************************************************
+ * Function:      xtask_kcall_register_thread_code                            *
+ * Parameters:    callnr  - Kernel call number.                               *
+ *                kdata   - Pointer to k_data structure.                      *
+ *                kcall   - kernel call parameters.                           *
+ *                                                                            *
+ * Return:        void                                                        *
+ *                                                                            *
+ * Kcall params:  p0      - function number                                   *
+ *                p1      - entry point of hardware thread                    *
+ *                                                                            *
+ * Return params: p0      - 0 on success, 1 when the function number is       *
+ *                          invalid or already registered                     *
+ *                                                                            *
+ *                Kernel call implementation for registering a hardware       *
+ *                thread that tasks on other tiles can start by number.       *
+ ******************************************************************************/
+void xtask_kcall_register_thread_code(unsigned int        callnr,
+                                      struct k_data     * kdata, 
+                                      struct kcall_data * kcall)
+{
+  struct man_msg msg;
+    
+  msg.cmd = 19;
+  msg.p0 = kcall->p0; // function number
+  msg.p1 = kcall->p1; // entry point
+    
+  _xtask_man_sendrec(kdata->cs_sync, (void*)&msg);
+    
+  kcall->p0 = msg.p0;      
+}
+
+/******************************************************************************
+ * Function:      xtask_kcall_join_thread                                     *
+ * Parameters:    callnr  - Kernel call number.                               *
+ *                kdata   - Pointer to k_data structure.                      *
+ *                kcall   - kernel call parameters.                           *
+ *                                                                            *
+ * Return:        void                                                        *
+ *                                                                            *
+ * Kcall params:  p0      - hardware thread handle                            *
+ *                                                                            *
+ * Return params: set at CS message handler                                   *
+ *                                                                            *
+ *                Kernel call implementation for waiting until a hardware     *
+ *                thread exits.                                               *
+ ******************************************************************************/
+void xtask_kcall_join_thread(unsigned int        callnr,
+                             struct k_data     * kdata, 
+                             struct kcall_data * kcall)
+{
+  /*     
+    Make a request at CS.
+    Block task until the hardware
+    thread has exited.
+  */
+  struct man_msg msg;
+    
+  msg.cmd = 20;
+  msg.p0 = kdata->current_task->tid; // calling task id
+  msg.p1 = kcall->p0; // handle
+    
+  _xtask_man_send(kdata->cs_sync, (void *)&msg);
+    
+  /* save block data */
+  kdata->current_task->kcall_nr = callnr;
+  kdata->current_task->kcall_params =  kcall;    
+
+  /* add process to block list */
+  kdata->current_task->next = kdata->block_head;
+  kdata->block_head = kdata->current_task;
+
+  /* invoke scheduler */
+  kdata->current_task = NULL;
+  xtask_pick_task(kdata);      
+}
+
+/******************************************************************************
+ * Function:     xtask_kcall_handler                                          *
+ * Parameters:   callnr  - Kernel call number.                                *
+ *               kdata   - Pointer to the kdata structure                     *
+ *               kcall   - Pointer to kcall_data structure. This structure is *
+ *                         provided by the calling task and contains optional *
+ *                         arguments for the kernel call. It is also used to  *
+ *                         pass back return values from the kernel to         *
+ *                         the calling task.                                  *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               kernel call handler dispatch.                                *
+ *               This function is redundant and the handlers can be called    *
+ *               directly from the kernel assembly code, however this is      *
+ *               not implemented yet.                                         *   
+ ******************************************************************************/
+void xtask_kcall_handler(unsigned int        callnr,
+                         struct k_data     * kdata,
+                         struct kcall_data * kcall)
+{
+  /*switch (callnr) {
+    case 0: xtask_kcall_delay_ticks(callnr, kdata, kcall);          break;
+    case 1: xtask_kcall_create_thread(callnr, kdata, kcall);        break;
+    case 2: xtask_kcall_vc_receive(callnr, kdata, kcall);           break;
+    case 3: xtask_kcall_vc_get_write_buf(callnr, kdata, kcall);     break;
+    case 4: xtask_kcall_vc_send(callnr, kdata, kcall);              break;
+    case 5: xtask_kcall_create_mailbox(callnr, kdata, kcall);       break;
+    case 6: xtask_kcall_create_remote_thread(callnr, kdata, kcall); break;
+    case 7: xtask_kcall_get_outbox(callnr, kdata, kcall);           break;
+    case 8: xtask_kcall_send_outbox(callnr, kdata, kcall);          break;
+    case 9: xtask_kcall_get_inbox(callnr, kdata, kcall);            break;
+    case 10: xtask_kcall_create_task(callnr, kdata, kcall);         break;
+    case 11: xtask_kcall_exit(callnr, kdata, kcall);                break;
+  }*/
+
+  // charge the time since the last kernel entry to the calling task
+  xtask_account(kdata);
+  
+  (*kdata->kcall_table[callnr])(callnr, kdata, kcall);
+}
+
+/******************************************************************************
+ * Function:     xtask_check_delayed_tasks                                    *
+ * Parameters:   kdata  - pointer to kdata structure.                         *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               This function checks the list of delayed tasks and           *
+ *               removes all tasks for which the delay is expired.            *
+ *               These tasks are then moved to their corresponding ready      *
+ *               queue. The list is sorted by expiring delays, so we can stop *
+ *               searching when we find the first task for which the delay    *
+ *               has not expired. This function is called on each kernel tick.*
+ ******************************************************************************/
+void xtask_check_delayed_tasks(struct k_data *kdata)
+{
+  struct task_entry *pe;
+
+  while (kdata->delay_head != NULL && kdata->delay_head->delay == kdata->time) {
+    pe = kdata->delay_head->next;
+    xtask_enqueue(kdata, kdata->delay_head);
+    kdata->delay_head = pe;
+  }
+}
+
+/******************************************************************************
+ * Function:     xtask_check_timers                                           *
+ * Parameters:   kdata  - pointer to kdata structure.                         *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Run the callbacks of all software timers that expire on the  *
+ *               current tick. Only the wheel slot of the current tick is     *
+ *               searched, so the cost does not depend on the total number    *
+ *               of timers. Periodic timers are re-armed before their         *
+ *               callback runs. This function is called on each kernel tick,  *
+ *               the callbacks run on the kernel stack with interrupts        *
+ *               disabled and may not perform any kernel calls.               *
+ ******************************************************************************/
+void xtask_check_timers(struct k_data *kdata)
+{
+  struct timer_entry **tpp;
+  struct timer_entry *te;
+  struct timer_entry *expired = NULL;
+
+  tpp = &kdata->timer_wheel[kdata->time & (TIMER_WHEEL_SIZE-1)];
+
+  // move expired timers to a private list first,
+  // a periodic timer may be re-armed in the same slot
+  while (*tpp != NULL) {
+    if ((*tpp)->expiry == kdata->time) {
+      te = *tpp;
+      *tpp = te->next;
+      te->next = expired;
+      expired = te;
+    } else {
+      tpp = &(*tpp)->next;
+    }
+  }
+
+  while (expired != NULL) {
+    te = expired;
+    expired = te->next;
+    te->state &= ~(TIMER_ACTIVE);
+
+    if (te->period > 0) {
+      xtask_timer_arm(kdata, te, te->period);
+    }
+
+    (*te->code)(te->args);
+  }
+}
+
+/******************************************************************************
+ * Function:     xtask_timer_arm                                              *
+ * Parameters:   kdata  - pointer to kdata structure.                         *
+ *               te     - pointer to software timer.                          *
+ *               ticks  - number of ticks until expiry.                       *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Add a software timer to the front of its timer wheel slot.   *
+ *               A timer of 0 ticks expires on the next tick.                 *
+ ******************************************************************************/
+void xtask_timer_arm(struct k_data      * kdata, 
+                     struct timer_entry * te, 
+                     unsigned int         ticks)
+{
+  struct timer_entry **tpp;
+
+  if (ticks == 0) {
+    ticks = 1;
+  }
+
+  te->expiry = kdata->time + ticks;
+  te->state |= TIMER_ACTIVE;
+
+  tpp = &kdata->timer_wheel[te->expiry & (TIMER_WHEEL_SIZE-1)];
+  te->next = *tpp;
+  *tpp = te;
+}
+
+/******************************************************************************
+ * Function:     xtask_timer_disarm                                           *
+ * Parameters:   kdata  - pointer to kdata structure.                         *
+ *               te     - pointer to software timer.                          *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Remove a software timer from its timer wheel slot if it is   *
+ *               active.                                                      *
+ ******************************************************************************/
+void xtask_timer_disarm(struct k_data      * kdata, 
+                        struct timer_entry * te)
+{
+  struct timer_entry **tpp;
+
+  if (!(te->state & TIMER_ACTIVE)) {
+    return;
+  }
+
+  tpp = &kdata->timer_wheel[te->expiry & (TIMER_WHEEL_SIZE-1)];
+
+  while (*tpp != NULL && *tpp != te) {
+    tpp = &(*tpp)->next;
+  }
+
+  if (*tpp != NULL) {
+    *tpp = te->next;
+  }
+
+  te->state &= ~(TIMER_ACTIVE);
+  te->next = NULL;
+}
+
+/******************************************************************************
+ * Function:     xtask_event_flags_set                                        *
+ * Parameters:   kdata  - pointer to kdata structure.                         *
+ *               eg     - pointer to event flag group.                        *
+ *               flags  - flags to set.                                       *
+ * Return:       number of tasks that were woken                              *
+ *                                                                            *
+ *               Set event flags and move every waiting task of which the     *
+ *               condition holds to its scheduling queue. All waiters see the *
+ *               same flags, the flags of waiters with EF_CLEAR are cleared   *
+ *               after the whole wait queue has been checked.                 *
+ ******************************************************************************/
+int xtask_event_flags_set(struct k_data      * kdata,
+                          struct event_group * eg,
+                          unsigned int         flags)
+{
+  struct task_entry **xpp;
+  struct task_entry *xp;
+  struct kcall_data *kc;
+  unsigned int clear = 0;
+  unsigned int match;
+  int woken = 0;
+
+  eg->flags |= flags;
+  xpp = &eg->wait_head;
+
+  while (*xpp != NULL) {
+    kc = (*xpp)->kcall_params;
+    match = eg->flags & kc->p1;
+
+    if ((kc->p2 & EF_WAIT_ALL) ? (match == kc->p1) : (match != 0)) {
+      // remove task from wait queue
+      xp = *xpp;
+      *xpp = xp->next;
+
+      if (kc->p2 & EF_CLEAR) {
+        clear |= kc->p1;
+      }
+
+      // return flags and schedule unblocked task
+      kc->p0 = eg->flags;
+      xtask_enqueue(kdata, xp);
+      woken++;
+    } else {
+      xpp = &(*xpp)->next;
+    }
+  }
+
+  eg->flags &= ~clear;
+
+  return woken;
+}
+
+/******************************************************************************
+ * Function:     xtask_check_shobj_waiters                                    *
+ * Parameters:   kdata  - pointer to kdata structure.                         *
+ * Return:       number of tasks that were woken                              *
+ *                                                                            *
+ *               Move the tasks that got the shared object they waited for    *
+ *               to their scheduling queue. This function is called when the  *
+ *               CS notifies the kernel and on each kernel tick, the tick     *
+ *               catches waiters woken by hardware threads.                   *
+ ******************************************************************************/
+int xtask_check_shobj_waiters(struct k_data *kdata)
+{
+  struct shobj_waiter **wpp = &kdata->shobj_waiters;
+  struct shobj_waiter *w;
+  int woken = 0;
+
+  while (*wpp != NULL) {
+    if ((*wpp)->granted) {
+      w = *wpp;
+      *wpp = w->k_next;
+      xtask_enqueue(kdata, w->task);
+      woken++;
+    } else {
+      wpp = &(*wpp)->k_next;
+    }
+  }
+
+  return woken;
+}
+
+/******************************************************************************
+ * Function:     xtask_get_not_chan                                           *
+ * Parameters:   kdata  - pointer to kdata structure.                         *
+ * Return:       chanend resource id for asynchronous management channel      *
+ *                                                                            *
+ *               This function provides easy access to this data datastructure*
+ *               for one or more asm functions. This dependency needs to be   *
+ *               removed!                                                     *
+ ******************************************************************************/
+unsigned int xtask_get_not_chan(struct k_data *kdata)
+{
+  return kdata->cs_async;
+}
+
+/******************************************************************************
+ * Function:     xtask_not_handler                                            *
+ * Parameters:   k      - pointer to kdata structure.                         *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               This function is called when an asynchronous notification    *
+ *               is received from the CS. The notification does not contain   *
+ *               any further information other than that something has        *
+ *               happened that interests this kernel. This function will then *
+ *               ask the CS about the details and processes the reply from CS.*
+ *               The CS sends one notification for any number of pending      *
+ *               replies, so the details are read until the CS has none left. *
+ *                                                                            *
+ *               To Do: move duplicate code to function.                      *
+ *               For example removing tasks from block list.                  *
+ *               Divide in subfunctions.                                      * 
+ ******************************************************************************/
+void xtask_not_handler(struct k_data *k)
+{
+  struct man_msg msg;
+  int woken = 0;
+
+  // charge the time since the last kernel entry to the interrupted task
+  xtask_account(k);
+
+  // the CS notifies once for all pending replies, read until none is left
+  for (;;) {
+    // ask CS about the event details
+    msg.cmd = 10;
+    _xtask_man_sendrec(k->cs_sync,(void *)&msg);
+  
+    // The event details are now in msg  
+  
+    if (msg.cmd == 0) {
+      // no more pending replies
+      break;
+    } else if (msg.cmd == 1) {
+      /*  
+         unblock task waiting for data from VC
+         msg.p0 = handle
+         msg.p1 = pointer to vc_buf
+      */
+      struct task_entry **xpp;
+      struct task_entry *xp;
+      xpp = &k->block_head;
+
+      // find task in block list
+      while (*xpp != NULL && 
+             ((*xpp)->kcall_nr != 2 || (*xpp)->kcall_params->p0 != msg.p0)) {
+        xpp = &(*xpp)->next;
+      }
+
+      if (*xpp != NULL) {
+        // remove task from block list
+        xp = *xpp;
+        *xpp = (*xpp)->next;
+      } else {
+        // task not found
+        continue;
+      }
+
+      // return pointer to vc_buf
+      xp->kcall_params->p0 = msg.p1;
+    
+      // schedule unblocked task
+      xtask_enqueue(k, xp);
+    
+      woken = 1;
+    
+    } else if (msg.cmd == 2) {
+      /*  
+         Result from creating remote hardware thread
+         msg.p0 = new handle, 0 on failure
+         msg.p1 = task id of requesting task
+      */
+
+      struct task_entry **xpp;
+      struct task_entry *xp;
+      xpp = &k->block_head;
+
+      // find blocked task in block list
+      while (*xpp != NULL && (*xpp)->tid != msg.p1) {
+        xpp = &(*xpp)->next;
+      }
+
+      if (*xpp != NULL) {
+        // remove task from block list
+        xp = *xpp;
+        *xpp = (*xpp)->next;
+      } else {
+        // task not found
+        continue;
+      }
+    
+      // return new handle
+      xp->kcall_params->p0 = msg.p0;
+    
+      // schedule unblocked task
+      xtask_enqueue(k, xp);
+    
+      woken = 1;
+
+    } else if (msg.cmd == 3) {
+      /*  
+         Unblock recipient task
+         msg.p0 = task id
+         msg.p1 = pointer to vc_buf
+      */
+  
+      struct task_entry **xpp;
+      struct task_entry *xp;
+      xpp = &k->block_head;
+    
+      // find task in block list
+      while (*xpp != NULL && (*xpp)->tid != msg.p0) {
+        xpp = &(*xpp)->next;
+      }
+
+      if (*xpp != NULL) {
+        // remove task from block list
+        xp = *xpp;
+        *xpp = (*xpp)->next;
+      } else {
+        // task not found
+        continue;
+      }
+    
+      // return pointer to vc_buf
+      xp->kcall_params->p0 = msg.p1;
+    
+      // schedule unblocked task
+      xtask_enqueue(k, xp);
+    
+      woken = 1;
+  
+    } else if (msg.cmd == 4) {
+      /*  
+         Unblock sending or joining task
+         msg.p0 = task id
+         msg.p1 = return value
+         msg.p2 = exit status of joined hardware thread
+      */
+
+      struct task_entry **xpp;
+      struct task_entry *xp;
+      xpp = &k->block_head;
+
+      // find task in block list
+      while (*xpp != NULL && (*xpp)->tid != msg.p0) {
+        xpp = &(*xpp)->next;
+      }
+
+      if (*xpp != NULL) {
+        // remove task from block list
+        xp = *xpp;
+        *xpp = (*xpp)->next;
+      } else {
+        // task not found
+        continue;
+      }
+    
+      // return value
+      xp->kcall_params->p0 = msg.p1;
+      xp->kcall_params->p1 = msg.p2;
+    
+      // schedule unblocked task
+      xtask_enqueue(k, xp);
+    
+      woken = 1;
+
+    } else if (msg.cmd == 5) {
+      /*
+         Event flags set by another task on this tile
+         msg.p0 = group handle
+         msg.p1 = flags
+      */
+
+      if (xtask_event_flags_set(k, (struct event_group *) msg.p0, msg.p1)) {
+        woken = 1;
+      }
+
+    } else if (msg.cmd == 6) {
+      /*
+         A task on another kernel released a shared object
+         for which a task of this kernel waits
+      */
+
+      if (xtask_check_shobj_waiters(k)) {
+        woken = 1;
+      }
+
+    } else if (msg.cmd == 7) {
+      /*  
+         unblock task waiting for a free VC write buffer
+         msg.p0 = handle
+         msg.p1 = pointer to vc_buf
+      */
+      struct task_entry **xpp;
+      struct task_entry *xp;
+      xpp = &k->block_head;
+
+      // find task in block list
+      while (*xpp != NULL && 
+             ((*xpp)->kcall_nr != 4 || (*xpp)->kcall_params->p1 != msg.p0)) {
+        xpp = &(*xpp)->next;
+      }
+
+      if (*xpp != NULL) {
+        // remove task from block list
+        xp = *xpp;
+        *xpp = (*xpp)->next;
+      } else {
+        // task not found
+        continue;
+      }
+
+      // return pointer to vc_buf
+      xp->kcall_params->p0 = msg.p1;
+    
+      // schedule unblocked task
+      xtask_enqueue(k, xp);
+    
+      woken = 1;
+
+    } else {
+      // unknown message id received
+    }
+  }
+
+  if (woken) {
+    // switch to an unblocked task if the interrupted task may be preempted
+    xtask_preempt(k);
   }
 }
@@ -0,0 +1,559 @@
+/******************************************************************************
+ *                                                                            *
+ * File:   shobj.c                                                            *
+ * Author: Bianco Zandbergen <bianco [AT] zandbergen.name>                    *
+ *                                                                            *
+ * This file is part of the xTask Distributed Operating System for            *
+ * the XMOS XS1 microprocessor architecture (www.xtask.org).                  *
+ *                                                                            *
+ * This file contains the shared objects: mutexes and queues in the shared    *
+ * memory of a tile, protected by hardware locks. They can be used by tasks   *
+ * on all kernels of the tile and by dedicated hardware threads. Only a task  *
+ * that has to block enters the kernel, the CS is only used to wake a task on *
+ * another kernel. More specific it contains the following functions:         *
+ *                                                                            *
+ * xtask_mutex_create       - create a mutex                                  *
+ * xtask_mutex_trylock      - lock a mutex if it is free                      *
+ * xtask_mutex_lock         - lock a mutex, spin and then block (tasks)       *
+ * xtask_mutex_unlock       - unlock a mutex (tasks)                          *
+ * xtask_hwt_mutex_lock     - lock a mutex, spin (hardware threads)           *
+ * xtask_hwt_mutex_unlock   - unlock a mutex (hardware threads)               *
+ * xtask_queue_create       - create a single consumer queue                  *
+ * xtask_queue_send         - add a word to a queue (tasks)                   *
+ * xtask_queue_receive      - take a word from a queue, block if empty (tasks)*
+ * xtask_hwt_queue_send     - add a word to a queue (hardware threads)        *
+ * xtask_hwt_queue_receive  - take a word from a queue, spin if empty         *
+ *                            (hardware threads)                              *
+ * xtask_shobj_prepare_wait - add a waiter to a shared object (kernel)        *
+ *                                                                            *
+ * internal functions:                                                        *
+ * shobj_acquire            - acquire hardware lock, disable interrupts       *
+ * shobj_release            - release hardware lock, restore interrupts       *
+ * shobj_alloc              - allocate shared object (kernel call)            *
+ * shobj_block              - block on a shared object (kernel call)          *
+ * shobj_kick               - wake a kernel (kernel call)                     *
+ * shobj_mutex_release      - hand mutex over to first waiter or free it      *
+ * shobj_queue_grant        - wake the blocked consumer of a queue            *
+ * shobj_queue_put          - add a word to a queue                           *
+ *                                                                            *
+ ******************************************************************************/
+
+#include <stdlib.h>
+#include <xccompat.h>
+#include "../include/kernel.h"
+#include "../include/shobj.h"
+
+/******************************************************************************
+ * Function:     shobj_acquire                                                *
+ * Parameters:   lock    - hardware lock resource.                            *
+ * Return:       previous interrupt enable bit of the status register         *
+ *                                                                            *
+ *               Acquire a hardware lock, the thread pauses until the lock    *
+ *               is free. Interrupts are disabled while the lock is held, a   *
+ *               task must not be preempted with the lock because its kernel  *
+ *               may spin on the same lock in xtask_shobj_prepare_wait.       *
+ ******************************************************************************/
+static unsigned int shobj_acquire(unsigned int lock)
+{
+  unsigned int dummy;
+  unsigned int sr;
+
+  __asm__ volatile ("getsr r11, 0x02\n\tadd %0, r11, 0":"=r"(sr)::"r11");
+  ENTER_CRITICAL();
+  __asm__ volatile ("in %0, res[%1]":"=r"(dummy):"r"(lock));
+
+  return sr;
+}
+
+/******************************************************************************
+ * Function:     shobj_release                                                *
+ * Parameters:   lock    - hardware lock resource.                            *
+ *               sr      - interrupt enable bit returned by shobj_acquire.    *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Release a hardware lock and enable interrupts again when     *
+ *               they were enabled before the lock was acquired.              *
+ ******************************************************************************/
+static void shobj_release(unsigned int lock, unsigned int sr)
+{
+  __asm__ volatile ("out res[%0], %0"::"r"(lock));
+
+  if (sr) {
+    EXIT_CRITICAL();
+  }
+}
+
+/******************************************************************************
+ * Function:     shobj_alloc                                                  *
+ * Parameters:   size    - size of the shared object in bytes.                *
+ * Return:       pointer to the shared object with the hardware lock in the   *
+ *               first word, NULL on failure                                  *
+ *                                                                            *
+ *               Allocate a shared object in the kernel.                      *
+ ******************************************************************************/
+static void * shobj_alloc(unsigned int size)
+{
+  struct kcall_data kcall_params;
+  struct kcall_data *p = &kcall_params;
+
+  kcall_params.p0 = size;
+
+  __asm__ volatile ("add r0, %0, 0"::"r"(p));
+  __asm__ volatile ("kcall 24");
+
+  return (void *) kcall_params.p0;
+}
+
+/******************************************************************************
+ * Function:     shobj_block                                                  *
+ * Parameters:   obj     - pointer to the shared object.                      *
+ *               type    - SHOBJ_MUTEX or SHOBJ_QUEUE.                        *
+ *               w       - waiter, on the stack of the calling task.          *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Block the calling task until the mutex is handed over or     *
+ *               the queue has data. Returns immediately when that already    *
+ *               happened while the task was spinning.                        *
+ ******************************************************************************/
+static void shobj_block(void *obj, unsigned int type, struct shobj_waiter *w)
+{
+  struct kcall_data kcall_params;
+  struct kcall_data *p = &kcall_params;
+
+  kcall_params.p0 = (unsigned int) obj;
+  kcall_params.p1 = type;
+  kcall_params.p2 = (unsigned int) w;
+
+  __asm__ volatile ("add r0, %0, 0"::"r"(p));
+  __asm__ volatile ("kcall 25");
+}
+
+/******************************************************************************
+ * Function:     shobj_kick                                                   *
+ * Parameters:   kernel  - CS handle of the kernel of a woken waiter.         *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Make a kernel check its waiters. A waiter on the kernel of   *
+ *               the calling task is unblocked directly, another kernel is    *
+ *               notified through the CS.                                     *
+ ******************************************************************************/
+static void shobj_kick(unsigned int kernel)
+{
+  struct kcall_data kcall_params;
+  struct kcall_data *p = &kcall_params;
+
+  kcall_params.p0 = kernel;
+
+  __asm__ volatile ("add r0, %0, 0"::"r"(p));
+  __asm__ volatile ("kcall 26");
+}
+
+/******************************************************************************
+ * Function:     shobj_mutex_release                                          *
+ * Parameters:   m       - pointer to mutex.                                  *
+ * Return:       CS handle of the kernel that must be woken, 0 if none        *
+ *                                                                            *
+ *               Hand the mutex over to the first waiter, the mutex stays     *
+ *               locked. Free the mutex when there are no waiters.            *
+ ******************************************************************************/
+static unsigned int shobj_mutex_release(struct shobj_mutex *m)
+{
+  struct shobj_waiter *w;
+  unsigned int kernel = 0;
+  unsigned int sr;
+
+  sr = shobj_acquire(m->lock);
+
+  w = m->wait_head;
+
+  if (w != NULL) {
+    m->wait_head = w->next;
+    kernel = w->kernel;  // w is gone as soon as the waiter runs again
+    w->granted = 1;
+  } else {
+    m->locked = 0;
+  }
+
+  shobj_release(m->lock, sr);
+
+  return kernel;
+}
+
+/******************************************************************************
+ * Function:     shobj_queue_grant                                            *
+ * Parameters:   q       - pointer to queue, the lock must be held.           *
+ * Return:       CS handle of the kernel that must be woken, 0 if none        *
+ *                                                                            *
+ *               Wake the blocked consumer of a queue.                        *
+ ******************************************************************************/
+static unsigned int shobj_queue_grant(struct shobj_queue *q)
+{
+  struct shobj_waiter *w = q->waiter;
+  unsigned int kernel;
+
+  if (w == NULL) {
+    return 0;
+  }
+
+  q->waiter = NULL;
+  kernel = w->kernel;
+  w->granted = 1;
+
+  return kernel;
+}
+
+/******************************************************************************
+ * Function:     shobj_queue_put                                              *
+ * Parameters:   q       - pointer to queue.                                  *
+ *               item    - word to add.                                       *
+ *               kick    - set to the CS handle of the kernel that must be    *
+ *                         woken, 0 if none.                                  *
+ * Return:       0 on success, 1 when the queue is full                       *
+ *                                                                            *
+ *               Add a word to a queue. A single producer does not take the   *
+ *               lock unless the consumer is blocked. The producer writes the *
+ *               tail before it reads the waiter and the consumer writes the  *
+ *               waiter before it reads the tail, so at least one of the two  *
+ *               sees the other.                                              *
+ ******************************************************************************/
+static unsigned int shobj_queue_put(struct shobj_queue * q,
+                                    unsigned int         item,
+                                    unsigned int       * kick)
+{
+  unsigned int sr;
+
+  *kick = 0;
+
+  if (q->flags & SHOBJ_MPSC) {
+    sr = shobj_acquire(q->lock);
+
+    if (q->tail - q->head == q->size) {
+      shobj_release(q->lock, sr);
+      return 1;
+    }
+
+    q->items[q->tail % q->size] = item;
+    q->tail++;
+    *kick = shobj_queue_grant(q);
+
+    shobj_release(q->lock, sr);
+  } else {
+    if (q->tail - q->head == q->size) {
+      return 1;
+    }
+
+    q->items[q->tail % q->size] = item;
+    q->tail++;
+
+    if (q->waiter != NULL) {
+      sr = shobj_acquire(q->lock);
+      *kick = shobj_queue_grant(q);
+      shobj_release(q->lock, sr);
+    }
+  }
+
+  return 0;
+}
+
+/******************************************************************************
+ * Function:     xtask_mutex_create                                           *
+ * Parameters:   none                                                         *
+ * Return:       mutex handle, 0 on failure                                   *
+ *                                                                            *
+ *               Create a mutex. The handle can be passed to tasks on other   *
+ *               kernels and to hardware threads of the same tile.            *
+ *               This function is part of the API.                            *
+ ******************************************************************************/
+unsigned int xtask_mutex_create(void)
+{
+  struct shobj_mutex *m = shobj_alloc(sizeof(struct shobj_mutex));
+
+  if (m == NULL) {
+    return 0;
+  }
+
+  m->locked    = 0;
+  m->wait_head = NULL;
+
+  return (unsigned int) m;
+}
+
+/******************************************************************************
+ * Function:     xtask_mutex_trylock                                          *
+ * Parameters:   mutex   - mutex handle.                                      *
+ * Return:       0 when the mutex has been locked, 1 when it is owned         *
+ *                                                                            *
+ *               Lock a mutex if it is free, never blocks.                    *
+ *               This function is part of the API.                            *
+ ******************************************************************************/
+unsigned int xtask_mutex_trylock(unsigned int mutex)
+{
+  struct shobj_mutex *m = (struct shobj_mutex *) mutex;
+  unsigned int owned;
+  unsigned int sr;
+
+  sr = shobj_acquire(m->lock);
+
+  owned = m->locked;
+  m->locked = 1;
+
+  shobj_release(m->lock, sr);
+
+  return owned;
+}
+
+/******************************************************************************
+ * Function:     xtask_mutex_lock                                             *
+ * Parameters:   mutex   - mutex handle.                                      *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Lock a mutex. The task tries SHOBJ_SPIN times and then       *
+ *               blocks until the owner hands the mutex over.                 *
+ *               This function is part of the API.                            *
+ ******************************************************************************/
+void xtask_mutex_lock(unsigned int mutex)
+{
+  struct shobj_waiter w;
+  int i;
+
+  for (i = 0; i < SHOBJ_SPIN; i++) {
+    if (!xtask_mutex_trylock(mutex)) {
+      return;
+    }
+  }
+
+  // the kernel takes the mutex if it has been freed in the meantime
+  shobj_block((void *) mutex, SHOBJ_MUTEX, &w);
+}
+
+/******************************************************************************
+ * Function:     xtask_mutex_unlock                                           *
+ * Parameters:   mutex   - mutex handle.                                      *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Unlock a mutex, the first waiting task becomes the owner.    *
+ *               This function is part of the API.                            *
+ ******************************************************************************/
+void xtask_mutex_unlock(unsigned int mutex)
+{
+  unsigned int kernel;
+
+  kernel = shobj_mutex_release((struct shobj_mutex *) mutex);
+
+  if (kernel != 0) {
+    shobj_kick(kernel);
+  }
+}
+
+/******************************************************************************
+ * Function:     xtask_hwt_mutex_lock                                         *
+ * Parameters:   mutex   - mutex handle.                                      *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Lock a mutex from a dedicated hardware thread. The thread    *
+ *               spins until the mutex is free.                               *
+ *               This function is part of the API.                            *
+ ******************************************************************************/
+void xtask_hwt_mutex_lock(unsigned int mutex)
+{
+  while (xtask_mutex_trylock(mutex));
+}
+
+/******************************************************************************
+ * Function:     xtask_hwt_mutex_unlock                                       *
+ * Parameters:   mutex   - mutex handle.                                      *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Unlock a mutex from a dedicated hardware thread. A waiting   *
+ *               task is unblocked by its kernel on the next tick.            *
+ *               This function is part of the API.                            *
+ ******************************************************************************/
+void xtask_hwt_mutex_unlock(unsigned int mutex)
+{
+  shobj_mutex_release((struct shobj_mutex *) mutex);
+}
+
+/******************************************************************************
+ * Function:     xtask_queue_create                                           *
+ * Parameters:   size    - capacity in words.                                 *
+ *               flags   - SHOBJ_SPSC for a single producer, SHOBJ_MPSC for   *
+ *                         multiple producers.                                *
+ * Return:       queue handle, 0 on failure                                   *
+ *                                                                            *
+ *               Create a queue of words with a single consumer.              *
+ *               This function is part of the API.                            *
+ ******************************************************************************/
+unsigned int xtask_queue_create(unsigned int size, unsigned int flags)
+{
+  struct shobj_queue *q;
+
+  q = shobj_alloc(sizeof(struct shobj_queue) + size * WORD_SIZE);
+
+  if (q == NULL) {
+    return 0;
+  }
+
+  q->flags  = flags;
+  q->size   = size;
+  q->head   = 0;
+  q->tail   = 0;
+  q->waiter = NULL;
+  q->items  = (unsigned int *) (q + 1);
+
+  return (unsigned int) q;
+}
+
+/******************************************************************************
+ * Function:     xtask_queue_send                                             *
+ * Parameters:   queue   - queue handle.                                      *
+ *               item    - word to send.                                      *
+ * Return:       0 on success, 1 when the queue is full                       *
+ *                                                                            *
+ *               Add a word to a queue and wake the consumer if it is         *
+ *               blocked. This function is part of the API.                   *
+ ******************************************************************************/
+unsigned int xtask_queue_send(unsigned int queue, unsigned int item)
+{
+  unsigned int kernel;
+
+  if (shobj_queue_put((struct shobj_queue *) queue, item, &kernel)) {
+    return 1;
+  }
+
+  if (kernel != 0) {
+    shobj_kick(kernel);
+  }
+
+  return 0;
+}
+
+/******************************************************************************
+ * Function:     xtask_queue_receive                                          *
+ * Parameters:   queue   - queue handle.                                      *
+ * Return:       received word                                                *
+ *                                                                            *
+ *               Take a word from a queue. When the queue is empty the task   *
+ *               spins SHOBJ_SPIN times and then blocks until a producer adds *
+ *               a word. This function is part of the API.                    *
+ ******************************************************************************/
+unsigned int xtask_queue_receive(unsigned int queue)
+{
+  struct shobj_queue *q = (struct shobj_queue *) queue;
+  struct shobj_waiter w;
+  unsigned int item;
+  int i;
+
+  while (q->head == q->tail) {
+    for (i = 0; i < SHOBJ_SPIN && q->head == q->tail; i++);
+
+    if (q->head == q->tail) {
+      shobj_block((void *) q, SHOBJ_QUEUE, &w);
+    }
+  }
+
+  item = q->items[q->head % q->size];
+  q->head++;
+
+  return item;
+}
+
+/******************************************************************************
+ * Function:     xtask_hwt_queue_send                                         *
+ * Parameters:   queue   - queue handle.                                      *
+ *               item    - word to send.                                      *
+ * Return:       0 on success, 1 when the queue is full                       *
+ *                                                                            *
+ *               Add a word to a queue from a dedicated hardware thread. A    *
+ *               blocked consumer task is unblocked by its kernel on the next *
+ *               tick. This function is part of the API.                      *
+ ******************************************************************************/
+unsigned int xtask_hwt_queue_send(unsigned int queue, unsigned int item)
+{
+  unsigned int kernel;
+
+  return shobj_queue_put((struct shobj_queue *) queue, item, &kernel);
+}
+
+/******************************************************************************
+ * Function:     xtask_hwt_queue_receive                                      *
+ * Parameters:   queue   - queue handle.                                      *
+ * Return:       received word                                                *
+ *                                                                            *
+ *               Take a word from a queue from a dedicated hardware thread.   *
+ *               The thread spins while the queue is empty.                   *
+ *               This function is part of the API.                            *
+ ******************************************************************************/
+unsigned int xtask_hwt_queue_receive(unsigned int queue)
+{
+  struct shobj_queue *q = (struct shobj_queue *) queue;
+  unsigned int item;
+
+  while (q->head == q->tail);
+
+  item = q->items[q->head % q->size];
+  q->head++;
+
+  return item;
+}
+
+/******************************************************************************
+ * Function:     xtask_shobj_prepare_wait                                     *
+ * Parameters:   obj     - pointer to the shared object.                      *
+ *               type    - SHOBJ_MUTEX or SHOBJ_QUEUE.                        *
+ *               w       - initialised waiter of the calling task.            *
+ * Return:       1 when the task must block, 0 when the mutex has been taken  *
+ *               or the queue has data                                        *
+ *                                                                            *
+ *               Add a waiter to a shared object. The state of the object is  *
+ *               checked again under the hardware lock, so a release between  *
+ *               the last try of the task and the kernel call is not missed.  *
+ *               This function is called by the kernel.                       *
+ ******************************************************************************/
+unsigned int xtask_shobj_prepare_wait(void                * obj,
+                                      unsigned int          type,
+                                      struct shobj_waiter * w)
+{
+  struct shobj_waiter **wpp;
+  unsigned int sr;
+
+  if (type == SHOBJ_MUTEX) {
+    struct shobj_mutex *m = (struct shobj_mutex *) obj;
+
+    sr = shobj_acquire(m->lock);
+
+    if (!m->locked) {
+      m->locked = 1;
+      shobj_release(m->lock, sr);
+      return 0;
+    }
+
+    // add waiter to the back of the wait queue
+    wpp = &m->wait_head;
+
+    while (*wpp != NULL) {
+      wpp = &(*wpp)->next;
+    }
+
+    w->next = NULL;
+    *wpp = w;
+
+    shobj_release(m->lock, sr);
+    return 1;
+  } else {
+    struct shobj_queue *q = (struct shobj_queue *) obj;
+
+    sr = shobj_acquire(q->lock);
+
+    // publish the waiter before checking for data, see shobj_queue_put
+    q->waiter = w;
+
+    if (q->head != q->tail) {
+      q->waiter = NULL;
+      shobj_release(q->lock, sr);
+      return 0;
+    }
+
+    shobj_release(q->lock, sr);
+    return 1;
+  }
+}
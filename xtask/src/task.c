@@ -12,6 +12,12 @@
  * xtask_create_init_task  - create initial task                              *
  * xtask_enqueue           - add task to scheduling queues                    *
  * xtask_pick_task         - pick next task to run (scheduler)                *
+ * xtask_preempt           - switch task if the current task may be preempted *
+ * xtask_dequeue           - remove task from its scheduling queue            *
+ * xtask_account           - charge CPU time to the reservation of the        *
+ *                           current task                                     *
+ * xtask_check_reservations - replenish CPU budget reservations               *
+ * xtask_resv_release      - remove the CPU budget reservation of a task      *
  *                                                                            *
  ******************************************************************************/
 #include <stdlib.h>
@@ -51,7 +57,13 @@ int xtask_create_init_task(task_code    code,
   pe->bottom_stack = (unsigned long*)stack;
   
   pe->priority = priority;
+
+  // by default tasks of the same priority share the processor
+  pe->threshold = priority + 1;
   
+  // no CPU budget reservation
+  pe->resv = NULL;
+
   // we don't know the next task in the scheduling queue
   pe->next = NULL;
     
@@ -110,7 +122,7 @@ void xtask_pick_task(struct k_data* kdata)
     printf("xtask_pick_task: current_task != NULL!\n");
   }*/
 
-  for (i = 0; i < 8; i++) {
+  for (i = 0; i < NR_PRIORITIES; i++) {
     if (kdata->sched_head[i] != NULL) {
       // we found a non-empty scheduling queue
       kdata->current_task  = kdata->sched_head[i];       // first task in queue is next task
@@ -122,3 +134,200 @@ void xtask_pick_task(struct k_data* kdata)
 }
 
 
+
+ /*****************************************************************************
+ * Function:     xtask_preempt                                                *
+ * Parameters:   kdata  - pointer to kdata structure                          *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Preemption point, used by the tick and notification          *
+ *               handlers. The current task is only moved back to the         *
+ *               scheduling queues when a ready task has a priority above     *
+ *               its preemption threshold. In cooperative mode the current    *
+ *               task is never preempted, tasks switch when they block or     *
+ *               yield. The idle task can always be preempted.                *
+ ******************************************************************************/
+void xtask_preempt(struct k_data *kdata)
+{
+  int i;
+
+  if (kdata->current_task != kdata->idle_task) {
+    
+    // a task that used up its budget can always be preempted
+    if (kdata->sched_mode == SCHED_COOPERATIVE &&
+        (kdata->current_task->resv == NULL || 
+         kdata->current_task->resv->remaining > 0)) {
+      return;
+    }
+
+    for (i = 0; i < kdata->current_task->threshold; i++) {
+      if (kdata->sched_head[i] != NULL) {
+        break;
+      }
+    }
+
+    if (i == kdata->current_task->threshold) {
+      return; // no ready task above the threshold, keep running
+    }
+  }
+
+  xtask_enqueue(kdata, kdata->current_task);
+  kdata->current_task = NULL;
+  xtask_pick_task(kdata);
+}
+
+ /*****************************************************************************
+ * Function:     xtask_dequeue                                                *
+ * Parameters:   kdata  - pointer to kdata structure                          *
+ *               proc   - pointer to the task_entry structure of the task     *
+ * Return:       1 if the task was removed from its scheduling queue,         *
+ *               0 if the task was not in its scheduling queue                *
+ *                                                                            *
+ *               Remove a task from the scheduling queue of its priority.     *
+ ******************************************************************************/
+int xtask_dequeue(struct k_data *kdata, struct task_entry *proc)
+{
+  struct task_entry **xpp;
+
+  xpp = &kdata->sched_head[proc->priority];
+
+  while (*xpp != NULL && *xpp != proc) {
+    xpp = &(*xpp)->next;
+  }
+
+  if (*xpp == NULL) {
+    return 0;
+  }
+
+  *xpp = proc->next;
+  proc->next = NULL;
+
+  return 1;
+}
+
+ /*****************************************************************************
+ * Function:     xtask_account                                                *
+ * Parameters:   kdata  - pointer to kdata structure                          *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Charge the timer cycles since the last accounting to the     *
+ *               reservation of the current task. This function is called on  *
+ *               each entry of the kernel, so every interval between two task *
+ *               switches is charged to the task that ran in it. When the     *
+ *               budget is used up the task drops to RESV_BG_PRIORITY until   *
+ *               its reservation is replenished. Nothing is done as long as   *
+ *               no reservation has been made on this kernel.                 *
+ ******************************************************************************/
+void xtask_account(struct k_data *kdata)
+{
+  struct task_entry *pe = kdata->current_task;
+  struct reservation *rp;
+  unsigned int now;
+  unsigned int used;
+
+  if (kdata->acct_timer == 0) {
+    return;
+  }
+
+  __asm__ volatile ("in %0, res[%1]":"=r"(now):"r"(kdata->acct_timer));
+  used = now - kdata->acct_stamp;
+  kdata->acct_stamp = now;
+
+  if (pe == NULL || pe->resv == NULL || pe->resv->remaining == 0) {
+    return;
+  }
+
+  rp = pe->resv;
+
+  if (used < rp->remaining) {
+    rp->remaining -= used;
+    return;
+  }
+
+  // budget used up, the task is not in a scheduling queue while running
+  rp->remaining = 0;
+
+  pe->priority  = RESV_BG_PRIORITY;
+  pe->threshold = pe->priority + 1;
+}
+
+ /*****************************************************************************
+ * Function:     xtask_check_reservations                                     *
+ * Parameters:   kdata  - pointer to kdata structure                          *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Account the current task and refill the budget of all        *
+ *               reservations of which the period ends on this tick. Unused   *
+ *               budget is not carried over to the next period. A task that   *
+ *               had used up its budget gets its priority and threshold back  *
+ *               and is moved to the scheduling queue of that priority.       *
+ *               This function is called on each kernel tick.                 *
+ ******************************************************************************/
+void xtask_check_reservations(struct k_data *kdata)
+{
+  struct reservation *rp;
+  struct task_entry *pe;
+  int queued;
+
+  xtask_account(kdata);
+
+  for (rp = kdata->resv_head; rp != NULL; rp = rp->next) {
+    if (rp->replenish != kdata->time) {
+      continue;
+    }
+
+    rp->replenish += rp->period;
+
+    if (rp->remaining == 0) {
+      pe = rp->task;
+      queued = (pe != kdata->current_task && xtask_dequeue(kdata, pe));
+
+      pe->priority  = rp->priority;
+      pe->threshold = rp->threshold;
+
+      if (queued) {
+        xtask_enqueue(kdata, pe);
+      }
+    }
+
+    rp->remaining = rp->budget;
+  }
+}
+
+ /*****************************************************************************
+ * Function:     xtask_resv_release                                           *
+ * Parameters:   kdata  - pointer to kdata structure                          *
+ *               proc   - pointer to the task_entry structure of the task     *
+ * Return:       void                                                         *
+ *                                                                            *
+ *               Remove the CPU budget reservation of a task. The priority    *
+ *               and threshold of the task are restored when its budget was   *
+ *               used up. The task must not be in a scheduling queue.         *
+ ******************************************************************************/
+void xtask_resv_release(struct k_data *kdata, struct task_entry *proc)
+{
+  struct reservation **rpp;
+  struct reservation *rp = proc->resv;
+
+  if (rp == NULL) {
+    return;
+  }
+
+  rpp = &kdata->resv_head;
+
+  while (*rpp != NULL && *rpp != rp) {
+    rpp = &(*rpp)->next;
+  }
+
+  if (*rpp != NULL) {
+    *rpp = rp->next;
+  }
+
+  if (rp->remaining == 0) {
+    proc->priority  = rp->priority;
+    proc->threshold = rp->threshold;
+  }
+
+  proc->resv = NULL;
+  free(rp);
+}